@@ -0,0 +1,118 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include "../../include/trading-db/qdb.hpp"
+
+// сравнение размера и скорости распаковки блоков тиков для разных форматов и кодеков
+// запуск: codec-benchmark [путь к файлу qdb ...]
+
+struct BenchmarkCase {
+    std::string name;
+    uint8_t     tick_format = trading_db::QdbCompactDataset::TICK_FORMAT_V2;
+    uint8_t     codec_id    = trading_db::QdbCodecRegistry::CODEC_ZSTD;
+};
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) paths.push_back(argv[i]);
+    if (paths.empty()) {
+        paths = {
+            "../../storage/test/AUDNZD.qdb",
+            "../../storage/test/EURUSD.qdb",
+            "../../storage/test/NZDUSD.qdb",
+            "../../storage/test/USDCAD.qdb",
+        };
+    }
+
+    const std::vector<BenchmarkCase> cases = {
+        {"v1 + zstd",   trading_db::QdbCompactDataset::TICK_FORMAT_V1, trading_db::QdbCodecRegistry::CODEC_ZSTD},
+        {"v2 + zstd",   trading_db::QdbCompactDataset::TICK_FORMAT_V2, trading_db::QdbCodecRegistry::CODEC_ZSTD},
+        {"v2 + bitpack",trading_db::QdbCompactDataset::TICK_FORMAT_V2, trading_db::QdbCodecRegistry::CODEC_BITPACK},
+    };
+    const int repeats = 5;
+
+    for (const auto &path : paths) {
+        trading_db::QdbStorage storage;
+        if (!storage.open(path, true)) {
+            std::cout << "open error: " << path << std::endl;
+            continue;
+        }
+        const int digits = storage.get_info_int(trading_db::QdbStorage::METADATA_TYPE::SYMBOL_DIGITS);
+
+        // исходные тики по часам
+        trading_db::QdbDataPreparation source;
+        source.config.price_scale = digits;
+        std::vector<uint64_t> keys;
+        std::vector<std::map<uint64_t, trading_db::ShortTick>> hours;
+        size_t num_ticks = 0;
+        storage.read_ticks_range(0, std::numeric_limits<int64_t>::max(), [&](
+                const uint64_t key,
+                const uint8_t *data,
+                const size_t size) {
+            std::map<uint64_t, trading_db::ShortTick> ticks;
+            if (!source.decompress_ticks(key, data, size, ticks)) return;
+            num_ticks += ticks.size();
+            keys.push_back(key);
+            hours.push_back(std::move(ticks));
+        });
+
+        std::cout << path << ": hours " << hours.size() << ", ticks " << num_ticks << std::endl;
+        for (const auto &item : cases) {
+            trading_db::QdbDataPreparation preparation;
+            preparation.config.price_scale = digits;
+            preparation.config.tick_format = item.tick_format;
+            preparation.config.codec_id = item.codec_id;
+
+            std::vector<std::vector<uint8_t>> blocks(hours.size());
+            size_t total_size = 0;
+            size_t errors = 0;
+            for (size_t i = 0; i < hours.size(); ++i) {
+                if (!preparation.compress_ticks(keys[i], hours[i], blocks[i])) ++errors;
+                total_size += blocks[i].size();
+            }
+
+            // распакованные тики должны совпадать с исходными бит в бит
+            std::vector<uint8_t> buffer;
+            for (size_t i = 0; i < blocks.size(); ++i) {
+                trading_db::QdbTickBlock block;
+                if (!preparation.decompress_ticks(keys[i], blocks[i].data(), blocks[i].size(), block, buffer) ||
+                    block.size() != hours[i].size()) {
+                    ++errors;
+                    continue;
+                }
+                size_t index = 0;
+                for (const auto &tick : hours[i]) {
+                    if (block.t_ms(index) != tick.first ||
+                        block.bid(index) != tick.second.bid ||
+                        block.ask(index) != tick.second.ask) {
+                        ++errors;
+                        break;
+                    }
+                    ++index;
+                }
+            }
+
+            // лучшее время распаковки из нескольких повторов
+            double best_ms = 0;
+            for (int r = 0; r < repeats; ++r) {
+                const auto start = std::chrono::steady_clock::now();
+                for (size_t i = 0; i < blocks.size(); ++i) {
+                    trading_db::QdbTickBlock block;
+                    if (!preparation.decompress_ticks(keys[i], blocks[i].data(), blocks[i].size(), block, buffer)) ++errors;
+                }
+                const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (!r || ms < best_ms) best_ms = ms;
+            }
+
+            std::cout
+                << "  " << std::setw(14) << std::left << item.name
+                << " size " << std::setw(10) << std::right << total_size
+                << " (" << std::fixed << std::setprecision(2) << (double)total_size / (double)std::max(num_ticks, (size_t)1) << " B/tick)"
+                << " decode " << std::setprecision(1) << best_ms << " ms"
+                << " (" << std::setprecision(1) << (double)num_ticks / std::max(best_ms, 0.001) / 1000.0 << " Mticks/s)"
+                << (errors ? " ERRORS " + std::to_string(errors) : std::string())
+                << std::endl;
+        }
+    }
+    return 0;
+}
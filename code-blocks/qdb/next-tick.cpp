@@ -6,6 +6,8 @@ int main() {
     const std::string path = "D:\\_repoz_trading\\mega-connector\\storage\\alpary-mt5-qdb\\AUDUSD.qdb";
 
     trading_db::QDB qdb;
+    // decode the next day of ticks in the background while iterating
+    qdb.config.prefetch_hours = 24;
     std::cout << "open status: " << qdb.open(path) << std::endl;
 
     uint64_t t_min = 0, t_max = 0;
@@ -11,23 +11,24 @@ int main() {
 
     trading_db::QdbPriceBuffer buffer;
 
-    buffer.on_read_ticks = [&](const uint64_t t) -> std::map<uint64_t, trading_db::ShortTick> {
+    buffer.on_read_ticks = [&](const uint64_t t) -> trading_db::QdbTickBlock {
         //std::cout << "on_read_ticks " << ztime::get_str_date_time(t) << std::endl;
-        std::map<uint64_t, trading_db::ShortTick> temp;
+        trading_db::QdbTickBlock temp;
         //if (ztime::get_hour_day(t) % 5 == 0) return temp;
         for (uint64_t i = t; i < (t + ztime::SEC_PER_HOUR); ++i) {
             if (i % 10 != 0) continue;
             const double price = get_price(i);
             const uint64_t t_ms = i * ztime::MS_PER_SEC;
             //std::cout << "gp " << price << " t " << ztime::get_str_date_time(i) << std::endl;
-            temp[t_ms] = trading_db::ShortTick(price, price + 1);
+            temp.push_back(t_ms, price, price + 1);
         }
         return temp;
     };
 
-    buffer.on_read_candles = [&](const uint64_t t) -> std::array<trading_db::Candle, ztime::MIN_PER_DAY> {
+    buffer.on_read_candles = [&](const uint64_t t) -> trading_db::QdbPriceBuffer::candles_day_ptr {
         //std::cout << "on_read_candles " << ztime::get_str_date_time(t) << std::endl;
-        std::array<trading_db::Candle, ztime::MIN_PER_DAY> temp;
+        auto day = std::make_shared<trading_db::QdbPriceBuffer::candles_day>();
+        auto &temp = *day;
         for (uint64_t i = t; i < (t + ztime::SEC_PER_DAY); ++i) {
             if (i % 10 != 0) continue;
             const uint32_t md = ztime::get_minute_day(i);
@@ -41,7 +42,7 @@ int main() {
                 temp[md].close = price;
             }
         }
-        return temp;
+        return day;
     };
 
     // тестируем получение цен через в виде свечей
@@ -0,0 +1,349 @@
+#pragma once
+#ifndef TRADING_DB_QDB_BITPACK_CODEC_HPP_INCLUDED
+#define TRADING_DB_QDB_BITPACK_CODEC_HPP_INCLUDED
+
+#include "compact-dataset.hpp"
+#include "compression-engine.hpp"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+namespace trading_db {
+
+	/** \brief Битовая упаковка столбцов блока тиков TICK_FORMAT_V2
+	 *
+	 * Формат TICK_FORMAT_V2 выбирает одну разрядность (1, 2, 4 или 8 байт) на весь столбец,
+	 * поэтому один выброс за час расширяет все значения столбца. Здесь каждый столбец
+	 * (дельты времени, дельты bid, спред) кодируется zigzag и упаковывается мини-блоками
+	 * по 128 значений, у каждого мини-блока своя разрядность в битах. Для каждого столбца
+	 * отдельно выбирается, хранить ли значения или их дельты (для времени - дельта дельт,
+	 * как в Gorilla), по меньшему размеру.
+	 *
+	 * Формат упакованных данных:
+	 * 0	режим (MODE_ZSTD - кадр zstd со словарем, MODE_TICKS_V2 - упакованный блок тиков)
+	 * далее для MODE_TICKS_V2: reg_a, reg_b, количество тиков и начальная цена (varint),
+	 * затем три столбца: флаг дельты (1 байт) и мини-блоки (разрядность 1 байт + упакованные биты)
+	 *
+	 * Распаковка восстанавливает исходный блок QdbCompactDataset бит в бит. Блоки другого
+	 * формата (бары, тики TICK_FORMAT_V1) сжимаются zstd, поэтому кодек можно выбрать для всей базы.
+	 * Упакованные тики не сжимаются энтропийным кодером: блок больше, чем у zstd, но распаковка быстрее.
+	 */
+	class QdbBitpackCodec {
+	public:
+
+		static const uint8_t MODE_ZSTD		= 0;	/**< Кадр zstd со словарем */
+		static const uint8_t MODE_TICKS_V2	= 1;	/**< Упакованный блок тиков TICK_FORMAT_V2 */
+
+		static const size_t MINI_BLOCK_SIZE = 128;	/**< Количество значений в мини-блоке */
+
+		/** \brief Упаковать блок QdbCompactDataset
+		 * \param dict_ptr	Указатель на данные словаря zstd (для блоков другого формата)
+		 * \param dict_size	Размер словаря
+		 * \param level		Уровень сжатия zstd (для блоков другого формата)
+		 * \param src		Блок
+		 * \param src_size	Размер блока
+		 * \param dst		Упакованные данные
+		 * \return Вернет true в случае успеха
+		 */
+		static bool encode(
+				const uint8_t *dict_ptr,
+				const size_t dict_size,
+				const int level,
+				const uint8_t *src,
+				const size_t src_size,
+				std::vector<uint8_t> &dst) noexcept {
+			dst.clear();
+			size_t count = 0, start_size = 0;
+			if (!parse_ticks_v2(src, src_size, count, start_size)) {
+				if (!QdbCompressionEngine::compress(dict_ptr, dict_size, level, src, src_size, dst)) return false;
+				dst.insert(dst.begin(), (uint8_t)MODE_ZSTD);
+				return true;
+			}
+			const uint8_t reg_b = src[1];
+			dst.push_back((uint8_t)MODE_TICKS_V2);
+			dst.push_back(src[0]);
+			dst.push_back(reg_b);
+			put_varint(dst, count);
+			put_varint(dst, get_value(src + 6, start_size, false));
+
+			std::vector<int64_t> column(count);
+			std::vector<uint64_t> zigzag(count);
+			const uint8_t widths[3] = {
+				(uint8_t)((reg_b >> 6) & 0x03),	// время
+				(uint8_t)((reg_b >> 2) & 0x03),	// дельты bid
+				(uint8_t)((reg_b >> 4) & 0x03)	// спред
+			};
+			size_t offset = 6 + start_size;
+			for (size_t c = 0; c < 3; ++c) {
+				const size_t bytes = (size_t)1 << widths[c];
+				for (size_t i = 0; i < count; ++i) {
+					column[i] = (int64_t)get_value(src + offset + i * bytes, bytes, true);
+				}
+				offset += count * bytes;
+				put_column(dst, column, zigzag);
+			}
+			return true;
+		}
+
+		/** \brief Распаковать блок QdbCompactDataset
+		 * \param dict_ptr	Указатель на данные словаря zstd
+		 * \param dict_size	Размер словаря
+		 * \param src		Упакованные данные
+		 * \param src_size	Размер упакованных данных
+		 * \param dst		Блок
+		 * \return Вернет false, если данные повреждены
+		 */
+		static bool decode(
+				const uint8_t *dict_ptr,
+				const size_t dict_size,
+				const uint8_t *src,
+				const size_t src_size,
+				std::vector<uint8_t> &dst) noexcept {
+			if (!src_size) return false;
+			if (src[0] == MODE_ZSTD) {
+				return QdbCompressionEngine::decompress(dict_ptr, dict_size, src + 1, src_size - 1, dst);
+			}
+			if (src[0] != MODE_TICKS_V2 || src_size < 3) return false;
+			const uint8_t reg_b = src[2];
+			size_t pos = 3;
+			uint64_t count = 0, start_price = 0;
+			if (!get_varint(src, src_size, pos, count) ||
+				!get_varint(src, src_size, pos, start_price)) return false;
+			if (count > src_size * MINI_BLOCK_SIZE) return false;
+
+			const uint8_t widths[3] = {
+				(uint8_t)((reg_b >> 6) & 0x03),
+				(uint8_t)((reg_b >> 2) & 0x03),
+				(uint8_t)((reg_b >> 4) & 0x03)
+			};
+			const size_t start_size = (size_t)1 << (reg_b & 0x03);
+			size_t offset = 6 + start_size;
+			dst.resize(offset + count * (
+				((size_t)1 << widths[0]) + ((size_t)1 << widths[1]) + ((size_t)1 << widths[2])));
+			dst[0] = src[1];
+			dst[1] = reg_b;
+			set_value(dst.data() + 2, count, 4);
+			set_value(dst.data() + 6, start_price, start_size);
+
+			std::vector<int64_t> column(count);
+			for (size_t c = 0; c < 3; ++c) {
+				if (!get_column(src, src_size, pos, column)) return false;
+				const size_t bytes = (size_t)1 << widths[c];
+				uint8_t *p = dst.data() + offset;
+				switch (widths[c]) {
+				case 0: store_column<int8_t>(column, p); break;
+				case 1: store_column<int16_t>(column, p); break;
+				case 2: store_column<int32_t>(column, p); break;
+				case 3: store_column<int64_t>(column, p); break;
+				};
+				offset += count * bytes;
+			}
+			return pos == src_size;
+		}
+
+	private:
+
+		// проверяем, что блок записан в формате TICK_FORMAT_V2, и получаем его размеры
+		static bool parse_ticks_v2(const uint8_t *src, const size_t src_size, size_t &count, size_t &start_size) noexcept {
+			if (src_size < 6 || ((src[0] >> 4) & 0x0F) != QdbCompactDataset::TICK_FORMAT_V2) return false;
+			const uint8_t reg_b = src[1];
+			count = (size_t)get_value(src + 2, 4, false);
+			start_size = (size_t)1 << (reg_b & 0x03);
+			const size_t sample_size =
+				((size_t)1 << ((reg_b >> 2) & 0x03)) +
+				((size_t)1 << ((reg_b >> 4) & 0x03)) +
+				((size_t)1 << ((reg_b >> 6) & 0x03));
+			return src_size == 6 + start_size + count * sample_size;
+		}
+
+		// значение little-endian заданной длины (со знаком или без)
+		static inline uint64_t get_value(const uint8_t *p, const size_t bytes, const bool is_signed) noexcept {
+			uint64_t value = 0;
+			for (size_t i = 0; i < bytes; ++i) value |= ((uint64_t)p[i]) << (8 * i);
+			if (is_signed && bytes < 8 && (value >> (8 * bytes - 1))) value |= ~(uint64_t)0 << (8 * bytes);
+			return value;
+		}
+
+		static inline void set_value(uint8_t *p, const uint64_t value, const size_t bytes) noexcept {
+			for (size_t i = 0; i < bytes; ++i) p[i] = (uint8_t)(value >> (8 * i));
+		}
+
+		template<class T1>
+		static inline void store_column(const std::vector<int64_t> &column, uint8_t *p) noexcept {
+			for (size_t i = 0; i < column.size(); ++i) {
+				const T1 value = static_cast<T1>(column[i]);
+				std::memcpy(p + i * sizeof(T1), &value, sizeof(T1));
+			}
+		}
+
+		static inline uint64_t zigzag_encode(const int64_t v) noexcept {
+			return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+		}
+
+		static inline int64_t zigzag_decode(const uint64_t v) noexcept {
+			return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+		}
+
+		static inline void put_varint(std::vector<uint8_t> &dst, uint64_t value) noexcept {
+			while (value >= 0x80) {
+				dst.push_back((uint8_t)(value | 0x80));
+				value >>= 7;
+			}
+			dst.push_back((uint8_t)value);
+		}
+
+		static inline bool get_varint(const uint8_t *src, const size_t src_size, size_t &pos, uint64_t &value) noexcept {
+			value = 0;
+			for (size_t shift = 0; shift < 64; shift += 7) {
+				if (pos >= src_size) return false;
+				const uint8_t byte = src[pos++];
+				value |= ((uint64_t)(byte & 0x7F)) << shift;
+				if (!(byte & 0x80)) return true;
+			}
+			return false;
+		}
+
+		static inline uint8_t calc_bit_width(const uint64_t *values, const size_t count) noexcept {
+			uint64_t acc = 0;
+			for (size_t i = 0; i < count; ++i) acc |= values[i];
+			uint8_t width = 0;
+			while (acc) {
+				++width;
+				acc >>= 1;
+			}
+			return width;
+		}
+
+		// размер упакованного столбца в байтах
+		static size_t calc_packed_size(const std::vector<uint64_t> &zigzag) noexcept {
+			size_t size = 0;
+			for (size_t i = 0; i < zigzag.size(); i += MINI_BLOCK_SIZE) {
+				const size_t n = std::min((size_t)MINI_BLOCK_SIZE, zigzag.size() - i);
+				size += 1 + (n * calc_bit_width(zigzag.data() + i, n) + 7) / 8;
+			}
+			return size;
+		}
+
+		// столбец пишется значениями или дельтами, в зависимости от того, что короче
+		static void put_column(
+				std::vector<uint8_t> &dst,
+				const std::vector<int64_t> &column,
+				std::vector<uint64_t> &zigzag) noexcept {
+			const size_t count = column.size();
+			for (size_t i = 0; i < count; ++i) zigzag[i] = zigzag_encode(column[i]);
+			const size_t plain_size = calc_packed_size(zigzag);
+			int64_t last = 0;
+			for (size_t i = 0; i < count; ++i) {
+				zigzag[i] = zigzag_encode(column[i] - last);
+				last = column[i];
+			}
+			const bool use_delta = calc_packed_size(zigzag) < plain_size;
+			if (!use_delta) {
+				for (size_t i = 0; i < count; ++i) zigzag[i] = zigzag_encode(column[i]);
+			}
+			dst.push_back(use_delta ? 1 : 0);
+			for (size_t i = 0; i < count; i += MINI_BLOCK_SIZE) {
+				const size_t n = std::min((size_t)MINI_BLOCK_SIZE, count - i);
+				const uint8_t width = calc_bit_width(zigzag.data() + i, n);
+				dst.push_back(width);
+				uint64_t acc = 0;
+				size_t bits = 0;
+				for (size_t j = 0; j < n; ++j) {
+					const uint64_t value = zigzag[i + j];
+					acc |= value << bits;
+					const size_t total = bits + width;
+					if (total >= 64) {
+						for (size_t k = 0; k < 8; ++k) dst.push_back((uint8_t)(acc >> (8 * k)));
+						acc = bits ? (value >> (64 - bits)) : 0;
+						bits = total - 64;
+					} else {
+						bits = total;
+					}
+				}
+				for (size_t k = 0; k < (bits + 7) / 8; ++k) dst.push_back((uint8_t)(acc >> (8 * k)));
+			}
+		}
+
+		// читаем width бит, начиная с бита bit_offset (данные little-endian)
+		static inline uint64_t read_bits(
+				const uint8_t *p,
+				const size_t bytes,
+				const size_t bit_offset,
+				const uint8_t width) noexcept {
+			if (!width) return 0;
+			const size_t index = bit_offset >> 3;
+			const size_t shift = bit_offset & 7;
+			uint64_t value = 0;
+			if (index + sizeof(uint64_t) <= bytes) {
+				std::memcpy(&value, p + index, sizeof(uint64_t));
+			} else {
+				for (size_t k = 0; index + k < bytes; ++k) value |= ((uint64_t)p[index + k]) << (8 * k);
+			}
+			value >>= shift;
+			if (shift + width > 64) value |= ((uint64_t)p[index + 8]) << (64 - shift);
+			return width == 64 ? value : (value & (((uint64_t)1 << width) - 1));
+		}
+
+		// распаковываем n значений разрядности width; пока до конца данных есть 8 байт,
+		// значение читается одним словом без проверок (разрядность до 56 бит)
+		static inline void unpack(
+				const uint8_t *p,
+				const size_t available,
+				const size_t n,
+				const uint8_t width,
+				int64_t *out) noexcept {
+			if (!width) {
+				std::fill(out, out + n, 0);
+				return;
+			}
+			size_t j = 0;
+			if (width <= 56) {
+				const uint64_t mask = ((uint64_t)1 << width) - 1;
+				size_t bit_offset = 0;
+				for (; j < n && (bit_offset >> 3) + sizeof(uint64_t) <= available; ++j, bit_offset += width) {
+					uint64_t value;
+					std::memcpy(&value, p + (bit_offset >> 3), sizeof(uint64_t));
+					out[j] = zigzag_decode((value >> (bit_offset & 7)) & mask);
+				}
+			}
+			const size_t bytes = std::min(available, (n * width + 7) / 8);
+			for (; j < n; ++j) {
+				out[j] = zigzag_decode(read_bits(p, bytes, j * width, width));
+			}
+		}
+
+		static bool get_column(
+				const uint8_t *src,
+				const size_t src_size,
+				size_t &pos,
+				std::vector<int64_t> &column) noexcept {
+			if (pos >= src_size) return false;
+			const bool use_delta = src[pos++] != 0;
+			const size_t count = column.size();
+			int64_t last = 0;
+			for (size_t i = 0; i < count; i += MINI_BLOCK_SIZE) {
+				const size_t n = std::min((size_t)MINI_BLOCK_SIZE, count - i);
+				if (pos >= src_size) return false;
+				const uint8_t width = src[pos++];
+				if (width > 64) return false;
+				const size_t bytes = (n * width + 7) / 8;
+				if (pos + bytes > src_size) return false;
+				const uint8_t *p = src + pos;
+				pos += bytes;
+				int64_t *out = column.data() + i;
+				unpack(p, src + src_size - p, n, width, out);
+				if (use_delta) {
+					for (size_t j = 0; j < n; ++j) {
+						last += out[j];
+						out[j] = last;
+					}
+				}
+			}
+			return true;
+		}
+	}; // QdbBitpackCodec
+}; // trading_db
+
+#endif // TRADING_DB_QDB_BITPACK_CODEC_HPP_INCLUDED
@@ -0,0 +1,324 @@
+#pragma once
+#ifndef TRADING_DB_QDB_BLOCK_CACHE_HPP_INCLUDED
+#define TRADING_DB_QDB_BLOCK_CACHE_HPP_INCLUDED
+
+#include "data-classes.hpp"
+#include "tick-block.hpp"
+#include "candle-day.hpp"
+#include <ztime.hpp>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <array>
+#include <mutex>
+#include <list>
+#include <map>
+
+namespace trading_db {
+
+	/** \brief Общий для процесса кэш распакованных блоков (часы тиков и дни баров)
+	 *
+	 * Блоки хранятся по ключу (БД, таблица, начало блока). Объем кэша ограничен config.max_bytes,
+	 * при превышении вытесняются давно не используемые блоки (LRU). Блок, который в данный момент
+	 * используется буфером цен (есть внешние ссылки на его данные), считается закрепленным и не вытесняется.
+	 */
+	class QdbBlockCache {
+	public:
+
+		/// Бары за день
+		using candles_day = QdbCandleDay;
+		using candles_day_ptr = std::shared_ptr<const candles_day>;
+
+		class Config {
+		public:
+			size_t max_bytes = 512 * 1024 * 1024;	/**< Максимальный объем распакованных данных в кэше */
+		};
+
+		/** \brief Статистика кэша
+		 */
+		class Stats {
+		public:
+			uint64_t hits		= 0;	/**< Количество найденных в кэше блоков */
+			uint64_t misses		= 0;	/**< Количество блоков, которых не было в кэше */
+			uint64_t evictions	= 0;	/**< Количество вытесненных блоков */
+			size_t	 blocks		= 0;	/**< Количество блоков в кэше */
+			size_t	 bytes		= 0;	/**< Объем данных в кэше */
+			size_t	 pinned_bytes = 0;	/**< Объем закрепленных блоков */
+		};
+
+	private:
+
+		class Key {
+		public:
+			uint64_t	db		= 0;
+			uint64_t	key		= 0;
+			bool		is_tick	= false;
+
+			Key() {};
+			Key(const uint64_t d, const bool t, const uint64_t k) : db(d), key(k), is_tick(t) {};
+
+			inline bool operator==(const Key &other) const noexcept {
+				return db == other.db && key == other.key && is_tick == other.is_tick;
+			}
+		};
+
+		class KeyHash {
+		public:
+			inline size_t operator()(const Key &k) const noexcept {
+				uint64_t h = k.key ^ (k.db * 0x9E3779B97F4A7C15ULL) ^ (k.is_tick ? 0xC2B2AE3D27D4EB4FULL : 0);
+				h ^= h >> 33;
+				h *= 0xFF51AFD7ED558CCDULL;
+				h ^= h >> 33;
+				return (size_t)h;
+			}
+		};
+
+		class Entry {
+		public:
+			Key				key;
+			QdbTickBlock	ticks;
+			candles_day_ptr	candles;
+			size_t			bytes = 0;
+
+			// блок закреплен, если на его данные есть ссылки кроме кэша
+			inline bool is_pinned() const noexcept {
+				if (key.is_tick) return ticks.use_count() > 1;
+				return candles.use_count() > 1;
+			}
+		};
+
+		using entry_list = std::list<Entry>;
+
+		class DbInfo {
+		public:
+			uint64_t	id		= 0;
+			size_t		refs	= 0;
+		};
+
+		mutable std::mutex		mutex;
+		Config					config;
+		entry_list				entries;	// в начале списка - недавно использованные блоки
+		std::unordered_map<Key, entry_list::iterator, KeyHash> index;
+		std::map<std::string, DbInfo> db_ids;
+		uint64_t				db_counter	= 0;
+		size_t					bytes		= 0;
+
+		std::atomic<uint64_t>	hits		= ATOMIC_VAR_INIT(0);
+		std::atomic<uint64_t>	misses		= ATOMIC_VAR_INIT(0);
+		std::atomic<uint64_t>	evictions	= ATOMIC_VAR_INIT(0);
+
+		// вытесняем незакрепленные блоки, пока кэш больше бюджета
+		void shrink() noexcept {
+			if (bytes <= config.max_bytes) return;
+			auto it = entries.end();
+			while (it != entries.begin() && bytes > config.max_bytes) {
+				--it;
+				if (it->is_pinned()) continue;
+				bytes -= it->bytes;
+				index.erase(it->key);
+				it = entries.erase(it);
+				++evictions;
+			}
+		}
+
+		template<class F>
+		inline bool find(const Key &key, F f) noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = index.find(key);
+			if (it == index.end()) {
+				++misses;
+				return false;
+			}
+			entries.splice(entries.begin(), entries, it->second);
+			f(*it->second);
+			++hits;
+			return true;
+		}
+
+		inline Entry &insert(const Key &key) noexcept {
+			auto it = index.find(key);
+			if (it != index.end()) {
+				bytes -= it->second->bytes;
+				entries.splice(entries.begin(), entries, it->second);
+				return *it->second;
+			}
+			entries.emplace_front();
+			entries.front().key = key;
+			index[key] = entries.begin();
+			return entries.front();
+		}
+
+	public:
+
+		QdbBlockCache() {};
+
+		/** \brief Получить общий для процесса кэш
+		 */
+		static QdbBlockCache &get_instance() noexcept {
+			static QdbBlockCache cache;
+			return cache;
+		}
+
+		/** \brief Получить идентификатор БД для ключей кэша
+		 * Экземпляры, одновременно открывшие один файл, разделяют блоки.
+		 * Блоки файла удаляются из кэша, когда его закрывает последний экземпляр
+		 * \param path Путь к файлу БД
+		 * \return Идентификатор БД
+		 */
+		uint64_t acquire_db(const std::string &path) noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			// у БД в памяти нет общего файла
+			if (path.empty() || path == ":memory:") return ++db_counter;
+			DbInfo &info = db_ids[path];
+			if (!info.refs++) info.id = ++db_counter;
+			return info.id;
+		}
+
+		/** \brief Освободить идентификатор БД
+		 * \param db Идентификатор БД, полученный от acquire_db
+		 */
+		void release_db(const uint64_t db) noexcept {
+			if (!db) return;
+			remove_db(db, true);
+		}
+
+		/** \brief Установить максимальный объем кэша
+		 * \param max_bytes Объем в байтах (0 - блоки хранятся, только пока закреплены)
+		 */
+		void set_max_bytes(const size_t max_bytes) noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			config.max_bytes = max_bytes;
+			shrink();
+		}
+
+		size_t get_max_bytes() const noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			return config.max_bytes;
+		}
+
+		/** \brief Найти час тиков в кэше
+		 * \param db	Идентификатор БД
+		 * \param key	Начало часа
+		 * \param ticks	Тики за час (разделяют буфер с кэшем)
+		 * \return Вернет true, если блок найден
+		 */
+		inline bool get_ticks(const uint64_t db, const uint64_t key, QdbTickBlock &ticks) noexcept {
+			return find(Key(db, true, key), [&](const Entry &entry) {
+				ticks = entry.ticks;
+			});
+		}
+
+		/** \brief Найти день баров в кэше
+		 * \param db		Идентификатор БД
+		 * \param key		Начало дня
+		 * \param candles	Бары за день
+		 * \return Вернет true, если блок найден
+		 */
+		inline bool get_candles(const uint64_t db, const uint64_t key, candles_day_ptr &candles) noexcept {
+			return find(Key(db, false, key), [&](const Entry &entry) {
+				candles = entry.candles;
+			});
+		}
+
+		/** \brief Проверить наличие блока в кэше без учета в статистике
+		 */
+		inline bool contains(const uint64_t db, const bool is_tick, const uint64_t key) const noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			return index.find(Key(db, is_tick, key)) != index.end();
+		}
+
+		/** \brief Добавить час тиков в кэш
+		 */
+		void put_ticks(const uint64_t db, const uint64_t key, const QdbTickBlock &ticks) noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			Entry &entry = insert(Key(db, true, key));
+			entry.ticks = ticks;
+			entry.bytes = sizeof(Entry) + ticks.memory_size();
+			bytes += entry.bytes;
+			shrink();
+		}
+
+		/** \brief Добавить день баров в кэш
+		 */
+		void put_candles(const uint64_t db, const uint64_t key, const candles_day_ptr &candles) noexcept {
+			if (!candles) return;
+			std::lock_guard<std::mutex> lock(mutex);
+			Entry &entry = insert(Key(db, false, key));
+			entry.candles = candles;
+			entry.bytes = sizeof(Entry) + candles_day::max_memory_size();
+			bytes += entry.bytes;
+			shrink();
+		}
+
+		/** \brief Удалить блок из кэша (после записи или удаления блока в БД)
+		 */
+		void remove(const uint64_t db, const bool is_tick, const uint64_t key) noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = index.find(Key(db, is_tick, key));
+			if (it == index.end()) return;
+			bytes -= it->second->bytes;
+			entries.erase(it->second);
+			index.erase(it);
+		}
+
+		/** \brief Удалить из кэша все блоки БД
+		 * \param db		Идентификатор БД
+		 * \param is_close	Флаг закрытия БД экземпляром (блоки удаляются после закрытия файла всеми экземплярами)
+		 */
+		void remove_db(const uint64_t db, const bool is_close = false) noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (is_close) {
+				for (auto it_db = db_ids.begin(); it_db != db_ids.end(); ++it_db) {
+					if (it_db->second.id != db) continue;
+					if (--it_db->second.refs) return;
+					db_ids.erase(it_db);
+					break;
+				}
+			}
+			auto it = entries.begin();
+			while (it != entries.end()) {
+				if (it->key.db == db) {
+					bytes -= it->bytes;
+					index.erase(it->key);
+					it = entries.erase(it);
+				} else ++it;
+			}
+		}
+
+		/** \brief Очистить кэш
+		 */
+		void clear() noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			index.clear();
+			entries.clear();
+			bytes = 0;
+		}
+
+		/** \brief Получить статистику кэша
+		 */
+		Stats get_stats() const noexcept {
+			Stats stats;
+			stats.hits = hits;
+			stats.misses = misses;
+			stats.evictions = evictions;
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.blocks = entries.size();
+			stats.bytes = bytes;
+			for (const auto &entry : entries) {
+				if (entry.is_pinned()) stats.pinned_bytes += entry.bytes;
+			}
+			return stats;
+		}
+
+		/** \brief Сбросить счетчики попаданий и промахов
+		 */
+		void reset_stats() noexcept {
+			hits = 0;
+			misses = 0;
+			evictions = 0;
+		}
+	}; // QdbBlockCache
+}; // trading_db
+
+#endif // TRADING_DB_QDB_BLOCK_CACHE_HPP_INCLUDED
@@ -0,0 +1,112 @@
+#pragma once
+#ifndef TRADING_DB_QDB_BLOCK_HEADER_HPP_INCLUDED
+#define TRADING_DB_QDB_BLOCK_HEADER_HPP_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace trading_db {
+
+	/** \brief Заголовок блока QDB
+	 *
+	 * Заголовок записывается перед сжатыми данными блока (16 байт, little-endian):
+	 * 0-1	сигнатура 'Q', 'B'
+	 * 2	версия заголовка
+	 * 3	размер заголовка (блоки с более длинным заголовком следующих версий остаются читаемыми)
+	 * 4	ID кодека (см. QdbCodecRegistry)
+	 * 5	формат данных блока (для тиков - версия формата QdbCompactDataset)
+	 * 6-7	ID словаря (см. QdbCodecRegistry)
+	 * 8-11	размер распакованных данных
+	 * 12-15	количество тиков или баров в блоке
+	 *
+	 * Блоки, записанные до появления заголовка, начинаются с сигнатуры кадра zstd
+	 * и читаются как сжатые zstd со встроенным словарем.
+	 */
+	class QdbBlockHeader {
+	public:
+		static const uint8_t	MAGIC_0		= 0x51;	/**< 'Q' */
+		static const uint8_t	MAGIC_1		= 0x42;	/**< 'B' */
+		static const uint8_t	VERSION		= 1;	/**< Текущая версия заголовка */
+		static const size_t		HEADER_SIZE	= 16;	/**< Размер заголовка текущей версии */
+
+		uint8_t		version		= VERSION;		/**< Версия заголовка */
+		uint8_t		header_size	= HEADER_SIZE;	/**< Размер заголовка */
+		uint8_t		codec_id	= 0;			/**< ID кодека */
+		uint8_t		data_format	= 0;			/**< Формат данных блока */
+		uint16_t	dict_id		= 0;			/**< ID словаря */
+		uint32_t	raw_size	= 0;			/**< Размер распакованных данных */
+		uint32_t	count		= 0;			/**< Количество тиков или баров */
+
+		/** \brief Проверить, является ли блок блоком без заголовка (кадр zstd)
+		 * \param data	Данные блока
+		 * \param size	Размер блока
+		 */
+		static inline bool is_legacy(const uint8_t *data, const size_t size) noexcept {
+			// сигнатура кадра zstd 0xFD2FB528 в порядке little-endian
+			return size >= 4 &&
+				data[0] == 0x28 && data[1] == 0xB5 &&
+				data[2] == 0x2F && data[3] == 0xFD;
+		}
+
+		/** \brief Проверить наличие заголовка
+		 * \param data	Данные блока
+		 * \param size	Размер блока
+		 */
+		static inline bool has_header(const uint8_t *data, const size_t size) noexcept {
+			return size >= HEADER_SIZE && data[0] == MAGIC_0 && data[1] == MAGIC_1;
+		}
+
+		/** \brief Прочитать заголовок блока
+		 * \param data	Данные блока
+		 * \param size	Размер блока
+		 * \return Вернет false, если заголовка нет или он поврежден
+		 */
+		bool read(const uint8_t *data, const size_t size) noexcept {
+			if (!has_header(data, size)) return false;
+			version		= data[2];
+			header_size	= data[3];
+			if (!version || header_size < HEADER_SIZE || header_size > size) return false;
+			codec_id	= data[4];
+			data_format	= data[5];
+			dict_id		= (uint16_t)get_value(data + 6, 2);
+			raw_size	= (uint32_t)get_value(data + 8, 4);
+			count		= (uint32_t)get_value(data + 12, 4);
+			return true;
+		}
+
+		/** \brief Записать заголовок в начало буфера
+		 * \param dst	Буфер (заголовок заменяет содержимое буфера)
+		 */
+		void write(std::vector<uint8_t> &dst) const noexcept {
+			dst.resize(HEADER_SIZE);
+			dst[0] = MAGIC_0;
+			dst[1] = MAGIC_1;
+			dst[2] = VERSION;
+			dst[3] = HEADER_SIZE;
+			dst[4] = codec_id;
+			dst[5] = data_format;
+			set_value(dst.data() + 6, dict_id, 2);
+			set_value(dst.data() + 8, raw_size, 4);
+			set_value(dst.data() + 12, count, 4);
+		}
+
+	private:
+
+		static inline uint64_t get_value(const uint8_t *p, const size_t bytes) noexcept {
+			uint64_t value = 0;
+			for (size_t i = 0; i < bytes; ++i) {
+				value |= ((uint64_t)p[i]) << (8 * i);
+			}
+			return value;
+		}
+
+		static inline void set_value(uint8_t *p, const uint64_t value, const size_t bytes) noexcept {
+			for (size_t i = 0; i < bytes; ++i) {
+				p[i] = (uint8_t)(value >> (8 * i));
+			}
+		}
+	}; // QdbBlockHeader
+}; // trading_db
+
+#endif // TRADING_DB_QDB_BLOCK_HEADER_HPP_INCLUDED
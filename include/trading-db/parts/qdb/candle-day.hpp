@@ -0,0 +1,125 @@
+#pragma once
+#ifndef TRADING_DB_QDB_CANDLE_DAY_HPP_INCLUDED
+#define TRADING_DB_QDB_CANDLE_DAY_HPP_INCLUDED
+
+#include "enums.hpp"
+#include "data-classes.hpp"
+#include <ztime.hpp>
+#include <array>
+#include <vector>
+#include <mutex>
+
+namespace trading_db {
+
+	/** \brief Минутные бары за день с пирамидой старших таймфреймов
+	 *
+	 * Для каждого таймфрейма M5..D1 при первом запросе один раз строится уровень пирамиды:
+	 * для каждой минуты дня - бар, сформированный от начала периода до этой минуты включительно.
+	 * Поэтому и закрытый, и еще формирующийся бар старшего таймфрейма возвращаются за O(1).
+	 *
+	 * Уровни строятся лениво и потокобезопасно (блок дня может разделяться кэшем блоков между потоками).
+	 * После первого запроса старшего таймфрейма минутные бары блока изменять нельзя.
+	 */
+	class QdbCandleDay : public std::array<Candle, ztime::MIN_PER_DAY> {
+	public:
+
+		using base_type = std::array<Candle, ztime::MIN_PER_DAY>;
+
+		QdbCandleDay() : base_type() {};
+
+		QdbCandleDay(const base_type &candles) : base_type(candles) {};
+
+		/// Копия получает только минутные бары, уровни пирамиды строятся заново
+		QdbCandleDay(const QdbCandleDay &other) : base_type(other) {};
+
+		QdbCandleDay &operator=(const QdbCandleDay &) = delete;
+
+		/** \brief Получить бар таймфрейма, сформированный к минуте дня
+		 * \param candle		Бар (начало бара - начало периода)
+		 * \param time_day		Метка времени начала дня
+		 * \param minute_day	Минута дня
+		 * \param p				Таймфрейм
+		 * \return Вернет false, если от начала периода до минуты нет данных
+		 */
+		bool get_candle(
+				Candle &candle,
+				const uint64_t time_day,
+				const uint64_t minute_day,
+				const QDB_TIMEFRAMES p) const noexcept {
+			if (minute_day >= ztime::MIN_PER_DAY) return false;
+			const uint64_t period = static_cast<uint64_t>(p);
+			const size_t level = get_level(p);
+			if (level >= LEVELS) {
+				const Candle &c = (*this)[minute_day];
+				if (c.empty()) return false;
+				candle = c;
+				return true;
+			}
+			std::call_once(level_flags[level], [&]() {
+				build_level(level, period);
+			});
+			Candle new_candle = levels[level][minute_day];
+			new_candle.timestamp = (minute_day - minute_day % period) * ztime::SEC_PER_MIN + time_day;
+			if (new_candle.empty()) return false;
+			candle = new_candle;
+			return true;
+		}
+
+		/** \brief Объем памяти блока со всеми уровнями пирамиды
+		 *
+		 * Уровни строятся лениво уже после того, как блок учтен кэшем блоков,
+		 * поэтому кэш резервирует место под все уровни сразу.
+		 */
+		static inline size_t max_memory_size() noexcept {
+			return sizeof(QdbCandleDay) + LEVELS * ztime::MIN_PER_DAY * sizeof(Candle);
+		}
+
+	private:
+
+		static const size_t LEVELS = 6;	// M5, M15, M30, H1, H4, D1
+
+		mutable std::array<std::once_flag, LEVELS>		level_flags;
+		mutable std::array<std::vector<Candle>, LEVELS>	levels;
+
+		static inline size_t get_level(const QDB_TIMEFRAMES p) noexcept {
+			switch (p) {
+			case QDB_TIMEFRAMES::PERIOD_M5:		return 0;
+			case QDB_TIMEFRAMES::PERIOD_M15:	return 1;
+			case QDB_TIMEFRAMES::PERIOD_M30:	return 2;
+			case QDB_TIMEFRAMES::PERIOD_H1:		return 3;
+			case QDB_TIMEFRAMES::PERIOD_H4:		return 4;
+			case QDB_TIMEFRAMES::PERIOD_D1:		return 5;
+			default:
+				break;
+			};
+			return LEVELS;
+		}
+
+		// формируем бары от начала периода до каждой минуты
+		void build_level(const size_t level, const uint64_t period) const noexcept {
+			std::vector<Candle> &dst = levels[level];
+			dst.resize(ztime::MIN_PER_DAY);
+			Candle new_candle;
+			for (size_t m = 0; m < ztime::MIN_PER_DAY; ++m) {
+				if (m % period == 0) new_candle = Candle();
+				const Candle &c = (*this)[m];
+				if (!c.empty()) {
+					if (!new_candle.open) new_candle.open = c.open;
+
+					if (!new_candle.high) new_candle.high = c.high;
+					else if (c.high > new_candle.high) new_candle.high = c.high;
+
+					if (!new_candle.low) new_candle.low = c.low;
+					else if (c.low < new_candle.low) new_candle.low = c.low;
+
+					new_candle.close = c.close;
+
+					new_candle.volume += c.volume;
+				}
+				dst[m] = new_candle;
+			}
+		}
+	}; // QdbCandleDay
+}; // trading_db
+
+#endif // TRADING_DB_QDB_CANDLE_DAY_HPP_INCLUDED
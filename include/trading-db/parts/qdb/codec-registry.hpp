@@ -0,0 +1,187 @@
+#pragma once
+#ifndef TRADING_DB_QDB_CODEC_REGISTRY_HPP_INCLUDED
+#define TRADING_DB_QDB_CODEC_REGISTRY_HPP_INCLUDED
+
+#include "compression-engine.hpp"
+#include "bitpack-codec.hpp"
+#include "dictionary-candles.hpp"
+#include "dictionary-ticks.hpp"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace trading_db {
+
+	/** \brief Реестр кодеков и словарей блоков QDB
+	 *
+	 * ID кодека и словаря записываются в заголовок блока (QdbBlockHeader), при чтении
+	 * блок распаковывается кодеком и словарем из реестра. Новый кодек или словарь
+	 * регистрируется под новым ID, уже записанные блоки остаются читаемыми.
+	 * Реестр общий для всех экземпляров QDB, регистрация потокобезопасна.
+	 */
+	class QdbCodecRegistry {
+	public:
+
+		static const uint8_t	CODEC_RAW		= 0;	/**< Данные без сжатия */
+		static const uint8_t	CODEC_ZSTD		= 1;	/**< zstd со словарем */
+		static const uint8_t	CODEC_BITPACK	= 2;	/**< Битовая упаковка столбцов тиков (QdbBitpackCodec) */
+
+		static const uint16_t	DICT_NONE		= 0;	/**< Без словаря */
+		static const uint16_t	DICT_TICKS		= 1;	/**< Встроенный словарь тиков */
+		static const uint16_t	DICT_CANDLES	= 2;	/**< Встроенный словарь баров */
+
+		/// Сжать данные (словарь, уровень сжатия, исходные данные, сжатые данные)
+		using compress_t = std::function<bool(
+			const uint8_t *dict_ptr,
+			const size_t dict_size,
+			const int level,
+			const uint8_t *src,
+			const size_t src_size,
+			std::vector<uint8_t> &dst)>;
+
+		/// Распаковать данные (словарь, сжатые данные, размер распакованных данных, распакованные данные)
+		using decompress_t = std::function<bool(
+			const uint8_t *dict_ptr,
+			const size_t dict_size,
+			const uint8_t *src,
+			const size_t src_size,
+			const size_t raw_size,
+			std::vector<uint8_t> &dst)>;
+
+		/** \brief Кодек блоков
+		 */
+		class Codec {
+		public:
+			std::string		name;
+			compress_t		compress;
+			decompress_t	decompress;
+		};
+
+		/** \brief Словарь кодека
+		 */
+		class Dictionary {
+		public:
+			const uint8_t	*ptr = nullptr;
+			size_t			size = 0;
+		};
+
+		/** \brief Зарегистрировать кодек
+		 * \param codec_id	ID кодека (записывается в заголовок блока)
+		 * \param codec		Кодек
+		 * \return Вернет false, если кодек не задан
+		 */
+		static bool register_codec(const uint8_t codec_id, const Codec &codec) noexcept {
+			if (!codec.compress || !codec.decompress) return false;
+			Registry &registry = get_registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			registry.codecs[codec_id] = std::make_shared<const Codec>(codec);
+			return true;
+		}
+
+		/** \brief Получить кодек
+		 * \param codec_id	ID кодека
+		 * \return Вернет указатель на кодек или nullptr, если кодек не зарегистрирован
+		 */
+		static std::shared_ptr<const Codec> get_codec(const uint8_t codec_id) noexcept {
+			Registry &registry = get_registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			return registry.codecs[codec_id];
+		}
+
+		/** \brief Зарегистрировать словарь
+		 * \param dict_id	ID словаря (записывается в заголовок блока)
+		 * \param ptr		Указатель на данные словаря (данные не копируются и должны жить до конца программы)
+		 * \param size		Размер словаря
+		 */
+		static void register_dictionary(const uint16_t dict_id, const uint8_t *ptr, const size_t size) noexcept {
+			Registry &registry = get_registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			Dictionary &dict = registry.dictionaries[dict_id];
+			dict.ptr = ptr;
+			dict.size = size;
+		}
+
+		/** \brief Получить словарь
+		 * \param dict_id	ID словаря
+		 * \param dict		Словарь
+		 * \return Вернет false, если словарь не зарегистрирован
+		 */
+		static bool get_dictionary(const uint16_t dict_id, Dictionary &dict) noexcept {
+			if (dict_id == DICT_NONE) {
+				dict = Dictionary();
+				return true;
+			}
+			Registry &registry = get_registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			auto it = registry.dictionaries.find(dict_id);
+			if (it == registry.dictionaries.end()) return false;
+			dict = it->second;
+			return true;
+		}
+
+	private:
+
+		class Registry {
+		public:
+			std::mutex										mutex;
+			std::array<std::shared_ptr<const Codec>, 256>	codecs;
+			std::map<uint16_t, Dictionary>					dictionaries;
+
+			Registry() {
+				Codec raw;
+				raw.name = "raw";
+				raw.compress = [](
+						const uint8_t *, const size_t, const int,
+						const uint8_t *src, const size_t src_size,
+						std::vector<uint8_t> &dst) {
+					dst.assign(src, src + src_size);
+					return true;
+				};
+				raw.decompress = [](
+						const uint8_t *, const size_t,
+						const uint8_t *src, const size_t src_size, const size_t,
+						std::vector<uint8_t> &dst) {
+					dst.assign(src, src + src_size);
+					return true;
+				};
+				codecs[CODEC_RAW] = std::make_shared<const Codec>(raw);
+
+				Codec zstd;
+				zstd.name = "zstd";
+				zstd.compress = QdbCompressionEngine::compress;
+				zstd.decompress = [](
+						const uint8_t *dict_ptr, const size_t dict_size,
+						const uint8_t *src, const size_t src_size, const size_t,
+						std::vector<uint8_t> &dst) {
+					return QdbCompressionEngine::decompress(dict_ptr, dict_size, src, src_size, dst);
+				};
+				codecs[CODEC_ZSTD] = std::make_shared<const Codec>(zstd);
+
+				Codec bitpack;
+				bitpack.name = "bitpack";
+				bitpack.compress = QdbBitpackCodec::encode;
+				bitpack.decompress = [](
+						const uint8_t *dict_ptr, const size_t dict_size,
+						const uint8_t *src, const size_t src_size, const size_t,
+						std::vector<uint8_t> &dst) {
+					return QdbBitpackCodec::decode(dict_ptr, dict_size, src, src_size, dst);
+				};
+				codecs[CODEC_BITPACK] = std::make_shared<const Codec>(bitpack);
+
+				dictionaries[(uint16_t)DICT_TICKS] = Dictionary{qdb_dictionary_ticks, sizeof(qdb_dictionary_ticks)};
+				dictionaries[(uint16_t)DICT_CANDLES] = Dictionary{qdb_dictionary_candles, sizeof(qdb_dictionary_candles)};
+			}
+		};
+
+		static Registry &get_registry() noexcept {
+			static Registry registry;
+			return registry;
+		}
+	}; // QdbCodecRegistry
+}; // trading_db
+
+#endif // TRADING_DB_QDB_CODEC_REGISTRY_HPP_INCLUDED
@@ -4,7 +4,11 @@
 
 #include "enums.hpp"
 #include "data-classes.hpp"
+#include "tick-block.hpp"
+#include "simd-decode.hpp"
 #include <vector>
+#include <limits>
+#include <cstring>
 #include <cmath>
 #include "ztime.hpp"
 
@@ -70,15 +74,16 @@ namespace trading_db {
 		template<class T1, class T2>
 		inline void set_ptr(const T2 value, const uint8_t* p, const size_t offset_ptr, const size_t offset) {
 			// uint8_t* p = data.data();
-			T1 *ptr = (T1*)(&p[offset_ptr]);
-			ptr[offset] = static_cast<T1>(value);
+			const T1 v = static_cast<T1>(value);
+			std::memcpy(const_cast<uint8_t*>(&p[offset_ptr + offset * sizeof(T1)]), &v, sizeof(T1));
 		}
 
 		template<class T1, class T2>
 		inline void get_ptr(T2 &value, const uint8_t* p, const size_t offset_ptr, const size_t offset) {
 			// uint8_t* p = data.data();
-			const T1 *ptr = (const T1*)(&p[offset_ptr]);
-			value = static_cast<T2>(ptr[offset]);
+			T1 v;
+			std::memcpy(&v, &p[offset_ptr + offset * sizeof(T1)], sizeof(T1));
+			value = static_cast<T2>(v);
 		}
 
 		inline size_t set_u64_value(const uint64_t value, const uint8_t type, const uint8_t* p, size_t offset_ptr, const size_t offset = 0) {
@@ -230,8 +235,179 @@ namespace trading_db {
 			return offset_ptr;
 		}
 
+		// записываем столбец знаковых значений одной разрядности (адрес столбца может быть не выровнен)
+		template<class T1>
+		static inline void set_column(const int64_t *src, const size_t count, uint8_t *p) noexcept {
+			for (size_t i = 0; i < count; ++i) {
+				const T1 value = static_cast<T1>(src[i]);
+				std::memcpy(p + i * sizeof(T1), &value, sizeof(T1));
+			}
+		}
+
+		static inline size_t set_column(const int64_t *src, const size_t count, const uint8_t type, uint8_t *p, const size_t offset_ptr) noexcept {
+			switch (type) {
+			case 0: set_column<int8_t>(src, count, p + offset_ptr); break;
+			case 1: set_column<int16_t>(src, count, p + offset_ptr); break;
+			case 2: set_column<int32_t>(src, count, p + offset_ptr); break;
+			case 3: set_column<int64_t>(src, count, p + offset_ptr); break;
+			};
+			return offset_ptr + count * ((size_t)1 << type);
+		}
+
+		// восстанавливаем столбец времени из дельт (префиксная сумма)
+		static inline size_t read_time_column_v2(
+				const uint8_t	*p,
+				const size_t	offset_ptr,
+				const size_t	count,
+				const uint8_t	type,
+				const uint64_t	timestamp_ms,
+				int64_t			*t_ms) noexcept {
+			dispatch_int_type(type, [&](auto tt) {
+				using TT = decltype(tt);
+				QdbSimdDecode::prefix_sum<TT>(p + offset_ptr, count, (int64_t)timestamp_ms, t_ms);
+			});
+			return offset_ptr + count * ((size_t)1 << type);
+		}
+
+		// первое значение столбца знаковых значений
+		static inline int64_t get_first_delta(const uint8_t *p, const size_t offset_ptr, const uint8_t type) noexcept {
+			switch (type) {
+			case 0: return load_value<int8_t>(p + offset_ptr);
+			case 1: return load_value<int16_t>(p + offset_ptr);
+			case 2: return load_value<int32_t>(p + offset_ptr);
+			case 3: return load_value<int64_t>(p + offset_ptr);
+			};
+			return 0;
+		}
+
+		// вызываем f с нулевым значением знакового типа нужной разрядности,
+		// разрядность выбирается один раз на блок, а не для каждого поля
+		template<class F>
+		static inline void dispatch_int_type(const uint8_t type, F &&f) {
+			switch (type) {
+			case 0: f(int8_t()); break;
+			case 1: f(int16_t()); break;
+			case 2: f(int32_t()); break;
+			case 3: f(int64_t()); break;
+			};
+		}
+
+		template<class T1>
+		static inline int64_t load_value(const uint8_t *p) noexcept {
+			T1 value;
+			std::memcpy(&value, p, sizeof(T1));
+			return static_cast<int64_t>(value);
+		}
+
+		// ядро распаковки баров для пары разрядностей (дельты цены TP, дельты объема TV)
+		template<class TP, class TV, class T>
+		static inline void read_candles_kernel(
+				T				&candles,
+				const uint8_t	*p,
+				int64_t			last_price,
+				int64_t			last_volume,
+				const double	price_factor,
+				const double	volume_factor,
+				const uint64_t	start_timestamp,
+				const bool		is_fill) {
+			const size_t sample_size = 4 * sizeof(TP) + sizeof(TV);
+			const int64_t no_value = static_cast<int64_t>(std::numeric_limits<TP>::min());
+			for (size_t i = 0; i < ztime::MIN_PER_DAY; ++i) {
+				const uint64_t timestamp = i * ztime::SEC_PER_MIN + start_timestamp;
+				const uint8_t *sample = p + i * sample_size;
+				const int64_t cdo = load_value<TP>(sample);
+				if (cdo == no_value) {
+					if (is_fill) {
+						// OHLCV
+						candles[i] = Candle(0,0,0,0,0,timestamp);
+					}
+					continue;
+				}
+				const int64_t co = last_price + cdo;
+				const int64_t ch = last_price + load_value<TP>(sample + sizeof(TP));
+				const int64_t cl = last_price + load_value<TP>(sample + 2 * sizeof(TP));
+				const int64_t cc = last_price + load_value<TP>(sample + 3 * sizeof(TP));
+				const int64_t cv = last_volume + load_value<TV>(sample + 4 * sizeof(TP));
+				last_price = cc;
+				last_volume = cv;
+				candles[i] = Candle(
+					(double)co / price_factor,
+					(double)ch / price_factor,
+					(double)cl / price_factor,
+					(double)cc / price_factor,
+					(double)cv / volume_factor,
+					timestamp);
+			}
+		}
+
+		// ядро распаковки тиков TICK_FORMAT_V1 для пары разрядностей (дельты цены TP, дельты времени TT)
+		template<class TP, class TT, class T>
+		static inline void read_ticks_v1_kernel(
+				T				&ticks,
+				const uint8_t	*p,
+				const size_t	count,
+				int64_t			last_price,
+				int64_t			last_time,
+				const double	price_factor) {
+			const size_t sample_size = 2 * sizeof(TP) + sizeof(TT);
+			for (size_t i = 0; i < count; ++i) {
+				const uint8_t *sample = p + i * sample_size;
+				const int64_t a = last_price + load_value<TP>(sample + sizeof(TP));
+				last_price += load_value<TP>(sample);
+				last_time += load_value<TT>(sample + 2 * sizeof(TP));
+				add_tick(ticks, last_time,
+					(double)last_price / price_factor,
+					(double)a / price_factor);
+			}
+		}
+
+		// то же ядро с добавлением тиков в контейнер
+		template<class TB, class TS, class T>
+		static inline void read_ticks_v2_kernel(
+				T				&ticks,
+				const int64_t	*t_ms,
+				const uint8_t	*p_bid,
+				const uint8_t	*p_spread,
+				const size_t	count,
+				int64_t			last_price,
+				const double	price_factor) {
+			for (size_t i = 0; i < count; ++i) {
+				last_price += load_value<TB>(p_bid + i * sizeof(TB));
+				add_tick(ticks, t_ms[i],
+					(double)last_price / price_factor,
+					(double)(last_price + load_value<TS>(p_spread + i * sizeof(TS))) / price_factor);
+			}
+		}
+
+		// ядро TICK_FORMAT_V1 с записью в плоские массивы блока тиков
+		template<class TP, class TT>
+		static inline void read_ticks_v1_kernel(
+				uint64_t		*t_ms,
+				double			*bid,
+				double			*ask,
+				const uint8_t	*p,
+				const size_t	count,
+				int64_t			last_price,
+				int64_t			last_time,
+				const double	price_factor) {
+			const size_t sample_size = 2 * sizeof(TP) + sizeof(TT);
+			for (size_t i = 0; i < count; ++i) {
+				const uint8_t *sample = p + i * sample_size;
+				const int64_t a = last_price + load_value<TP>(sample + sizeof(TP));
+				last_price += load_value<TP>(sample);
+				last_time += load_value<TT>(sample + 2 * sizeof(TP));
+				t_ms[i] = (uint64_t)last_time;
+				bid[i] = (double)last_price / price_factor;
+				ask[i] = (double)a / price_factor;
+			}
+		}
+
 	public:
 
+		/// Версии формата блока тиков (биты 4-7 регистра reg_a)
+		static const uint8_t TICK_FORMAT_V1 = 0;	/**< Тики построчно: дельты bid и ask от предыдущего bid и дельта времени одной разрядности */
+		static const uint8_t TICK_FORMAT_V2 = 1;	/**< Тики по столбцам: время, bid и спред, у каждого столбца своя разрядность */
+
 		QdbCompactDataset() {};
 
 		inline std::vector<uint8_t> &get_data() noexcept {
@@ -393,53 +569,49 @@ namespace trading_db {
 			uint64_t start_price = 0, start_volume = 0;
 			offset_ptr = get_u64_value(start_price, reg_b0, p, offset_ptr);
 			offset_ptr = get_u64_value(start_volume, reg_b2, p, offset_ptr);
-			uint64_t last_price = start_price, last_volume = start_volume;
-
-			for (size_t i = 0; i < ztime::MIN_PER_DAY; ++i) {
-				const uint64_t timestamp = i * ztime::SEC_PER_MIN + start_timestamp;
-				size_t sample_offset_ptr = offset_ptr + i * sample_size;
-				bool status = false;
-				check_no_value(status, reg_b1, p, sample_offset_ptr);
-				if (!status) {
-					if (is_fill) {
-						// OHLCV
-						candles[i] = Candle(0,0,0,0,0,timestamp);
-					}
-					continue;
-				}
-				int64_t cdo = 0, cdh = 0, cdl = 0, cdc = 0, cdv = 0;
-				sample_offset_ptr = get_s64_value(cdo, reg_b1, p, sample_offset_ptr);
-				sample_offset_ptr = get_s64_value(cdh, reg_b1, p, sample_offset_ptr);
-				sample_offset_ptr = get_s64_value(cdl, reg_b1, p, sample_offset_ptr);
-				sample_offset_ptr = get_s64_value(cdc, reg_b1, p, sample_offset_ptr);
-									get_s64_value(cdv, reg_b3, p, sample_offset_ptr);
-				const int64_t co = last_price + cdo;
-				const int64_t ch = last_price + cdh;
-				const int64_t cl = last_price + cdl;
-				const int64_t cc = last_price + cdc;
-				const int64_t cv = last_volume + cdv;
-				last_price = cc;
-				last_volume = cv;
-
-				const double fco = (double)co / (double)price_factor;
-				const double fch = (double)ch / (double)price_factor;
-				const double fcl = (double)cl / (double)price_factor;
-				const double fcc = (double)cc / (double)price_factor;
-				const double fcv = (double)cv / (double)volume_factor;
-				candles[i] = Candle(fco,fch,fcl,fcc,fcv,timestamp);
-			}
+			if (data.size() < offset_ptr + sample_size * ztime::MIN_PER_DAY) return;
+
+			// разрядности известны для всего блока, поэтому выбираем ядро один раз
+			dispatch_int_type(reg_b1, [&](auto tp) {
+				dispatch_int_type(reg_b3, [&](auto tv) {
+					read_candles_kernel<decltype(tp), decltype(tv)>(
+						candles, p + offset_ptr,
+						(int64_t)start_price, (int64_t)start_volume,
+						(double)price_factor, (double)volume_factor,
+						start_timestamp, is_fill);
+				});
+			});
 		} // read_candles
 
 		/** \brief Записать последовательность тиков
+		 *
+		 * Формат блока тиков:
+		 *
+		 * reg_a - 0-3 биты - множитель цены, 4-7 биты - версия формата (TICK_FORMAT_V1, TICK_FORMAT_V2)
+		 *
+		 * TICK_FORMAT_V1
+		 * reg_b - 0-1 биты - начальная цена, 2-3 биты - дельты цены, 6-7 биты - дельты времени
+		 * далее начальная цена и сэмплы тиков: дельта bid, дельта ask (от предыдущего bid), дельта времени
+		 *
+		 * TICK_FORMAT_V2
+		 * reg_b - 0-1 биты - начальная цена, 2-3 биты - дельты bid, 4-5 биты - спред, 6-7 биты - дельты времени
+		 * далее количество тиков (4 байта), начальная цена и три столбца: дельты времени, дельты bid, спред (ask - bid)
 		 * \param ticks			Последовательность цен
 		 * \param price_scale	Множитель для цены (количество знаков послезапятой)
+		 * \param timestamp_ms	Время начала блока (мс)
+		 * \param version		Версия формата
 		 */
 		template<class T>
 		inline void write_ticks(
 				const T &ticks,
 				const size_t price_scale,
-				const uint64_t timestamp_ms) noexcept {
+				const uint64_t timestamp_ms,
+				const uint8_t version = TICK_FORMAT_V2) noexcept {
 			if (ticks.empty()) return;
+			if (version == TICK_FORMAT_V2) {
+				write_ticks_v2(ticks, price_scale, timestamp_ms);
+				return;
+			}
 
 			auto it_begin = ticks.begin();
 
@@ -534,6 +706,88 @@ namespace trading_db {
 			}
 		} // write_ticks
 
+		/** \brief Записать последовательность тиков в формате TICK_FORMAT_V2
+		 * \param ticks			Последовательность цен
+		 * \param price_scale	Множитель для цены (количество знаков послезапятой)
+		 * \param timestamp_ms	Время начала блока (мс)
+		 */
+		template<class T>
+		inline void write_ticks_v2(
+				const T &ticks,
+				const size_t price_scale,
+				const uint64_t timestamp_ms) noexcept {
+			if (ticks.empty()) return;
+
+			const uint64_t price_factor = (uint64_t)(std::pow(10, price_scale) + 0.5d);
+			const size_t count = ticks.size();
+
+			// столбцы дельт времени, дельт bid и спреда
+			std::vector<int64_t> columns(3 * count);
+			int64_t *dt = columns.data();
+			int64_t *db = dt + count;
+			int64_t *ds = db + count;
+
+			const uint64_t start_price = (uint64_t)((ticks.begin()->second.bid * (double)price_factor) + 0.5d);
+			int64_t last_p = (int64_t)start_price;
+			int64_t last_t = (int64_t)timestamp_ms;
+			uint64_t max_dt = 0, max_db = 0, max_ds = 0;
+			size_t index = 0;
+			for (const auto &tick : ticks) {
+				const int64_t bid = (int64_t)((tick.second.bid * (double)price_factor) + 0.5d);
+				const int64_t ask = (int64_t)((tick.second.ask * (double)price_factor) + 0.5d);
+				const int64_t t = (int64_t)(tick.first);
+				dt[index] = t - last_t;
+				db[index] = bid - last_p;
+				ds[index] = ask - bid;
+				max_dt = std::max(max_dt, (uint64_t)std::abs(dt[index]));
+				max_db = std::max(max_db, (uint64_t)std::abs(db[index]));
+				max_ds = std::max(max_ds, (uint64_t)std::abs(ds[index]));
+				last_p = bid;
+				last_t = t;
+				++index;
+			}
+
+			const uint8_t reg_a = (uint8_t)(price_scale & 0x0F) | (TICK_FORMAT_V2 << 4);
+			const uint8_t reg_b0 = calc_uint_type(start_price);
+			const uint8_t reg_b1 = calc_int_type(max_db);
+			const uint8_t reg_b2 = calc_int_type(max_ds);
+			const uint8_t reg_b3 = calc_int_type(max_dt);
+			const uint8_t reg_b = (reg_b3 << 6) | (reg_b2 << 4) | (reg_b1 << 2) | (reg_b0 & 0x03);
+
+			const size_t length = 2 + sizeof(uint32_t) +
+				conv_int_type_to_bytes(reg_b0) +
+				count * (conv_int_type_to_bytes(reg_b1) + conv_int_type_to_bytes(reg_b2) + conv_int_type_to_bytes(reg_b3));
+			data.resize(length);
+			data[0] = reg_a;
+			data[1] = reg_b;
+
+			uint8_t* p = data.data();
+			size_t offset_ptr = 2;
+			offset_ptr = set_u64_value(count, 2, p, offset_ptr);
+			offset_ptr = set_u64_value(start_price, reg_b0, p, offset_ptr);
+			offset_ptr = set_column(dt, count, reg_b3, p, offset_ptr);
+			offset_ptr = set_column(db, count, reg_b1, p, offset_ptr);
+						 set_column(ds, count, reg_b2, p, offset_ptr);
+		} // write_ticks_v2
+
+		// добавляем тик в контейнер вида std::map<uint64_t, ShortTick>
+		template<class T>
+		static inline void add_tick(T &ticks, const uint64_t t, const double bid, const double ask) {
+			ticks[t] = ShortTick(bid, ask);
+		}
+
+		// тики идут по возрастанию времени, поэтому в блок они просто дописываются
+		static inline void add_tick(QdbTickBlock &ticks, const uint64_t t, const double bid, const double ask) {
+			ticks.push_back(t, bid, ask);
+		}
+
+		template<class T>
+		static inline void reserve_ticks(T &, const size_t) {}
+
+		static inline void reserve_ticks(QdbTickBlock &ticks, const size_t num_ticks) {
+			ticks.reserve(ticks.size() + num_ticks);
+		}
+
 		template<class T>
 		inline void read_ticks(
 				T				&ticks,
@@ -547,6 +801,10 @@ namespace trading_db {
 
 			// получаем точность котировок и объема
 			price_scale = data[0] & 0x0F;			// reg_a 0-3
+			if (((data[0] >> 4) & 0x0F) == TICK_FORMAT_V2) {
+				read_ticks_v2(ticks, price_scale, timestamp_ms);
+				return;
+			}
 
 			// получаем множитель для котировок иобъема
 			const uint64_t price_factor = (uint64_t)(std::pow(10, price_scale) + 0.5d);
@@ -562,34 +820,147 @@ namespace trading_db {
 
 			const size_t sample_size = 2 * conv_int_type_to_bytes(reg_b1) + conv_int_type_to_bytes(reg_b3);
 
-			// получаем стартовую цену и время
-			uint64_t start_price = 0;//, start_time = 0;
+			// получаем стартовую цену
+			uint64_t start_price = 0;
 			offset_ptr = get_u64_value(start_price, reg_b0, p, offset_ptr);
-			//offset_ptr = get_u64_value(start_time, reg_b2, p, offset_ptr);
-			//uint64_t last_price = start_price, last_time = start_time;
-			uint64_t last_price = start_price, last_time = timestamp_ms;
+			if (data.size() <= offset_ptr) return;
+			const size_t count = (data.size() - offset_ptr) / sample_size;
+			if (!count) return;
+			read_ticks_v1(ticks, reg_b1, reg_b3, p + offset_ptr, count, start_price, timestamp_ms, (double)price_factor);
+		} // read_ticks
 
-			size_t index = 0;
-			while (!false) {
-				size_t sample_offset_ptr = offset_ptr + index * sample_size;
-				if (sample_offset_ptr >= data.size()) break;
-				++index;
+		// читаем тики в формате TICK_FORMAT_V1 ядром для пары разрядностей блока
+		template<class T>
+		inline void read_ticks_v1(
+				T				&ticks,
+				const uint8_t	reg_b1,
+				const uint8_t	reg_b3,
+				const uint8_t	*p,
+				const size_t	count,
+				const uint64_t	start_price,
+				const uint64_t	timestamp_ms,
+				const double	price_factor) {
+			reserve_ticks(ticks, count);
+			dispatch_int_type(reg_b1, [&](auto tp) {
+				dispatch_int_type(reg_b3, [&](auto tt) {
+					read_ticks_v1_kernel<decltype(tp), decltype(tt)>(
+						ticks, p, count, (int64_t)start_price, (int64_t)timestamp_ms, price_factor);
+				});
+			});
+		}
 
-				int64_t db = 0, da = 0, dt = 0;
-				sample_offset_ptr = get_s64_value(db, reg_b1, p, sample_offset_ptr);
-				sample_offset_ptr = get_s64_value(da, reg_b1, p, sample_offset_ptr);
-									get_s64_value(dt, reg_b3, p, sample_offset_ptr);
-				const int64_t b = last_price + db;
-				const int64_t a = last_price + da;
-				const int64_t t = last_time + dt;
-				last_price = b;
-				last_time = t;
-
-				const double bid = (double)b / (double)price_factor;
-				const double ask = (double)a / (double)price_factor;
-				ticks[t] = ShortTick(bid, ask);
-			};
-		} // read_ticks
+		// для блока тиков распаковываем сразу в массивы блока, если тики идут после тиков блока
+		inline void read_ticks_v1(
+				QdbTickBlock	&ticks,
+				const uint8_t	reg_b1,
+				const uint8_t	reg_b3,
+				const uint8_t	*p,
+				const size_t	count,
+				const uint64_t	start_price,
+				const uint64_t	timestamp_ms,
+				const double	price_factor) {
+			const uint64_t first_t_ms = timestamp_ms + get_first_delta(p, 2 * conv_int_type_to_bytes(reg_b1), reg_b3);
+			if (!ticks.empty() && first_t_ms <= ticks.t_ms(ticks.size() - 1)) {
+				read_ticks_v1<QdbTickBlock>(ticks, reg_b1, reg_b3, p, count, start_price, timestamp_ms, price_factor);
+				return;
+			}
+			uint64_t *t_ms = nullptr;
+			double *bid = nullptr, *ask = nullptr;
+			ticks.append(count, t_ms, bid, ask);
+			dispatch_int_type(reg_b1, [&](auto tp) {
+				dispatch_int_type(reg_b3, [&](auto tt) {
+					read_ticks_v1_kernel<decltype(tp), decltype(tt)>(
+						t_ms, bid, ask, p, count, (int64_t)start_price, (int64_t)timestamp_ms, price_factor);
+				});
+			});
+		}
+
+		// читаем тики в формате TICK_FORMAT_V2: каждый столбец восстанавливается отдельным циклом
+		template<class T>
+		inline void read_ticks_v2(
+				T				&ticks,
+				const size_t	price_scale,
+				const uint64_t	timestamp_ms) {
+			const uint64_t price_factor = (uint64_t)(std::pow(10, price_scale) + 0.5d);
+
+			const uint8_t reg_b0 = data[1] & 0x03;
+			const uint8_t reg_b1 = (data[1] >> 2) & 0x03;
+			const uint8_t reg_b2 = (data[1] >> 4) & 0x03;
+			const uint8_t reg_b3 = (data[1] >> 6) & 0x03;
+
+			const uint8_t* p = data.data();
+			size_t offset_ptr = 2;
+			if (data.size() < offset_ptr + sizeof(uint32_t) + conv_int_type_to_bytes(reg_b0)) return;
+
+			uint64_t count = 0, start_price = 0;
+			offset_ptr = get_u64_value(count, 2, p, offset_ptr);
+			offset_ptr = get_u64_value(start_price, reg_b0, p, offset_ptr);
+			const size_t sample_size =
+				conv_int_type_to_bytes(reg_b1) + conv_int_type_to_bytes(reg_b2) + conv_int_type_to_bytes(reg_b3);
+			if (data.size() < offset_ptr + count * sample_size) return;
+
+			std::vector<int64_t> t_ms(count);
+			offset_ptr = read_time_column_v2(p, offset_ptr, count, reg_b3, timestamp_ms, t_ms.data());
+			const uint8_t *p_bid = p + offset_ptr;
+			const uint8_t *p_spread = p_bid + count * conv_int_type_to_bytes(reg_b1);
+
+			reserve_ticks(ticks, count);
+			dispatch_int_type(reg_b1, [&](auto tb) {
+				dispatch_int_type(reg_b2, [&](auto ts) {
+					read_ticks_v2_kernel<decltype(tb), decltype(ts)>(
+						ticks, t_ms.data(), p_bid, p_spread, count, (int64_t)start_price, (double)price_factor);
+				});
+			});
+		} // read_ticks_v2
+
+		// для блока тиков столбцы восстанавливаются сразу в массивы блока, без промежуточного буфера
+		inline void read_ticks_v2(
+				QdbTickBlock	&ticks,
+				const size_t	price_scale,
+				const uint64_t	timestamp_ms) {
+			const uint64_t price_factor = (uint64_t)(std::pow(10, price_scale) + 0.5d);
+
+			const uint8_t reg_b0 = data[1] & 0x03;
+			const uint8_t reg_b1 = (data[1] >> 2) & 0x03;
+			const uint8_t reg_b2 = (data[1] >> 4) & 0x03;
+			const uint8_t reg_b3 = (data[1] >> 6) & 0x03;
+
+			const uint8_t* p = data.data();
+			size_t offset_ptr = 2;
+			if (data.size() < offset_ptr + sizeof(uint32_t) + conv_int_type_to_bytes(reg_b0)) return;
+
+			uint64_t count = 0, start_price = 0;
+			offset_ptr = get_u64_value(count, 2, p, offset_ptr);
+			offset_ptr = get_u64_value(start_price, reg_b0, p, offset_ptr);
+			const size_t sample_size =
+				conv_int_type_to_bytes(reg_b1) + conv_int_type_to_bytes(reg_b2) + conv_int_type_to_bytes(reg_b3);
+			if (!count || data.size() < offset_ptr + count * sample_size) return;
+
+			// тики дописываются на месте, только если они идут после тиков блока
+			const uint64_t first_t_ms = timestamp_ms + get_first_delta(p, offset_ptr, reg_b3);
+			if (!ticks.empty() && first_t_ms <= ticks.t_ms(ticks.size() - 1)) {
+				read_ticks_v2<QdbTickBlock>(ticks, price_scale, timestamp_ms);
+				return;
+			}
+
+			uint64_t *t_ms = nullptr;
+			double *bid = nullptr, *ask = nullptr;
+			ticks.append(count, t_ms, bid, ask);
+
+			// столбец времени, затем оба столбца цен одним проходом (векторный код, если он доступен)
+			offset_ptr = read_time_column_v2(p, offset_ptr, count, reg_b3, timestamp_ms, (int64_t*)t_ms);
+			const uint8_t *p_bid = p + offset_ptr;
+			const uint8_t *p_spread = p_bid + count * conv_int_type_to_bytes(reg_b1);
+			dispatch_int_type(reg_b1, [&](auto tb) {
+				dispatch_int_type(reg_b2, [&](auto ts) {
+					using TB = decltype(tb);
+					using TS = decltype(ts);
+					QdbSimdDecode::decode_prices<TB, TS>(
+						p_bid, p_spread, count,
+						(int64_t)start_price, (double)price_factor, bid, ask);
+				});
+			});
+		} // read_ticks_v2
 	};
 
 };
@@ -0,0 +1,167 @@
+#pragma once
+#ifndef TRADING_DB_QDB_COMPRESSION_ENGINE_HPP_INCLUDED
+#define TRADING_DB_QDB_COMPRESSION_ENGINE_HPP_INCLUDED
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include "zdict.h"
+#include "zstd.h"
+
+namespace trading_db {
+
+	/** \brief Движок сжатия zstd для блоков QDB
+	 *
+	 * Словари разбираются один раз (ZSTD_CDict/ZSTD_DDict) и используются всеми экземплярами QDB
+	 * только для чтения. Контексты сжатия и распаковки создаются один раз на поток.
+	 * \warning Словарь идентифицируется адресом, размером и ID, поэтому его данные
+	 * не должны меняться, пока по этому адресу выполняется сжатие
+	 */
+	class QdbCompressionEngine {
+	private:
+
+		using dict_key_t = std::tuple<const uint8_t *, size_t, unsigned, int>;
+
+		template<class T>
+		class DictCache {
+		public:
+			std::mutex							mutex;
+			std::map<dict_key_t, std::shared_ptr<T>>	dicts;
+		};
+
+		static DictCache<ZSTD_CDict> &cdict_cache() noexcept {
+			static DictCache<ZSTD_CDict> cache;
+			return cache;
+		}
+
+		static DictCache<ZSTD_DDict> &ddict_cache() noexcept {
+			static DictCache<ZSTD_DDict> cache;
+			return cache;
+		}
+
+		static ZSTD_CCtx *get_cctx() noexcept {
+			static thread_local std::unique_ptr<ZSTD_CCtx, size_t(*)(ZSTD_CCtx*)> cctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+			return cctx.get();
+		}
+
+		static ZSTD_DCtx *get_dctx() noexcept {
+			static thread_local std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+			return dctx.get();
+		}
+
+	public:
+
+		/** \brief Получить разобранный словарь для сжатия
+		 * \param dict_ptr	Указатель на данные словаря
+		 * \param dict_size	Размер словаря
+		 * \param level		Уровень сжатия
+		 * \return Вернет указатель на словарь или nullptr в случае ошибки
+		 */
+		static std::shared_ptr<ZSTD_CDict> get_cdict(
+				const uint8_t *dict_ptr,
+				const size_t dict_size,
+				const int level) noexcept {
+			auto &cache = cdict_cache();
+			const dict_key_t key(dict_ptr, dict_size, ZSTD_getDictID_fromDict(dict_ptr, dict_size), level);
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			auto it = cache.dicts.find(key);
+			if (it != cache.dicts.end()) return it->second;
+			ZSTD_CDict *cdict = ZSTD_createCDict(dict_ptr, dict_size, level);
+			if (!cdict) return nullptr;
+			std::shared_ptr<ZSTD_CDict> ptr(cdict, ZSTD_freeCDict);
+			cache.dicts[key] = ptr;
+			return ptr;
+		}
+
+		/** \brief Получить разобранный словарь для распаковки
+		 * \param dict_ptr	Указатель на данные словаря
+		 * \param dict_size	Размер словаря
+		 * \return Вернет указатель на словарь или nullptr в случае ошибки
+		 */
+		static std::shared_ptr<ZSTD_DDict> get_ddict(
+				const uint8_t *dict_ptr,
+				const size_t dict_size) noexcept {
+			auto &cache = ddict_cache();
+			const dict_key_t key(dict_ptr, dict_size, ZSTD_getDictID_fromDict(dict_ptr, dict_size), 0);
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			auto it = cache.dicts.find(key);
+			if (it != cache.dicts.end()) return it->second;
+			ZSTD_DDict *ddict = ZSTD_createDDict(dict_ptr, dict_size);
+			if (!ddict) return nullptr;
+			std::shared_ptr<ZSTD_DDict> ptr(ddict, ZSTD_freeDDict);
+			cache.dicts[key] = ptr;
+			return ptr;
+		}
+
+		/** \brief Сжать данные
+		 * \param dict_ptr	Указатель на данные словаря
+		 * \param dict_size	Размер словаря
+		 * \param level		Уровень сжатия
+		 * \param src		Исходные данные
+		 * \param src_size	Размер исходных данных
+		 * \param dst		Сжатые данные
+		 * \return Вернет true в случае успеха
+		 */
+		static bool compress(
+				const uint8_t *dict_ptr,
+				const size_t dict_size,
+				const int level,
+				const uint8_t *src,
+				const size_t src_size,
+				std::vector<uint8_t> &dst) noexcept {
+			auto cdict = get_cdict(dict_ptr, dict_size, level);
+			ZSTD_CCtx *cctx = get_cctx();
+			if (!cdict || !cctx) return false;
+			dst.resize(ZSTD_compressBound(src_size));
+			const size_t compressed_size = ZSTD_compress_usingCDict(
+				cctx,
+				dst.data(),
+				dst.size(),
+				src,
+				src_size,
+				cdict.get());
+			if (ZSTD_isError(compressed_size)) return false;
+			dst.resize(compressed_size);
+			return true;
+		}
+
+		/** \brief Распаковать данные
+		 * \param dict_ptr	Указатель на данные словаря
+		 * \param dict_size	Размер словаря
+		 * \param src		Сжатые данные
+		 * \param src_size	Размер сжатых данных
+		 * \param dst		Распакованные данные (буфер может переиспользоваться)
+		 * \return Вернет true в случае успеха
+		 */
+		static bool decompress(
+				const uint8_t *dict_ptr,
+				const size_t dict_size,
+				const uint8_t *src,
+				const size_t src_size,
+				std::vector<uint8_t> &dst) noexcept {
+			const unsigned long long raw_decompress_size = ZSTD_getFrameContentSize(src, src_size);
+			if (raw_decompress_size == ZSTD_CONTENTSIZE_ERROR ||
+				raw_decompress_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+				return false;
+			}
+			auto ddict = get_ddict(dict_ptr, dict_size);
+			ZSTD_DCtx *dctx = get_dctx();
+			if (!ddict || !dctx) return false;
+			dst.resize(raw_decompress_size);
+			const size_t decompress_size = ZSTD_decompress_usingDDict(
+				dctx,
+				dst.data(),
+				dst.size(),
+				src,
+				src_size,
+				ddict.get());
+			if (ZSTD_isError(decompress_size)) return false;
+			dst.resize(decompress_size);
+			return true;
+		}
+	}; // QdbCompressionEngine
+}; // trading_db
+
+#endif // TRADING_DB_QDB_COMPRESSION_ENGINE_HPP_INCLUDED
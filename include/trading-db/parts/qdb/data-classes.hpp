@@ -3,6 +3,7 @@
 #define TRADING_DB_QDB_DATA_CLASSES_HPP_INCLUDED
 
 #include <limits>
+#include <vector>
 #include "ztime.hpp"
 
 namespace trading_db {
@@ -155,6 +156,110 @@ namespace trading_db {
 		}
 	}; // ShortTick
 
+	/** \brief Массив тиков в виде отдельных столбцов (время, bid, ask)
+	 */
+	class TickColumns {
+	public:
+		std::vector<uint64_t>	t_ms;
+		std::vector<double>		bid;
+		std::vector<double>		ask;
+
+		inline size_t size() const noexcept { return t_ms.size(); }
+		inline bool empty() const noexcept { return t_ms.empty(); }
+
+		/// Очистить массивы без освобождения памяти
+		inline void clear() noexcept {
+			t_ms.clear();
+			bid.clear();
+			ask.clear();
+		}
+
+		inline void push_back(const uint64_t time_ms, const double bid_price, const double ask_price) {
+			t_ms.push_back(time_ms);
+			bid.push_back(bid_price);
+			ask.push_back(ask_price);
+		}
+	}; // TickColumns
+
+	/** \brief Массив баров в виде отдельных столбцов
+	 */
+	class CandleColumns {
+	public:
+		std::vector<uint64_t>	timestamp;
+		std::vector<double>		open;
+		std::vector<double>		high;
+		std::vector<double>		low;
+		std::vector<double>		close;
+		std::vector<double>		volume;
+
+		inline size_t size() const noexcept { return timestamp.size(); }
+		inline bool empty() const noexcept { return timestamp.empty(); }
+
+		/// Очистить массивы без освобождения памяти
+		inline void clear() noexcept {
+			timestamp.clear();
+			open.clear();
+			high.clear();
+			low.clear();
+			close.clear();
+			volume.clear();
+		}
+
+		inline void push_back(const Candle &candle) {
+			timestamp.push_back(candle.timestamp);
+			open.push_back(candle.open);
+			high.push_back(candle.high);
+			low.push_back(candle.low);
+			close.push_back(candle.close);
+			volume.push_back(candle.volume);
+		}
+	}; // CandleColumns
+
+	/** \brief Сводка по блоку тиков (один час)
+	 */
+	class TickBlockSummary {
+	public:
+		uint64_t	key				= 0;	/**< Начало часа */
+		uint32_t	count			= 0;	/**< Количество тиков */
+		uint64_t	first_t_ms		= 0;	/**< Время первого тика */
+		uint64_t	last_t_ms		= 0;	/**< Время последнего тика */
+		double		first_bid		= 0;
+		double		first_ask		= 0;
+		double		last_bid		= 0;
+		double		last_ask		= 0;
+		double		min_bid			= 0;
+		double		max_bid			= 0;
+		double		min_ask			= 0;
+		double		max_ask			= 0;
+		uint32_t	compressed_size	= 0;	/**< Размер сжатого блока */
+		uint32_t	raw_size		= 0;	/**< Размер блока до сжатия */
+
+		bool empty() const noexcept {
+			return (count == 0);
+		}
+	}; // TickBlockSummary
+
+	/** \brief Сводка по блоку баров (один день)
+	 */
+	class CandleBlockSummary {
+	public:
+		uint64_t	key				= 0;	/**< Начало дня */
+		uint32_t	count			= 0;	/**< Количество баров */
+		uint64_t	first_time		= 0;	/**< Время первого бара */
+		uint64_t	last_time		= 0;	/**< Время последнего бара */
+		double		open			= 0;
+		double		high			= 0;
+		double		low				= 0;
+		double		close			= 0;
+		double		volume			= 0;
+		uint32_t	compressed_size	= 0;	/**< Размер сжатого блока */
+		uint32_t	raw_size		= 0;	/**< Размер блока до сжатия */
+
+		bool empty() const noexcept {
+			return (count == 0);
+		}
+	}; // CandleBlockSummary
+
 	/** \brief Класс точки времени
 	 */
 	class TimePoint {
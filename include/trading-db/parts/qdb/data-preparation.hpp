@@ -5,10 +5,15 @@
 #include "enums.hpp"
 #include "data-classes.hpp"
 #include "compact-dataset.hpp"
+#include "compression-engine.hpp"
+#include "block-header.hpp"
+#include "codec-registry.hpp"
 #include "dictionary-candles.hpp"
 #include "dictionary-ticks.hpp"
 #include <map>
+#include <array>
 #include <vector>
+#include <algorithm>
 #include "zdict.h"
 #include "zstd.h"
 
@@ -27,10 +32,23 @@ namespace trading_db {
 			// флаг заполнения данных
 			bool	use_filling_empty_bars = false;
 
-			// уровень сжатия
+			// уровень сжатия (архивный)
 			int		compress_level			= ZSTD_maxCLevel();
+			// уровень сжатия при быстрой записи (для многоуровневого сжатия)
+			int		fast_compress_level		= 3;
+			// флаг многоуровневого сжатия: блоки пишутся на fast_compress_level и позже пережимаются до compress_level
+			bool	use_tiered_compression	= false;
+			// формат новых блоков тиков (QdbCompactDataset::TICK_FORMAT_V1 или TICK_FORMAT_V2)
+			uint8_t	tick_format				= QdbCompactDataset::TICK_FORMAT_V2;
+			// флаг записи блоков с заголовком QdbBlockHeader (иначе блоки пишутся как кадр zstd без заголовка)
+			bool	use_block_header		= true;
+			// кодек новых блоков (см. QdbCodecRegistry)
+			uint8_t	codec_id				= QdbCodecRegistry::CODEC_ZSTD;
+			// словари новых блоков (см. QdbCodecRegistry)
+			uint16_t dictionary_candles_id	= QdbCodecRegistry::DICT_CANDLES;
+			uint16_t dictionary_ticks_id	= QdbCodecRegistry::DICT_TICKS;
 
-			// указатели на данные библиотек для сжатия
+			// указатели на данные библиотек для сжатия блоков без заголовка
 			uint8_t *dictionary_candles_ptr = nullptr;
 			size_t	dictionary_candles_size = 0;
 			uint8_t *dictionary_ticks_ptr	= nullptr;
@@ -39,73 +57,81 @@ namespace trading_db {
 
 	private:
 
-		// сжимаем сырые данные
-		inline bool compress_raw_data(
-				const uint8_t *dict_ptr,
-				const size_t dict_size,
+		// буфер распакованных данных, переиспользуется между вызовами
+		std::vector<uint8_t> raw_buffer;
+
+		// буфер сжатых данных блока до добавления заголовка
+		std::vector<uint8_t> payload_buffer;
+
+		// сжимаем сырые данные в кадр zstd без заголовка
+		inline bool compress_legacy(
+				const bool is_tick,
+				const int level,
 				const std::vector<uint8_t> &src,
 				std::vector<uint8_t> &dst) noexcept {
+			return QdbCompressionEngine::compress(
+				is_tick ? config.dictionary_ticks_ptr : config.dictionary_candles_ptr,
+				is_tick ? config.dictionary_ticks_size : config.dictionary_candles_size,
+				level, src.data(), src.size(), dst);
+		}
 
-			size_t new_compressed_data_size = ZSTD_compressBound(src.size());
-			dst.resize(new_compressed_data_size);
-
-			ZSTD_CCtx* const cctx = ZSTD_createCCtx();
-			size_t compressed_size = ZSTD_compress_usingDict(
-				cctx,
-				dst.data(),
-				dst.size(),
-				src.data(),
-				src.size(),
-				dict_ptr,
-				dict_size,
-				config.compress_level);
-
-			ZSTD_freeCCtx(cctx);
-			if (ZSTD_isError(compressed_size)) {
-				return false;
-			}
-			dst.resize(compressed_size);
-
-			//std::cout << "src size: " << src.size() << " dst size: " << dst.size() << std::endl;
+		// сжимаем сырые данные в блок с заголовком
+		inline bool compress_block(
+				const QdbBlockHeader &header,
+				const int level,
+				const std::vector<uint8_t> &src,
+				std::vector<uint8_t> &dst) noexcept {
+			auto codec = QdbCodecRegistry::get_codec(header.codec_id);
+			QdbCodecRegistry::Dictionary dict;
+			if (!codec || !QdbCodecRegistry::get_dictionary(header.dict_id, dict)) return false;
+			if (!codec->compress(dict.ptr, dict.size, level, src.data(), src.size(), payload_buffer)) return false;
+			QdbBlockHeader block_header = header;
+			block_header.raw_size = (uint32_t)src.size();
+			block_header.write(dst);
+			dst.insert(dst.end(), payload_buffer.begin(), payload_buffer.end());
 			return true;
 		}
 
-		// разорхивируем сырые данные
-		inline bool decompress_raw_data(
-				const uint8_t *dict_ptr,
-				const size_t dict_size,
+		inline bool compress_raw_data(
+				const bool is_tick,
+				const uint32_t count,
+				const uint8_t data_format,
 				const std::vector<uint8_t> &src,
 				std::vector<uint8_t> &dst) noexcept {
+			if (!config.use_block_header) return compress_legacy(is_tick, get_write_level(), src, dst);
+			QdbBlockHeader header;
+			header.codec_id = config.codec_id;
+			header.data_format = data_format;
+			header.dict_id = is_tick ? config.dictionary_ticks_id : config.dictionary_candles_id;
+			header.count = count;
+			return compress_block(header, get_write_level(), src, dst);
+		}
 
-			const unsigned long long raw_decompress_size = ZSTD_getFrameContentSize(src.data(), src.size());
-			if(raw_decompress_size == ZSTD_CONTENTSIZE_ERROR) {
-				//std::cout << "error ZSTD_CONTENTSIZE_ERROR!" << std::endl;
-				return false;
-			} else
-			if(raw_decompress_size == ZSTD_CONTENTSIZE_UNKNOWN) {
-				//std::cout << "error ZSTD_CONTENTSIZE_UNKNOWN!" << std::endl;
-				return false;
-			}
-
-			dst.resize(raw_decompress_size);
-
-			ZSTD_DCtx* const dctx = ZSTD_createDCtx();
-			const size_t decompress_size = ZSTD_decompress_usingDict(
-				dctx,
-				dst.data(),
-				raw_decompress_size,
-				src.data(),
-				src.size(),
-				dict_ptr,
-				dict_size);
-
-			ZSTD_freeDCtx(dctx);
-			if (ZSTD_isError(decompress_size)) {
-				//std::cout << "error ZSTD_isError!" << std::endl;
-				//std::cout << "error decompressin: " << ZSTD_getErrorName(decompress_size) << std::endl;
-				return false;
+		// распаковываем блок: блок без заголовка - кадр zstd со словарем из config, иначе кодек из заголовка
+		inline bool decompress_raw_data(
+				const bool is_tick,
+				const uint8_t *src,
+				const size_t src_size,
+				std::vector<uint8_t> &dst,
+				QdbBlockHeader *block_header = nullptr) noexcept {
+			if (QdbBlockHeader::is_legacy(src, src_size)) {
+				if (block_header) *block_header = QdbBlockHeader();
+				return QdbCompressionEngine::decompress(
+					is_tick ? config.dictionary_ticks_ptr : config.dictionary_candles_ptr,
+					is_tick ? config.dictionary_ticks_size : config.dictionary_candles_size,
+					src, src_size, dst);
 			}
-			dst.resize(decompress_size);
+			QdbBlockHeader header;
+			if (!header.read(src, src_size)) return false;
+			auto codec = QdbCodecRegistry::get_codec(header.codec_id);
+			QdbCodecRegistry::Dictionary dict;
+			if (!codec || !QdbCodecRegistry::get_dictionary(header.dict_id, dict)) return false;
+			if (!codec->decompress(
+					dict.ptr, dict.size,
+					src + header.header_size, src_size - header.header_size,
+					header.raw_size, dst)) return false;
+			if (dst.size() != header.raw_size) return false;
+			if (block_header) *block_header = header;
 			return true;
 		}
 
@@ -122,53 +148,224 @@ namespace trading_db {
 
 		}
 
+		/** \brief Получить уровень сжатия, с которым записываются новые блоки
+		 */
+		inline int get_write_level() const noexcept {
+			if (config.use_tiered_compression) return std::min(config.fast_compress_level, config.compress_level);
+			return config.compress_level;
+		}
+
+		/** \brief Пережать блок до архивного уровня сжатия
+		 * \param is_tick	Флаг блока тиков
+		 * \param src		Сжатый блок
+		 * \param src_size	Размер блока
+		 * \param dst		Пережатый блок
+		 * \return Вернет true в случае успеха
+		 */
+		inline bool recompress(
+				const bool is_tick,
+				const uint8_t *src,
+				const size_t src_size,
+				std::vector<uint8_t> &dst) noexcept {
+			// блок пережимается тем же кодеком и словарем, блок без заголовка остается без заголовка
+			QdbBlockHeader header;
+			if (!decompress_raw_data(is_tick, src, src_size, raw_buffer, &header)) return false;
+			if (QdbBlockHeader::is_legacy(src, src_size)) {
+				return compress_legacy(is_tick, config.compress_level, raw_buffer, dst);
+			}
+			return compress_block(header, config.compress_level, raw_buffer, dst);
+		}
+
 		inline bool compress_candles(
 				const std::array<Candle, ztime::MIN_PER_DAY> &src,
 				std::vector<uint8_t> &dst) noexcept {
 			trading_db::QdbCompactDataset dataset;
 			dataset.write_candles(src, config.price_scale, 0);
+			uint32_t count = 0;
+			for (const auto &candle : src) {
+				if (!candle.empty()) ++count;
+			}
 			auto &data = dataset.get_data();
-			return compress_raw_data((const uint8_t *)config.dictionary_candles_ptr, config.dictionary_candles_size, data, dst);
+			return compress_raw_data(false, count, 0, data, dst);
 		}
 
 		inline bool decompress_candles(
 				const uint64_t timestamp_day,
 				const std::vector<uint8_t> &src,
 				std::array<Candle, ztime::MIN_PER_DAY> &dst) noexcept {
+			return decompress_candles(timestamp_day, src.data(), src.size(), dst, raw_buffer);
+		}
+
+		/** \brief Распаковать бары без промежуточного копирования сжатых данных
+		 * \param timestamp_day	Метка времени начала дня
+		 * \param src			Указатель на сжатые данные (например, blob sqlite)
+		 * \param src_size		Размер сжатых данных
+		 * \param dst			Бары за день
+		 * \param buffer		Переиспользуемый буфер для распакованных данных
+		 * \return Вернет true в случае успеха
+		 */
+		inline bool decompress_candles(
+				const uint64_t timestamp_day,
+				const uint8_t *src,
+				const size_t src_size,
+				std::array<Candle, ztime::MIN_PER_DAY> &dst,
+				std::vector<uint8_t> &buffer) noexcept {
 			trading_db::QdbCompactDataset dataset;
 			auto &data = dataset.get_data();
-			if (!decompress_raw_data((const uint8_t *)config.dictionary_candles_ptr, config.dictionary_candles_size, src, data)) {
+			data.swap(buffer);
+			if (!decompress_raw_data(false, src, src_size, data)) {
+				data.swap(buffer);
 				return false;
 			}
 			size_t volume_scale = 0;
 			dataset.read_candles(dst, config.price_scale, volume_scale, timestamp_day, config.use_filling_empty_bars);
+			data.swap(buffer);
 			return true;
 		}
 
+		inline bool decompress_candles(
+				const uint64_t timestamp_day,
+				const uint8_t *src,
+				const size_t src_size,
+				std::array<Candle, ztime::MIN_PER_DAY> &dst) noexcept {
+			return decompress_candles(timestamp_day, src, src_size, dst, raw_buffer);
+		}
+
 		inline bool compress_ticks(
 				const uint64_t timestamp_hour,
 				const std::map<uint64_t, trading_db::ShortTick> &src,
 				std::vector<uint8_t> &dst) noexcept {
 			const uint64_t t_ms = timestamp_hour * ztime::MS_PER_SEC;
 			trading_db::QdbCompactDataset dataset;
-			dataset.write_ticks(src, config.price_scale, t_ms);
+			dataset.write_ticks(src, config.price_scale, t_ms, config.tick_format);
 			auto &data = dataset.get_data();
-			return compress_raw_data(config.dictionary_ticks_ptr, config.dictionary_ticks_size, data, dst);
+			return compress_raw_data(true, (uint32_t)src.size(), config.tick_format, data, dst);
 		}
 
 		inline bool decompress_ticks(
 				const uint64_t timestamp_hour,
 				const std::vector<uint8_t> &src,
 				std::map<uint64_t, trading_db::ShortTick> &dst) noexcept {
+			return decompress_ticks(timestamp_hour, src.data(), src.size(), dst, raw_buffer);
+		}
+
+		/** \brief Распаковать тики без промежуточного копирования сжатых данных
+		 * \param timestamp_hour	Метка времени начала часа
+		 * \param src				Указатель на сжатые данные (например, blob sqlite)
+		 * \param src_size			Размер сжатых данных
+		 * \param dst				Тики за час (std::map<uint64_t, ShortTick> или QdbTickBlock)
+		 * \param buffer			Переиспользуемый буфер для распакованных данных
+		 * \return Вернет true в случае успеха
+		 */
+		template<class T>
+		inline bool decompress_ticks(
+				const uint64_t timestamp_hour,
+				const uint8_t *src,
+				const size_t src_size,
+				T &dst,
+				std::vector<uint8_t> &buffer) noexcept {
 			const uint64_t t_ms = timestamp_hour * ztime::MS_PER_SEC;
 			trading_db::QdbCompactDataset dataset;
 			auto &data = dataset.get_data();
-			if (!decompress_raw_data(config.dictionary_ticks_ptr, config.dictionary_ticks_size, src, data)) {
+			data.swap(buffer);
+			if (!decompress_raw_data(true, src, src_size, data)) {
+				data.swap(buffer);
 				return false;
 			}
 			dataset.read_ticks(dst, config.price_scale, t_ms);
+			data.swap(buffer);
 			return true;
 		}
+
+		template<class T>
+		inline bool decompress_ticks(
+				const uint64_t timestamp_hour,
+				const uint8_t *src,
+				const size_t src_size,
+				T &dst) noexcept {
+			return decompress_ticks(timestamp_hour, src, src_size, dst, raw_buffer);
+		}
+
+		/** \brief Получить сводку по блоку тиков
+		 * \param timestamp_hour	Метка времени начала часа
+		 * \param ticks			Тики за час
+		 * \param data				Сжатый блок
+		 * \param summary			Сводка по блоку
+		 */
+		static void get_summary(
+				const uint64_t timestamp_hour,
+				const std::map<uint64_t, trading_db::ShortTick> &ticks,
+				const std::vector<uint8_t> &data,
+				TickBlockSummary &summary) noexcept {
+			summary = TickBlockSummary();
+			summary.key = timestamp_hour;
+			summary.compressed_size = data.size();
+			summary.raw_size = get_raw_size(data);
+			if (ticks.empty()) return;
+			const auto &first = *ticks.begin();
+			const auto &last = *std::prev(ticks.end());
+			summary.count = ticks.size();
+			summary.first_t_ms = first.first;
+			summary.last_t_ms = last.first;
+			summary.first_bid = first.second.bid;
+			summary.first_ask = first.second.ask;
+			summary.last_bid = last.second.bid;
+			summary.last_ask = last.second.ask;
+			summary.min_bid = summary.max_bid = first.second.bid;
+			summary.min_ask = summary.max_ask = first.second.ask;
+			for (const auto &item : ticks) {
+				summary.min_bid = std::min(summary.min_bid, item.second.bid);
+				summary.max_bid = std::max(summary.max_bid, item.second.bid);
+				summary.min_ask = std::min(summary.min_ask, item.second.ask);
+				summary.max_ask = std::max(summary.max_ask, item.second.ask);
+			}
+		}
+
+		/** \brief Получить сводку по блоку баров
+		 * \param timestamp_day	Метка времени начала дня
+		 * \param candles		Бары за день
+		 * \param data			Сжатый блок
+		 * \param summary		Сводка по блоку
+		 */
+		static void get_summary(
+				const uint64_t timestamp_day,
+				const std::array<Candle, ztime::MIN_PER_DAY> &candles,
+				const std::vector<uint8_t> &data,
+				CandleBlockSummary &summary) noexcept {
+			summary = CandleBlockSummary();
+			summary.key = timestamp_day;
+			summary.compressed_size = data.size();
+			summary.raw_size = get_raw_size(data);
+			for (size_t i = 0; i < candles.size(); ++i) {
+				const Candle &candle = candles[i];
+				if (candle.empty()) continue;
+				const uint64_t t = timestamp_day + i * ztime::SEC_PER_MIN;
+				if (!summary.count) {
+					summary.first_time = t;
+					summary.open = candle.open;
+					summary.high = candle.high;
+					summary.low = candle.low;
+				}
+				++summary.count;
+				summary.last_time = t;
+				summary.close = candle.close;
+				summary.high = std::max(summary.high, candle.high);
+				summary.low = std::min(summary.low, candle.low);
+				summary.volume += candle.volume;
+			}
+		}
+
+		/** \brief Получить размер распакованного блока из заголовка блока или заголовка кадра zstd
+		 */
+		static size_t get_raw_size(const std::vector<uint8_t> &data) noexcept {
+			if (data.empty()) return 0;
+			QdbBlockHeader header;
+			if (header.read(data.data(), data.size())) return header.raw_size;
+			const unsigned long long raw_size = ZSTD_getFrameContentSize(data.data(), data.size());
+			if (raw_size == ZSTD_CONTENTSIZE_ERROR ||
+				raw_size == ZSTD_CONTENTSIZE_UNKNOWN) return 0;
+			return raw_size;
+		}
 	}; // QdbDataPreparation
 }; // trading_db
 
@@ -0,0 +1,124 @@
+#pragma once
+#ifndef TRADING_DB_QDB_PREFETCHER_HPP_INCLUDED
+#define TRADING_DB_QDB_PREFETCHER_HPP_INCLUDED
+
+#include "../../utils/async-tasks.hpp"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+namespace trading_db {
+
+	/** \brief Фоновая предзагрузка блоков
+	 *
+	 * Один фоновый поток выполняет запросы на предзагрузку. Хранится только последний запрос:
+	 * если поток не успел взять предыдущий запрос, он заменяется новым,
+	 * поэтому при последовательном проходе поток всегда работает с ближайшими блоками.
+	 */
+	class QdbPrefetcher {
+	public:
+
+		/// Загрузка блоков, начиная с t_start, но не дальше t_max
+		using Job = std::function<void(const uint64_t t_start, const uint64_t t_max)>;
+
+	private:
+		std::mutex				mutex;
+		std::condition_variable	request_cv;
+		std::condition_variable	idle_cv;
+		bool					is_stop		= true;
+		bool					has_request	= false;
+		bool					is_busy		= false;
+		uint64_t				req_start	= 0;
+		uint64_t				req_max		= 0;
+		Job						on_job		= nullptr;
+		utils::AsyncTasks		tasks;
+
+		void loop() noexcept {
+			while (!false) {
+				uint64_t t_start = 0, t_max = 0;
+				{
+					std::unique_lock<std::mutex> locker(mutex);
+					request_cv.wait(locker, [&](){return has_request || is_stop;});
+					if (is_stop) break;
+					t_start = req_start;
+					t_max = req_max;
+					has_request = false;
+					is_busy = true;
+				}
+				on_job(t_start, t_max);
+				{
+					std::lock_guard<std::mutex> locker(mutex);
+					is_busy = false;
+				}
+				idle_cv.notify_all();
+			}
+			idle_cv.notify_all();
+		}
+
+	public:
+
+		QdbPrefetcher() {};
+
+		~QdbPrefetcher() {
+			stop();
+		};
+
+		/** \brief Запустить фоновый поток
+		 * \param job Функция загрузки блоков. Вызывается из фонового потока
+		 */
+		inline void start(const Job &job) noexcept {
+			stop();
+			{
+				std::lock_guard<std::mutex> locker(mutex);
+				is_stop = false;
+				has_request = false;
+				on_job = job;
+			}
+			tasks.create_task([this]() {
+				loop();
+			});
+		}
+
+		inline bool is_running() noexcept {
+			std::lock_guard<std::mutex> locker(mutex);
+			return !is_stop;
+		}
+
+		/** \brief Запросить предзагрузку (заменяет еще не взятый в работу запрос)
+		 * \return Вернет false, если поток не запущен
+		 */
+		inline bool request(const uint64_t t_start, const uint64_t t_max) noexcept {
+			{
+				std::lock_guard<std::mutex> locker(mutex);
+				if (is_stop) return false;
+				req_start = t_start;
+				req_max = t_max;
+				has_request = true;
+			}
+			request_cv.notify_one();
+			return true;
+		}
+
+		/** \brief Отменить ожидающий запрос и дождаться завершения текущего
+		 */
+		inline void wait() noexcept {
+			std::unique_lock<std::mutex> locker(mutex);
+			has_request = false;
+			idle_cv.wait(locker, [&](){return !is_busy || is_stop;});
+		}
+
+		/** \brief Остановить фоновый поток
+		 */
+		inline void stop() noexcept {
+			{
+				std::lock_guard<std::mutex> locker(mutex);
+				if (is_stop) return;
+				is_stop = true;
+			}
+			request_cv.notify_all();
+			tasks.wait();
+		}
+	}; // QdbPrefetcher
+}; // trading_db
+
+#endif // TRADING_DB_QDB_PREFETCHER_HPP_INCLUDED
@@ -0,0 +1,147 @@
+#pragma once
+#ifndef TRADING_DB_QDB_PRESENCE_BITMAP_HPP_INCLUDED
+#define TRADING_DB_QDB_PRESENCE_BITMAP_HPP_INCLUDED
+
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include "ztime.hpp"
+
+namespace trading_db {
+
+	/** \brief Битовая карта наличия блоков (один бит на час тиков или день баров)
+	 *
+	 * Карта загружается при открытии БД и позволяет не обращаться к sqlite за блоками,
+	 * которых нет (выходные, разрывы в данных). Пока карта не загружена, считается,
+	 * что любой блок может существовать.
+	 */
+	class QdbPresenceBitmap {
+	private:
+		mutable std::mutex		mutex;
+		std::vector<uint64_t>	bits;
+		uint64_t				period		= ztime::SEC_PER_HOUR;
+		uint64_t				base_index	= 0;	// индекс первого бита, кратен 64
+		bool					is_loaded	= false;
+
+		// расширяем карту так, чтобы в нее попал индекс
+		void reserve_index(const uint64_t index) noexcept {
+			const uint64_t word_index = index / 64;
+			if (bits.empty()) {
+				base_index = word_index * 64;
+				bits.resize(1, 0);
+				return;
+			}
+			const uint64_t base_word = base_index / 64;
+			if (word_index < base_word) {
+				bits.insert(bits.begin(), (size_t)(base_word - word_index), 0);
+				base_index = word_index * 64;
+			} else
+			if (word_index >= base_word + bits.size()) {
+				bits.resize((size_t)(word_index - base_word + 1), 0);
+			}
+		}
+
+		inline bool test_index(const uint64_t index) const noexcept {
+			if (index < base_index) return false;
+			const uint64_t pos = index - base_index;
+			if ((pos / 64) >= bits.size()) return false;
+			return (bits[(size_t)(pos / 64)] >> (pos % 64)) & 1;
+		}
+
+	public:
+
+		QdbPresenceBitmap(const uint64_t block_period = ztime::SEC_PER_HOUR) : period(block_period) {};
+
+		/** \brief Загрузить карту из списка ключей блоков
+		 * \param keys	Ключи блоков (начало часа или дня)
+		 */
+		void load(const std::vector<uint64_t> &keys) noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			bits.clear();
+			base_index = 0;
+			for (const uint64_t key : keys) {
+				const uint64_t index = key / period;
+				reserve_index(index);
+				const uint64_t pos = index - base_index;
+				bits[(size_t)(pos / 64)] |= (uint64_t)1 << (pos % 64);
+			}
+			is_loaded = true;
+		}
+
+		/** \brief Отметить блок как существующий
+		 */
+		void set(const uint64_t key) noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!is_loaded) return;
+			const uint64_t index = key / period;
+			reserve_index(index);
+			const uint64_t pos = index - base_index;
+			bits[(size_t)(pos / 64)] |= (uint64_t)1 << (pos % 64);
+		}
+
+		/** \brief Отметить блок как отсутствующий
+		 */
+		void reset(const uint64_t key) noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			const uint64_t index = key / period;
+			if (!test_index(index)) return;
+			const uint64_t pos = index - base_index;
+			bits[(size_t)(pos / 64)] &= ~((uint64_t)1 << (pos % 64));
+		}
+
+		/** \brief Отметить все блоки как отсутствующие
+		 */
+		void clear() noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			bits.clear();
+			base_index = 0;
+		}
+
+		/** \brief Проверить, может ли блок существовать
+		 * \param key	Ключ блока (начало часа или дня)
+		 * \return Вернет false, только если карта загружена и блока точно нет
+		 */
+		bool check(const uint64_t key) const noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!is_loaded) return true;
+			return test_index(key / period);
+		}
+
+		/** \brief Найти первый существующий блок в диапазоне
+		 * \param t_start	Ключ первого блока (включительно)
+		 * \param t_stop	Ключ последнего блока (включительно)
+		 * \param key		Ключ найденного блока (0, если блока нет)
+		 * \return Вернет false, если карта не загружена
+		 */
+		bool find_next(const uint64_t t_start, const uint64_t t_stop, uint64_t &key) const noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			key = 0;
+			if (!is_loaded) return false;
+			const uint64_t stop_index = t_stop / period;
+			uint64_t index = std::max(t_start / period, base_index);
+			const uint64_t end_index = std::min(stop_index + 1, base_index + (uint64_t)bits.size() * 64);
+			while (index < end_index) {
+				const uint64_t pos = index - base_index;
+				const uint64_t word = bits[(size_t)(pos / 64)] >> (pos % 64);
+				if (!word) {
+					// пропускаем пустое слово целиком
+					index += 64 - (pos % 64);
+					continue;
+				}
+				if (word & 1) {
+					key = index * period;
+					return true;
+				}
+				++index;
+			}
+			return true;
+		}
+
+		inline bool loaded() const noexcept {
+			std::lock_guard<std::mutex> lock(mutex);
+			return is_loaded;
+		}
+	}; // QdbPresenceBitmap
+}; // trading_db
+
+#endif // TRADING_DB_QDB_PRESENCE_BITMAP_HPP_INCLUDED
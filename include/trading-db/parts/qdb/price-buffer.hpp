@@ -4,10 +4,16 @@
 
 #include "enums.hpp"
 #include "data-classes.hpp"
+#include "tick-block.hpp"
+#include "candle-day.hpp"
+#include "tick-candle-aggregator.hpp"
 #include <functional>
+#include <memory>
 #include <map>
 #include <array>
 #include <vector>
+#include <algorithm>
+#include <limits>
 #include "ztime.hpp"
 
 namespace trading_db {
@@ -17,6 +23,10 @@ namespace trading_db {
 	class QdbPriceBuffer {
 	public:
 
+		/// Бары за день (данные дня могут разделяться с кэшем блоков и другими буферами)
+		using candles_day = QdbCandleDay;
+		using candles_day_ptr = std::shared_ptr<const candles_day>;
+
 		QdbPriceBuffer() {};
 
 		~QdbPriceBuffer() {};
@@ -33,44 +43,127 @@ namespace trading_db {
 			QDB_PRICE_MODE candles_price_mode = QDB_PRICE_MODE::BID_PRICE;
 		} config;
 
-		std::function<std::map<uint64_t, ShortTick>(const uint64_t t)>			on_read_ticks = nullptr;
-		std::function<std::array<Candle, ztime::MIN_PER_DAY>(const uint64_t t)>	on_read_candles = nullptr;
+		std::function<QdbTickBlock(const uint64_t t)>							on_read_ticks = nullptr;
+		std::function<candles_day_ptr(const uint64_t t)>						on_read_candles = nullptr;
+
+		/// Чтение диапазона часов [t_start, t_stop] одним запросом (возвращает только имеющиеся часы)
+		std::function<std::map<uint64_t, QdbTickBlock>(
+			const uint64_t t_start,
+			const uint64_t t_stop)>												on_read_ticks_range = nullptr;
+		/// Чтение диапазона дней [t_start, t_stop] одним запросом (возвращает только имеющиеся дни)
+		std::function<std::map<uint64_t, candles_day_ptr>(
+			const uint64_t t_start,
+			const uint64_t t_stop)>												on_read_candles_range = nullptr;
+		/// Проверка наличия часа тиков без обращения к БД (false - часа точно нет)
+		std::function<bool(const uint64_t t)>									on_check_tick_hour = nullptr;
+		/// Проверка наличия дня баров без обращения к БД (false - дня точно нет)
+		std::function<bool(const uint64_t t)>									on_check_candle_day = nullptr;
+		/// Поиск первого часа с тиком после t_ms среди часов до t_stop по сводкам блоков (hour = 0, если такого часа нет).
+		/// Вернет false, если сводки недоступны
+		std::function<bool(
+			const uint64_t t_ms,
+			const uint64_t t_stop,
+			uint64_t &hour)>													on_find_next_tick_hour = nullptr;
+		/// Фоновая предзагрузка часов тиков, начиная с t_start, но не дальше t_max.
+		/// Вызывается после загрузки окна тиков, если чтение идет вперед по времени
+		std::function<void(
+			const uint64_t t_start,
+			const uint64_t t_max)>												on_prefetch_ticks = nullptr;
 
 	private:
 
-		template<typename Container, typename Key>
-		typename Container::iterator lower_bound_dec(Container &container, const Key &key) {
-			auto it = container.lower_bound(key);
-			if (it == std::begin(container)) {
-				if (it->first != key) it = std::end(container);
-			} else {
-				if (it->first != key) --it;
-			}
-			return it;
-		}
-
 		// данные тиков за час
-		using ticks_hour = std::map<uint64_t, ShortTick>;
+		using ticks_hour = QdbTickBlock;
 		// массив данных тиков
 		std::map<uint64_t, ticks_hour> tick_buffer;
+		// время последней загрузки окна тиков (для определения чтения вперед)
+		uint64_t last_tick_read_ms = 0;
+		// формирующиеся бары из тиков
+		QdbTickCandleAggregator tick_candles;
+
+		// запрашиваем предзагрузку часов после загруженного окна
+		inline void prefetch_tick_buffer(const uint64_t t_ms, const uint64_t t_ms_max) noexcept {
+			const bool is_forward = t_ms >= last_tick_read_ms;
+			last_tick_read_ms = t_ms;
+			if (!on_prefetch_ticks || !is_forward || tick_buffer.empty()) return;
+			const uint64_t t_start = tick_buffer.rbegin()->first + ztime::SEC_PER_HOUR;
+			const uint64_t t_max = t_ms_max / ztime::MS_PER_SEC;
+			if (t_start > t_max) return;
+			on_prefetch_ticks(t_start, t_max);
+		}
 
 		void write_tick_buffer(const Tick &tick) noexcept {
 			const uint64_t time_hour = ztime::start_of_hour_sec(tick.t_ms);
-			ShortTick short_tick;
-			short_tick.ask = tick.ask;
-			short_tick.bid = tick.bid;
-			tick_buffer[time_hour][tick.t_ms] = short_tick;
+			tick_buffer[time_hour].insert(tick.t_ms, tick.bid, tick.ask);
+			tick_candles.reset();
+		}
+
+		// час тиков из буфера, при отсутствии в буфере - из источника данных (окно буфера не меняется)
+		bool get_tick_hour(const uint64_t time_hour, QdbTickBlock &ticks) noexcept {
+			auto it = tick_buffer.find(time_hour);
+			if (it != tick_buffer.end()) {
+				ticks = it->second;
+				return true;
+			}
+			if (on_check_tick_hour && !on_check_tick_hour(time_hour)) {
+				ticks = QdbTickBlock();
+				return true;
+			}
+			if (!on_read_ticks) return false;
+			ticks = on_read_ticks(time_hour);
+			return true;
+		}
+
+		/** \brief Загрузить в буфер отсутствующие часы из диапазона [start_time, stop_time]
+		 * \param start_time	Начало первого часа
+		 * \param stop_time	Начало последнего часа
+		 * \param t_ms			Метка времени для поиска следующего тика
+		 * \return Вернет true, если среди загруженных часов есть тик после t_ms
+		 */
+		bool load_tick_buffer(const uint64_t start_time, const uint64_t stop_time, const uint64_t t_ms) noexcept {
+			bool has_last_tick = false;
+			if (!on_read_ticks_range) {
+				for (uint64_t rd_time = start_time; rd_time <= stop_time; rd_time += ztime::SEC_PER_HOUR) {
+					if (tick_buffer.find(rd_time) != tick_buffer.end()) continue;
+					auto &data = tick_buffer[rd_time];
+					if (on_check_tick_hour && !on_check_tick_hour(rd_time)) continue;
+					data = on_read_ticks(rd_time);
+					if (!data.empty() && data.t_ms(data.size() - 1) > t_ms) has_last_tick = true;
+				}
+				return has_last_tick;
+			}
+
+			// сужаем диапазон до отсутствующих в буфере часов, часы без данных сразу помечаем пустыми
+			uint64_t first_time = stop_time + ztime::SEC_PER_HOUR;
+			uint64_t last_time = 0;
+			for (uint64_t rd_time = start_time; rd_time <= stop_time; rd_time += ztime::SEC_PER_HOUR) {
+				if (tick_buffer.find(rd_time) != tick_buffer.end()) continue;
+				if (on_check_tick_hour && !on_check_tick_hour(rd_time)) {
+					tick_buffer[rd_time];
+					continue;
+				}
+				if (first_time > stop_time) first_time = rd_time;
+				last_time = rd_time;
+			}
+			if (first_time > stop_time) return false;
+
+			auto data = on_read_ticks_range(first_time, last_time);
+			for (uint64_t rd_time = first_time; rd_time <= last_time; rd_time += ztime::SEC_PER_HOUR) {
+				if (tick_buffer.find(rd_time) != tick_buffer.end()) continue;
+				auto &buff = tick_buffer[rd_time];
+				auto it = data.find(rd_time);
+				if (it == data.end()) continue;
+				buff = std::move(it->second);
+				if (!buff.empty() && buff.t_ms(buff.size() - 1) > t_ms) has_last_tick = true;
+			}
+			return has_last_tick;
 		}
 
 		void read_tick_buffer(const uint64_t t_ms) noexcept {
 			const uint64_t t = t_ms/(uint64_t)ztime::MS_PER_SEC;
 			const uint64_t start_time = t <= config.tick_start ? 0 : ztime::start_of_hour(t - config.tick_start);
 			const uint64_t stop_time = ztime::start_of_hour(t + config.tick_stop);
-			for (uint64_t rd_time = start_time; rd_time <= stop_time; rd_time += ztime::SEC_PER_HOUR) {
-				if (tick_buffer.find(rd_time) == tick_buffer.end()) {
-					tick_buffer[rd_time] = on_read_ticks(rd_time);
-				}
-			}
+			load_tick_buffer(start_time, stop_time, t_ms);
 		}
 
 		void read_next_tick_buffer(const uint64_t t_ms, const uint64_t t_ms_max) noexcept {
@@ -78,21 +171,29 @@ namespace trading_db {
 			const uint64_t t_max = t_ms_max/(uint64_t)ztime::MS_PER_SEC;
 
 			const uint64_t start_time = ztime::start_of_hour(t);
-			uint64_t stop_time = ztime::start_of_hour(t + config.tick_stop);
+			const uint64_t stop_time = ztime::start_of_hour(t + config.tick_stop);
+			const uint64_t max_time = ztime::start_of_hour(t_max);
+			// после окна буфера догружаем данные порциями такого же размера
+			const uint64_t chunk_time = std::max(ztime::start_of_hour(config.tick_stop), (uint64_t)ztime::SEC_PER_HOUR);
+
+			// по сводкам блоков сразу переходим к часу со следующим тиком, пропуская пустые часы
+			uint64_t next_time = 0;
+			if (on_find_next_tick_hour && on_find_next_tick_hour(t_ms, max_time, next_time)) {
+				const uint64_t window_stop = std::max(std::min(stop_time, max_time), start_time);
+				load_tick_buffer(start_time, window_stop, t_ms);
+				if (next_time > window_stop) {
+					const uint64_t next_stop = std::max(std::min(next_time + chunk_time - ztime::SEC_PER_HOUR, max_time), next_time);
+					load_tick_buffer(next_time, next_stop, t_ms);
+				}
+				return;
+			}
 
-			bool has_last_tick = false;
 			uint64_t rd_time = start_time;
 			while(!false) {
-				if (tick_buffer.find(rd_time) == tick_buffer.end()) {
-					auto data = on_read_ticks(rd_time);
-					tick_buffer[rd_time] = data;
-					if (!has_last_tick && !data.empty()) {
-						if (std::prev(data.end())->first > t_ms) {
-							has_last_tick = true;
-						}
-					}
-				}
-				rd_time += ztime::SEC_PER_HOUR;
+				uint64_t rd_stop = rd_time <= stop_time ? stop_time : (rd_time + chunk_time - ztime::SEC_PER_HOUR);
+				rd_stop = std::max(std::min(rd_stop, max_time), rd_time);
+				const bool has_last_tick = load_tick_buffer(rd_time, rd_stop, t_ms);
+				rd_time = rd_stop + ztime::SEC_PER_HOUR;
 				if (rd_time > stop_time && has_last_tick) break;
 				if (rd_time > t_max) break;
 			}
@@ -128,11 +229,11 @@ namespace trading_db {
 			const uint64_t time_hour = ztime::start_of_hour_sec(t_ms);
 			auto it = tick_buffer.find(time_hour);
 			if (it == tick_buffer.end()) return false;
-			auto &buff = it->second;
-			// находим последний тик
-			auto it_tick = lower_bound_dec(buff, t_ms);
+			const auto &buff = it->second;
+			// находим последний тик не позже t_ms
+			const size_t index = buff.upper_bound_index(t_ms);
 
-			if (it_tick == buff.end()) {
+			if (index == 0) {
 				// тика нет, ищем последний тик в предыдущих массивах
 
 				// проверяем, есть ли данные в буфере
@@ -145,26 +246,23 @@ namespace trading_db {
 					// проверяем наличие данных в буфере
 					if (!it_prev->second.empty()) break;
 				}
-				if (it_prev->second.empty()) return false;
+				const auto &prev_buff = it_prev->second;
+				if (prev_buff.empty()) return false;
 				// находим последний тик предыдущего часа
-				auto it_last = std::prev(it_prev->second.end());
+				const size_t last = prev_buff.size() - 1;
 
 				// проверяем мертвое время
-				const int64_t deadtime = ztime::ms_to_sec((int64_t)t_ms - (int64_t)it_last->first);
+				const int64_t deadtime = ztime::ms_to_sec((int64_t)t_ms - (int64_t)prev_buff.t_ms(last));
 				if (deadtime > (int64_t)config.tick_deadtime) return false;
 
-				tick.ask = it_last->second.ask;
-				tick.bid = it_last->second.bid;
-				tick.t_ms = it_last->first;
+				tick = prev_buff.get_tick(last);
 			} else {
 
 				// проверяем мертвое время
-				const int64_t deadtime = ztime::ms_to_sec((int64_t)t_ms - (int64_t)it_tick->first);
+				const int64_t deadtime = ztime::ms_to_sec((int64_t)t_ms - (int64_t)buff.t_ms(index - 1));
 				if (deadtime > (int64_t)config.tick_deadtime) return false;
 
-				tick.ask = it_tick->second.ask;
-				tick.bid = it_tick->second.bid;
-				tick.t_ms = it_tick->first;
+				tick = buff.get_tick(index - 1);
 			}
 			return true;
 		}
@@ -173,507 +271,38 @@ namespace trading_db {
 			const uint64_t time_hour = ztime::start_of_hour_sec(t_ms);
 			auto it = tick_buffer.find(time_hour);
 			if (it == tick_buffer.end()) return false;
-			auto &buff = it->second;
-			// находим последний тик
-			auto it_tick = buff.upper_bound(t_ms);
+			const auto &buff = it->second;
+			// находим первый тик после t_ms
+			const size_t index = buff.upper_bound_index(t_ms);
 
-			if (it_tick == buff.end()) {
+			if (index == buff.size()) {
 				// тика нет, ищем последний тик в следующих массивах
 				// проверяем, есть ли данные в буфере
 				if (it == std::prev(tick_buffer.end())) return false;
 				auto it_prev = it;
-				while (it_prev != tick_buffer.end()) {
+				while (!false) {
 					// получаем следующий час тиков
 					it_prev = std::next(it_prev);
+					if (it_prev == tick_buffer.end()) return false;
 					// проверяем наличие данных в буфере
 					if (!it_prev->second.empty()) break;
 				}
-				if (it_prev->second.empty()) return false;
 				// находим первый тик следующего часа
-				auto it_first = it_prev->second.begin();
-
-				tick.ask = it_first->second.ask;
-				tick.bid = it_first->second.bid;
-				tick.t_ms = it_first->first;
+				tick = it_prev->second.get_tick(0);
 			} else {
-				tick.ask = it_tick->second.ask;
-				tick.bid = it_tick->second.bid;
-				tick.t_ms = it_tick->first;
+				tick = buff.get_tick(index);
 			}
 			return true;
 		}
 
-		bool get_ticks_buffer(std::vector<Tick> &ticks, const uint64_t t_ms_start, const uint64_t t_ms_stop) noexcept {
-			const uint64_t start_time = ztime::start_of_hour_sec(t_ms_start);
-			const uint64_t stop_time = ztime::start_of_hour_sec(t_ms_stop);
-
-			auto it_start = tick_buffer.find(start_time);
-			if (it_start == tick_buffer.end() || it_start->second.empty()) {
-
-				// проверяем, есть ли данные в буфере
-				if (it_start == tick_buffer.begin()) return false;
-				auto it_prev = it_start;
-
-				while (it_prev != tick_buffer.begin()) {
-					// получаем предыдущий час тиков
-					it_prev = std::prev(it_prev);
-					// проверяем наличие данных в буфере
-					if (!it_prev->second.empty()) break;
-				}
-				if (it_prev->second.empty()) return false;
-
-				// находим последний тик предыдущего часа
-				auto it_last = std::prev(it_prev->second.end());
-
-				Tick tick;
-				tick.ask = it_last->second.ask;
-				tick.bid = it_last->second.bid;
-				tick.t_ms = it_last->first;
-				ticks.push_back(tick);
-
-				it_prev++;
-				it_start = it_prev;
-				if (it_start == tick_buffer.end()) return true;
-			}
-
-			auto it_stop = tick_buffer.find(stop_time);
-			if (it_stop == tick_buffer.end() || it_stop->second.empty()) {
-
-				// проверяем, есть ли данные в буфере
-				if (it_stop == tick_buffer.begin()) {
-					if (ticks.empty()) return false;
-					return true;
-				}
-				auto it_prev = it_stop;
-
-				while (it_prev != tick_buffer.begin()) {
-					// получаем предыдущий час тиков
-					it_prev = std::prev(it_prev);
-					// проверяем наличие данных в буфере
-					if (!it_prev->second.empty()) break;
-				}
-
-				if (it_prev->second.empty()) {
-					if (ticks.empty()) return false;
-					return true;
-				}
-
-				// находим последний тик предыдущего часа
-				auto it_last = std::prev(it_prev->second.end());
-
-				Tick tick;
-				tick.ask = it_last->second.ask;
-				tick.bid = it_last->second.bid;
-				tick.t_ms = it_last->first;
-
-				if (!ticks.empty() && tick.t_ms <= ticks.back().t_ms) return true;
-				it_stop = it_prev;
-			}
-
-			if (it_start == it_stop) {
-				auto &buff = it_start->second;
-				auto it_begin = lower_bound_dec(buff, t_ms_start);
-
-				if (it_begin == buff.end()) {
-					// данных нет в буфере, ищем буфером ниже
-
-					// проверяем, есть ли данные в буфере
-					if (it_start == tick_buffer.begin()) return false;
-					auto it_prev = it_start;
-
-					while (it_prev != tick_buffer.begin()) {
-						// получаем предыдущий час тиков
-						it_prev = std::prev(it_prev);
-						// проверяем наличие данных в буфере
-						if (!it_prev->second.empty()) break;
-					}
-					if (it_prev->second.empty()) return false;
-					// находим последний тик предыдущего часа
-					auto it_last = std::prev(it_prev->second.end());
-
-					Tick tick;
-					tick.ask = it_last->second.ask;
-					tick.bid = it_last->second.bid;
-					tick.t_ms = it_last->first;
-					ticks.push_back(tick);
-
-					it_begin = buff.begin();
-				}
-				auto it_end = lower_bound_dec(buff, t_ms_stop);
-				if (it_end == buff.end()) return false;
-
-				++it_end;
-				for (auto it_tick = it_begin; it_tick != it_end; ++it_tick) {
-					Tick tick;
-					tick.ask = it_tick->second.ask;
-					tick.bid = it_tick->second.bid;
-					tick.t_ms = it_tick->first;
-					ticks.push_back(tick);
-				}
-			} else {
-				++it_stop;
-
-				for (auto it = it_start; it != it_stop; ++it) {
-					auto &buff = it->second;
-					if (it == it_start) {
-						auto it_begin = lower_bound_dec(buff, t_ms_start);
-						if (it_begin == buff.end()) {
-							// данных нет в буфере, ищем буфером ниже
-
-							// проверяем, есть ли данные в буфере
-							if (it_start == tick_buffer.begin()) return false;
-							auto it_prev = it_start;
-
-							while (it_prev != tick_buffer.begin()) {
-								// получаем предыдущий час тиков
-								it_prev = std::prev(it_prev);
-								// проверяем наличие данных в буфере
-								if (!it_prev->second.empty()) break;
-							}
-							if (it_prev->second.empty()) return false;
-							// находим последний тик предыдущего часа
-							auto it_last = std::prev(it_prev->second.end());
-
-							Tick tick;
-							tick.ask = it_last->second.ask;
-							tick.bid = it_last->second.bid;
-							tick.t_ms = it_last->first;
-							ticks.push_back(tick);
-							continue;
-						}
-
-						for (auto it_tick = it_begin; it_tick != buff.end(); ++it_tick) {
-							Tick tick;
-							tick.ask = it_tick->second.ask;
-							tick.bid = it_tick->second.bid;
-							tick.t_ms = it_tick->first;
-							ticks.push_back(tick);
-						}
-					} else
-					if (it == it_stop) {
-						auto it_end = lower_bound_dec(buff, t_ms_stop);
-						if (it_end == buff.end()) return false;
-						++it_end;
-						for (auto it_tick = buff.begin(); it_tick != it_end; ++it_tick) {
-							Tick tick;
-							tick.ask = it_tick->second.ask;
-							tick.bid = it_tick->second.bid;
-							tick.t_ms = it_tick->first;
-							ticks.push_back(tick);
-						}
-					} else {
-						for (auto it_tick = buff.begin(); it_tick != buff.end(); ++it_tick) {
-							Tick tick;
-							tick.ask = it_tick->second.ask;
-							tick.bid = it_tick->second.bid;
-							tick.t_ms = it_tick->first;
-							ticks.push_back(tick);
-						}
-					}
-				}
-			}
-			return true;
-		}
-
-		/*
-		bool get_ticks_buffer_v2(std::vector<Tick> &ticks, const size_t num_ticks, const uint64_t t_ms, const uint64_t min_date, const uint64_t max_date) noexcept {
-			uint64_t buffer_time = ztime::start_of_hour_sec(t_ms);
-			if (buffer_time >= max_date) return false;
-            if (buffer_time < min_date) return false;
-
-            //{ Получаем данные из буфера
-            auto it_buffer = tick_buffer.find(buffer_time);
-            if (it_buffer == tick_buffer.end()) {
-                tick_buffer[buffer_time] = on_read_ticks(buffer_time);
-                it_buffer = tick_buffer.find(buffer_time);
-                if (it_buffer == tick_buffer.end()) return false;
-            }
-            //}
-
-            //{ чистим буферы после it_buffer
-            const std::ptrdiff_t max_distance = std::max((std::ptrdiff_t)(config.tick_stop / ztime::SEC_PER_HOUR), std::ptrdiff_t(1));
-            if (std::distance(it_buffer, tick_buffer.end()) > max_distance) {
-                auto it_remove = std::next(it_buffer, max_distance);
-                while (it_remove != tick_buffer.end()) {
-                    it_remove = tick_buffer.erase(it_remove);
-                }
-            }
-            //}
-
-            //{ Загружаем буферы от t_ms
-            const uint64_t last_time = std::prev(tick_buffer.end())->first + ztime::SEC_PER_HOUR;
-            for (uint64_t read_time = last_time; read_time < max_date; read_time += ztime::SEC_PER_HOUR) {
-                tick_buffer[buffer_time] = on_read_ticks(buffer_time);
-            }
-            //}
-
-            //{ внутри первого элемента буфера
-            while (!it_buffer->second.empty()) {
-                auto &buffer = it_buffer->second;
-                auto it_end = lower_bound_dec(buffer, t_ms);
-                if (it_end == buffer.end()) break;
-                // в буфере есть искомый тик
-                if ((std::distance(buffer.begin(), it_end) + 1) >= num_ticks) {
-                    auto it_begin = std::prev(it_end, num_ticks);
-                    for (auto it = it_begin; it < it_end; ++it) {
-                        Tick tick;
-                        tick.ask = it->second.ask;
-                        tick.bid = it->second.bid;
-                        tick.timestamp_ms = it->first;
-                        ticks.push_back(tick);
-                    }
-                    //{ чистим буферы после it_buffer
-                    const std::ptrdiff_t max_distance = std::max((std::ptrdiff_t)(config.tick_start / ztime::SEC_PER_HOUR), 1);
-                    if (std::distance(it_buffer, tick_buffer.end()) > max_distance) {
-                        auto it_remove = std::next(it_buffer, max_distance);
-                        while (it_remove != tick_buffer.end()) {
-                            it_remove = tick_buffer.erase(it_remove);
-                        }
-                    }
-                    //}
-
-                    return true;
-                } else {
-
-                }
-                break;
-            }
-            //}
-
-            while (!false) {
-                // если в буфере нет данных, грузим данные
-                if (it_buffer == tick_buffer.end()) {
-                    tick_buffer[buffer_time] = on_read_ticks(buffer_time);
-                    it_buffer = tick_buffer.find(buffer_time);
-                    if (it_buffer == tick_buffer.end()) return false;
-                }
-                // если данные пустые, смотрим предыдущие данные
-                while (it_buffer->second.empty()) {
-                    if (it_buffer == tick_buffer.begin()) {
-                        // если попали в начало данных, грузим новые
-                        buffer_time -= ztime::SEC_PER_HOUR;
-                        if (buffer_time < min_date) return false;
-                        tick_buffer[buffer_time] = on_read_ticks(buffer_time);
-                        it_buffer = tick_buffer.find(buffer_time);
-                    } else {
-                        it_buffer = std::prev(it_buffer);
-                        buffer_time = it_buffer->first;
-                        if (buffer_time < min_date) return false;
-                    }
-                    continue;
-                }
-                // данные получены
-                auto &buff = it_buffer->second;
-                auto it_begin = lower_bound_dec(buff, t_ms_start);
-
-                if (it_prev->second.size() >= num_ticks) {
-
-                }
-
-            }
-
-
-			if (it_stop == tick_buffer.end() || it_stop->second.empty()) {
-                // проверяем, есть ли данные в буфере
-				if (it_stop == tick_buffer.begin()) return false;
-				auto it_prev = it_stop;
-
-				while (it_prev != tick_buffer.begin()) {
-					// получаем предыдущий час тиков
-					it_prev = std::prev(it_prev);
-					// проверяем наличие данных в буфере
-					if (!it_prev->second.empty()) break;
-				}
-				if (it_prev->second.empty()) return false;
-
-				// находим последний тик предыдущего часа
-				auto it_last = std::prev(it_prev->second.end());
-
-				Tick tick;
-				tick.ask = it_last->second.ask;
-				tick.bid = it_last->second.bid;
-				tick.timestamp_ms = it_last->first;
-				ticks.push_back(tick);
-			} else {
-                auto &buff = it_start->second;
-				auto it_begin = lower_bound_dec(buff, t_ms_start);
-
-			}
-
-
-			auto it_start = tick_buffer.find(start_time);
-			if (it_start == tick_buffer.end() || it_start->second.empty()) {
-
-				// проверяем, есть ли данные в буфере
-				if (it_start == tick_buffer.begin()) return false;
-				auto it_prev = it_start;
-
-				while (it_prev != tick_buffer.begin()) {
-					// получаем предыдущий час тиков
-					it_prev = std::prev(it_prev);
-					// проверяем наличие данных в буфере
-					if (!it_prev->second.empty()) break;
-				}
-				if (it_prev->second.empty()) return false;
-
-				// находим последний тик предыдущего часа
-				auto it_last = std::prev(it_prev->second.end());
-
-				Tick tick;
-				tick.ask = it_last->second.ask;
-				tick.bid = it_last->second.bid;
-				tick.timestamp_ms = it_last->first;
-				ticks.push_back(tick);
-
-				it_prev++;
-				it_start = it_prev;
-				if (it_start == tick_buffer.end()) return true;
-			}
-
-			auto it_stop = tick_buffer.find(stop_time);
-			if (it_stop == tick_buffer.end() || it_stop->second.empty()) {
-
-				// проверяем, есть ли данные в буфере
-				if (it_stop == tick_buffer.begin()) {
-					if (ticks.empty()) return false;
-					return true;
-				}
-				auto it_prev = it_stop;
-
-				while (it_prev != tick_buffer.begin()) {
-					// получаем предыдущий час тиков
-					it_prev = std::prev(it_prev);
-					// проверяем наличие данных в буфере
-					if (!it_prev->second.empty()) break;
-				}
-
-				if (it_prev->second.empty()) {
-					if (ticks.empty()) return false;
-					return true;
-				}
-
-				// находим последний тик предыдущего часа
-				auto it_last = std::prev(it_prev->second.end());
-
-				Tick tick;
-				tick.ask = it_last->second.ask;
-				tick.bid = it_last->second.bid;
-				tick.timestamp_ms = it_last->first;
-
-				if (!ticks.empty() && tick.timestamp_ms <= ticks.back().timestamp_ms) return true;
-				it_stop = it_prev;
-			}
-
-			if (it_start == it_stop) {
-				auto &buff = it_start->second;
-				auto it_begin = lower_bound_dec(buff, t_ms_start);
-
-				if (it_begin == buff.end()) {
-					// данных нет в буфере, ищем буфером ниже
-
-					// проверяем, есть ли данные в буфере
-					if (it_start == tick_buffer.begin()) return false;
-					auto it_prev = it_start;
-
-					while (it_prev != tick_buffer.begin()) {
-						// получаем предыдущий час тиков
-						it_prev = std::prev(it_prev);
-						// проверяем наличие данных в буфере
-						if (!it_prev->second.empty()) break;
-					}
-					if (it_prev->second.empty()) return false;
-					// находим последний тик предыдущего часа
-					auto it_last = std::prev(it_prev->second.end());
-
-					Tick tick;
-					tick.ask = it_last->second.ask;
-					tick.bid = it_last->second.bid;
-					tick.timestamp_ms = it_last->first;
-					ticks.push_back(tick);
-
-					it_begin = buff.begin();
-				}
-				auto it_end = lower_bound_dec(buff, t_ms_stop);
-				if (it_end == buff.end()) return false;
-
-				++it_end;
-				for (auto it_tick = it_begin; it_tick != it_end; ++it_tick) {
-					Tick tick;
-					tick.ask = it_tick->second.ask;
-					tick.bid = it_tick->second.bid;
-					tick.timestamp_ms = it_tick->first;
-					ticks.push_back(tick);
-				}
-			} else {
-				++it_stop;
-
-				for (auto it = it_start; it != it_stop; ++it) {
-					auto &buff = it->second;
-					if (it == it_start) {
-						auto it_begin = lower_bound_dec(buff, t_ms_start);
-						if (it_begin == buff.end()) {
-							// данных нет в буфере, ищем буфером ниже
-
-							// проверяем, есть ли данные в буфере
-							if (it_start == tick_buffer.begin()) return false;
-							auto it_prev = it_start;
-
-							while (it_prev != tick_buffer.begin()) {
-								// получаем предыдущий час тиков
-								it_prev = std::prev(it_prev);
-								// проверяем наличие данных в буфере
-								if (!it_prev->second.empty()) break;
-							}
-							if (it_prev->second.empty()) return false;
-							// находим последний тик предыдущего часа
-							auto it_last = std::prev(it_prev->second.end());
-
-							Tick tick;
-							tick.ask = it_last->second.ask;
-							tick.bid = it_last->second.bid;
-							tick.timestamp_ms = it_last->first;
-							ticks.push_back(tick);
-							continue;
-						}
+		// array of bars/candle by day
+		std::map<uint64_t, candles_day_ptr> candle_buffer;
 
-						for (auto it_tick = it_begin; it_tick != buff.end(); ++it_tick) {
-							Tick tick;
-							tick.ask = it_tick->second.ask;
-							tick.bid = it_tick->second.bid;
-							tick.timestamp_ms = it_tick->first;
-							ticks.push_back(tick);
-						}
-					} else
-					if (it == it_stop) {
-						auto it_end = lower_bound_dec(buff, t_ms_stop);
-						if (it_end == buff.end()) return false;
-						++it_end;
-						for (auto it_tick = buff.begin(); it_tick != it_end; ++it_tick) {
-							Tick tick;
-							tick.ask = it_tick->second.ask;
-							tick.bid = it_tick->second.bid;
-							tick.timestamp_ms = it_tick->first;
-							ticks.push_back(tick);
-						}
-					} else {
-						for (auto it_tick = buff.begin(); it_tick != buff.end(); ++it_tick) {
-							Tick tick;
-							tick.ask = it_tick->second.ask;
-							tick.bid = it_tick->second.bid;
-							tick.timestamp_ms = it_tick->first;
-							ticks.push_back(tick);
-						}
-					}
-				}
-			}
-			return true;
+		// общий для всех буферов пустой день
+		static const candles_day_ptr &empty_candles_day() noexcept {
+			static const candles_day_ptr empty = std::make_shared<const candles_day>();
+			return empty;
 		}
-		*/
-
-		// bar data per day
-		using candles_day = std::array<Candle, ztime::MIN_PER_DAY>;
-		// array of bars/candle by day
-		std::map<uint64_t, candles_day> candle_buffer;
 
 		inline bool check_candle_buffer(const uint64_t t) noexcept {
 			const uint64_t rd_time = ztime::start_of_day(t);
@@ -685,10 +314,39 @@ namespace trading_db {
 		void read_candle_buffer(const uint64_t t) noexcept {
 			const uint64_t start_time = ztime::start_of_day(t - config.candle_start);
 			const uint64_t stop_time = ztime::start_of_day(t + config.candle_stop);
+			if (!on_read_candles_range) {
+				for (uint64_t rd_time = start_time; rd_time <= stop_time; rd_time += ztime::SEC_PER_DAY) {
+					if (candle_buffer.find(rd_time) == candle_buffer.end()) {
+						if (on_check_candle_day && !on_check_candle_day(rd_time)) candle_buffer[rd_time] = empty_candles_day();
+						else {
+							candles_day_ptr day = on_read_candles(rd_time);
+							candle_buffer[rd_time] = day ? std::move(day) : empty_candles_day();
+						}
+					}
+				}
+				return;
+			}
+
+			// сужаем диапазон до отсутствующих в буфере дней, дни без данных сразу помечаем пустыми
+			uint64_t first_time = stop_time + ztime::SEC_PER_DAY;
+			uint64_t last_time = 0;
 			for (uint64_t rd_time = start_time; rd_time <= stop_time; rd_time += ztime::SEC_PER_DAY) {
-				if (candle_buffer.find(rd_time) == candle_buffer.end()) {
-					candle_buffer[rd_time] = on_read_candles(rd_time);
+				if (candle_buffer.find(rd_time) != candle_buffer.end()) continue;
+				if (on_check_candle_day && !on_check_candle_day(rd_time)) {
+					candle_buffer[rd_time] = empty_candles_day();
+					continue;
 				}
+				if (first_time > stop_time) first_time = rd_time;
+				last_time = rd_time;
+			}
+			if (first_time > stop_time) return;
+
+			auto data = on_read_candles_range(first_time, last_time);
+			for (uint64_t rd_time = first_time; rd_time <= last_time; rd_time += ztime::SEC_PER_DAY) {
+				if (candle_buffer.find(rd_time) != candle_buffer.end()) continue;
+				auto it = data.find(rd_time);
+				if (it == data.end() || !it->second) candle_buffer[rd_time] = empty_candles_day();
+				else candle_buffer[rd_time] = it->second;
 			}
 		}
 
@@ -713,10 +371,11 @@ namespace trading_db {
 				const uint64_t time_day = ztime::start_of_day(t);
 				auto it = candle_buffer.find(time_day);
 				if (it == candle_buffer.end()) return false;
+				const candles_day &day = *it->second;
 				const uint64_t minute_day = ztime::get_minute_day(t);
 				switch (p) {
 				case QDB_TIMEFRAMES::PERIOD_M1: {
-						auto &c = it->second[minute_day];
+						auto &c = day[minute_day];
 						if (c.empty()) return false;
 						candle = c;
 					}
@@ -726,73 +385,22 @@ namespace trading_db {
 				case QDB_TIMEFRAMES::PERIOD_M30:
 				case QDB_TIMEFRAMES::PERIOD_H1:
 				case QDB_TIMEFRAMES::PERIOD_H4:
-				case QDB_TIMEFRAMES::PERIOD_D1: {
-						const uint64_t candle_period = static_cast<uint64_t>(p);
-						const uint64_t start_minute_day = minute_day - minute_day % candle_period;
-						// form a new bar
-						Candle new_candle;
-						new_candle.timestamp = start_minute_day * ztime::SEC_PER_MIN + time_day;
-						for (uint64_t m = start_minute_day; m <= minute_day; ++m) {
-							auto &c = it->second[m];
-							if (c.empty()) continue;
-							if (!new_candle.open) new_candle.open = c.open;
-
-							if (!new_candle.high) new_candle.high = c.high;
-							else if (c.high > new_candle.high) new_candle.high = c.high;
-
-							if (!new_candle.low) new_candle.low = c.low;
-							else if (c.low < new_candle.low) new_candle.low = c.low;
-
-							new_candle.close = c.close;
-
-							new_candle.volume += c.volume;
-						}
-						if (new_candle.empty()) return false;
-						candle = new_candle;
-					}
+				case QDB_TIMEFRAMES::PERIOD_D1:
+					// бар берем из пирамиды таймфреймов дня
+					if (!day.get_candle(candle, time_day, minute_day, p)) return false;
 					break;
 				};
 			} else
 			if (m == QDB_CANDLE_MODE::SRC_TICK) {
-				const uint64_t candle_period = static_cast<uint64_t>(p);
-				const uint64_t time_start = (t - (t % (candle_period * ztime::SEC_PER_MIN)));
-				const uint64_t time_start_ms = time_start * ztime::MS_PER_SEC;
-				const uint64_t time_stop_ms = t * ztime::MS_PER_SEC;
-				// get an array of ticks to form an incomplete bar
-				std::vector<Tick> ticks;
-				if (!get_ticks_buffer(
-					ticks,
-					time_start_ms,
-					time_stop_ms)) {
-					return false;
-				}
-				if (config.candle_deadtime) {
-					const int64_t deadtime = ((int64_t)time_stop_ms - (int64_t)ticks.back().t_ms) / (int64_t)ztime::MS_PER_SEC;
-					if (deadtime > (int64_t)config.candle_deadtime) return false;
-				}
-
-				for (auto tick : ticks) {
-					//std::cout << "tick " << tick.bid << " t " << ztime::get_str_date_time(tick.timestamp_ms/1000) << std::endl;
-					double price = 0;
-					switch (config.candles_price_mode) {
-					case QDB_PRICE_MODE::BID_PRICE:
-						price = tick.bid;
-						break;
-					case QDB_PRICE_MODE::ASK_PRICE:
-						price = tick.ask;
-						break;
-					case QDB_PRICE_MODE::AVG_PRICE:
-						price = ((tick.bid + tick.ask) / 2.0);
-						break;
-					}
-					if (!candle.open) {
-						candle.open = candle.high = candle.low = price;
-						candle.timestamp = time_start;
-					}
-					if (price > candle.high) candle.high = price;
-					if (price < candle.low) candle.low = price;
-					candle.close = price;
-				}
+				// бар обновляется только тиками, пришедшими после предыдущего запроса
+				return tick_candles.get_candle(
+					candle, t, p,
+					config.candles_price_mode,
+					config.candle_deadtime,
+					config.tick_start,
+					[&](const uint64_t time_hour, QdbTickBlock &ticks) {
+						return get_tick_hour(time_hour, ticks);
+					});
 			}
 			return true;
 		}
@@ -814,7 +422,6 @@ namespace trading_db {
 				break;
 			case QDB_CANDLE_MODE::SRC_TICK: {
 					const uint64_t t_ms = t * (uint64_t)ztime::MS_PER_SEC;
-					// ! Тут надо переделать реализацию
 					Tick tick;
 					if (!get_tick_buffer(tick, t_ms)) {
 						erase_tick_buffer(t_ms);
@@ -831,6 +438,7 @@ namespace trading_db {
 			if (!get_tick_buffer(tick, t_ms)) {
 				erase_tick_buffer(t_ms);
 				read_tick_buffer(t_ms);
+				prefetch_tick_buffer(t_ms, std::numeric_limits<uint64_t>::max());
 				return get_tick_buffer(tick, t_ms);
 			}
 			return true;
@@ -840,6 +448,7 @@ namespace trading_db {
 			if (!get_tick_buffer(tick, t_ms)) {
 				erase_tick_buffer(t_ms);
 				read_tick_buffer(t_ms);
+				prefetch_tick_buffer(t_ms, std::numeric_limits<uint64_t>::max());
 				return get_tick_buffer(tick, t_ms);
 			}
 			return true;
@@ -849,6 +458,7 @@ namespace trading_db {
 			if (!get_next_tick_buffer(tick, t_ms)) {
 				erase_tick_buffer(t_ms);
 				read_next_tick_buffer(t_ms, t_ms_max);
+				prefetch_tick_buffer(t_ms, t_ms_max);
 				return get_next_tick_buffer(tick, t_ms);
 			}
 			return true;
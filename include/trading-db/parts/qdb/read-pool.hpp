@@ -0,0 +1,97 @@
+#pragma once
+#ifndef TRADING_DB_QDB_READ_POOL_HPP_INCLUDED
+#define TRADING_DB_QDB_READ_POOL_HPP_INCLUDED
+
+#include "storage.hpp"
+#include "presence-bitmap.hpp"
+#include "block-cache.hpp"
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <string>
+
+namespace trading_db {
+
+	/** \brief Общий пул соединений только для чтения к одному файлу QDB
+	 *
+	 * Несколько экземпляров QDB (например, по одному на рабочий поток) открываются поверх пула
+	 * и используют его соединения, карты наличия блоков и общий кэш распакованных блоков.
+	 * У каждого экземпляра остается только свой буфер цен со ссылками на блоки кэша.
+	 */
+	class QdbReadPool {
+	private:
+		std::vector<std::shared_ptr<QdbStorage>>	connections;
+		std::shared_ptr<QdbPresenceBitmap>		tick_presence;
+		std::shared_ptr<QdbPresenceBitmap>		candle_presence;
+		std::string								path;
+		uint64_t								cache_db_id = 0;
+		std::atomic<size_t>						next_connection = ATOMIC_VAR_INIT(0);
+
+		void close() noexcept {
+			connections.clear();
+			tick_presence.reset();
+			candle_presence.reset();
+			QdbBlockCache::get_instance().release_db(cache_db_id);
+			cache_db_id = 0;
+		}
+
+	public:
+
+		QdbReadPool() {};
+
+		~QdbReadPool() {
+			close();
+		}
+
+		/** \brief Открыть пул
+		 * \param file_path		Путь к файлу БД
+		 * \param connections_count	Количество соединений с БД (запросы на одном соединении выполняются последовательно)
+		 * \return Вернет true, если все соединения открыты
+		 */
+		bool open(const std::string &file_path, const size_t connections_count = 1) noexcept {
+			close();
+			for (size_t i = 0; i < std::max(connections_count, (size_t)1); ++i) {
+				auto storage = std::make_shared<QdbStorage>();
+				if (!storage->open(file_path, true)) {
+					close();
+					return false;
+				}
+				connections.push_back(std::move(storage));
+			}
+			tick_presence = std::make_shared<QdbPresenceBitmap>(ztime::SEC_PER_HOUR);
+			candle_presence = std::make_shared<QdbPresenceBitmap>(ztime::SEC_PER_DAY);
+			std::vector<uint64_t> keys;
+			if (connections[0]->read_keys(true, keys)) tick_presence->load(keys);
+			if (connections[0]->read_keys(false, keys)) candle_presence->load(keys);
+			path = file_path;
+			cache_db_id = QdbBlockCache::get_instance().acquire_db(path);
+			return true;
+		}
+
+		inline bool is_open() const noexcept {
+			return !connections.empty();
+		}
+
+		/** \brief Получить соединение для нового экземпляра (соединения раздаются по кругу)
+		 */
+		inline std::shared_ptr<QdbStorage> get_connection() noexcept {
+			if (connections.empty()) return nullptr;
+			return connections[next_connection++ % connections.size()];
+		}
+
+		inline std::shared_ptr<QdbPresenceBitmap> get_tick_presence() const noexcept {
+			return tick_presence;
+		}
+
+		inline std::shared_ptr<QdbPresenceBitmap> get_candle_presence() const noexcept {
+			return candle_presence;
+		}
+
+		inline const std::string &get_path() const noexcept {
+			return path;
+		}
+	}; // QdbReadPool
+}; // trading_db
+
+#endif // TRADING_DB_QDB_READ_POOL_HPP_INCLUDED
@@ -0,0 +1,291 @@
+#pragma once
+#ifndef TRADING_DB_QDB_SIMD_DECODE_HPP_INCLUDED
+#define TRADING_DB_QDB_SIMD_DECODE_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define TRADING_DB_QDB_USE_SIMD_DECODE
+#include <immintrin.h>
+#endif
+
+namespace trading_db {
+
+	/** \brief Векторная распаковка столбцов дельт блока тиков
+	 *
+	 * Дельты столбца (int8/16/32/64) расширяются до int64, значения восстанавливаются
+	 * векторной префиксной суммой, цены переводятся в double и делятся на множитель цены.
+	 * Деление (а не умножение на обратное число) оставлено, чтобы результат совпадал
+	 * со скалярной распаковкой бит в бит.
+	 *
+	 * Столбцы в блоке не выровнены, поэтому значения читаются через memcpy и невыровненные загрузки.
+	 *
+	 * Набор инструкций (AVX2, SSE4.1 или скалярный код) выбирается при первом вызове
+	 * по возможностям процессора. Векторный код собирается только GCC/Clang для x86-64,
+	 * на остальных платформах используется скалярный код.
+	 */
+	class QdbSimdDecode {
+	public:
+
+		/// Наборы инструкций
+		enum class Level {
+			SCALAR	= 0,
+			SSE41	= 1,
+			AVX2	= 2,
+		};
+
+		/** \brief Получить набор инструкций, используемый для распаковки
+		 */
+		static Level get_level() noexcept {
+			int value = level_ref().load(std::memory_order_relaxed);
+			if (value < 0) {
+				value = (int)detect_level();
+				level_ref().store(value, std::memory_order_relaxed);
+			}
+			return (Level)value;
+		}
+
+		/** \brief Ограничить набор инструкций (например, для сравнения со скалярным кодом)
+		 * \param level	Набор инструкций (не выше поддерживаемого процессором)
+		 */
+		static void set_level(const Level level) noexcept {
+			const Level max_level = detect_level();
+			level_ref().store((int)(level < max_level ? level : max_level), std::memory_order_relaxed);
+		}
+
+		/** \brief Восстановить столбец значений из дельт (префиксная сумма)
+		 * \param src		Дельты типа T1 (адрес может быть не выровнен)
+		 * \param count		Количество значений
+		 * \param start		Начальное значение
+		 * \param dst		Значения
+		 */
+		template<class T1>
+		static void prefix_sum(const uint8_t *src, const size_t count, const int64_t start, int64_t *dst) noexcept {
+#			ifdef TRADING_DB_QDB_USE_SIMD_DECODE
+			switch (get_level()) {
+			case Level::AVX2:
+				prefix_sum_avx2<T1>(src, count, start, dst);
+				return;
+			case Level::SSE41:
+				prefix_sum_sse41<T1>(src, count, start, dst);
+				return;
+			default:
+				break;
+			};
+#			endif
+			prefix_sum_scalar<T1>(src, count, start, dst);
+		}
+
+		/** \brief Восстановить столбцы цен bid и ask
+		 * \param db			Дельты bid типа TB (адрес может быть не выровнен)
+		 * \param ds			Спред (ask - bid) типа TS (адрес может быть не выровнен)
+		 * \param count			Количество тиков
+		 * \param start			Начальная цена в пунктах
+		 * \param price_factor	Множитель цены
+		 * \param bid			Цены bid
+		 * \param ask			Цены ask
+		 */
+		template<class TB, class TS>
+		static void decode_prices(
+				const uint8_t	*db,
+				const uint8_t	*ds,
+				const size_t	count,
+				const int64_t	start,
+				const double	price_factor,
+				double			*bid,
+				double			*ask) noexcept {
+#			ifdef TRADING_DB_QDB_USE_SIMD_DECODE
+			// перевод int64 -> double через смещение точен для |x| < 2^51
+			if (is_exact_range<TB, TS>(count, start)) {
+				switch (get_level()) {
+				case Level::AVX2:
+					decode_prices_avx2<TB, TS>(db, ds, count, start, price_factor, bid, ask);
+					return;
+				case Level::SSE41:
+					decode_prices_sse41<TB, TS>(db, ds, count, start, price_factor, bid, ask);
+					return;
+				default:
+					break;
+				};
+			}
+#			endif
+			decode_prices_scalar<TB, TS>(db, ds, count, start, price_factor, bid, ask);
+		}
+
+	private:
+
+		static std::atomic<int> &level_ref() noexcept {
+			static std::atomic<int> level(-1);
+			return level;
+		}
+
+		static Level detect_level() noexcept {
+#			ifdef TRADING_DB_QDB_USE_SIMD_DECODE
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2")) return Level::AVX2;
+			if (__builtin_cpu_supports("sse4.1")) return Level::SSE41;
+#			endif
+			return Level::SCALAR;
+		}
+
+		template<class T1>
+		static inline int64_t load_value(const uint8_t *p) noexcept {
+			T1 value;
+			std::memcpy(&value, p, sizeof(T1));
+			return static_cast<int64_t>(value);
+		}
+
+		template<class T1>
+		static inline void prefix_sum_scalar(const uint8_t *src, const size_t count, int64_t value, int64_t *dst) noexcept {
+			for (size_t i = 0; i < count; ++i) {
+				value += load_value<T1>(src + i * sizeof(T1));
+				dst[i] = value;
+			}
+		}
+
+		template<class TB, class TS>
+		static inline void decode_prices_scalar(
+				const uint8_t *db, const uint8_t *ds, const size_t count, int64_t value,
+				const double price_factor, double *bid, double *ask) noexcept {
+			for (size_t i = 0; i < count; ++i) {
+				value += load_value<TB>(db + i * sizeof(TB));
+				bid[i] = (double)value / price_factor;
+				ask[i] = (double)(value + load_value<TS>(ds + i * sizeof(TS))) / price_factor;
+			}
+		}
+
+		// все промежуточные цены по модулю меньше 2^51
+		template<class TB, class TS>
+		static inline bool is_exact_range(const size_t count, const int64_t start) noexcept {
+			if (sizeof(TB) > 4 || sizeof(TS) > 4 || start < 0) return false;
+			const uint64_t limit = (uint64_t)1 << 51;
+			const uint64_t max_delta = (uint64_t)1 << (8 * sizeof(TB) - 1);
+			const uint64_t max_spread = (uint64_t)1 << (8 * sizeof(TS) - 1);
+			if ((uint64_t)start >= limit || count >= (limit >> 32)) return false;
+			return (uint64_t)start + count * max_delta + max_spread < limit;
+		}
+
+#		ifdef TRADING_DB_QDB_USE_SIMD_DECODE
+
+		// загрузка и расширение до int64 двух (SSE4.1) или четырех (AVX2) значений,
+		// тип значений задается нулевым значением этого типа
+		static inline __m128i __attribute__((target("sse4.1"))) load2(const uint8_t *p, int8_t) noexcept {
+			int16_t v; std::memcpy(&v, p, sizeof(v));
+			return _mm_cvtepi8_epi64(_mm_cvtsi32_si128(v));
+		}
+		static inline __m128i __attribute__((target("sse4.1"))) load2(const uint8_t *p, int16_t) noexcept {
+			int32_t v; std::memcpy(&v, p, sizeof(v));
+			return _mm_cvtepi16_epi64(_mm_cvtsi32_si128(v));
+		}
+		static inline __m128i __attribute__((target("sse4.1"))) load2(const uint8_t *p, int32_t) noexcept {
+			return _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i*)p));
+		}
+		static inline __m128i __attribute__((target("sse4.1"))) load2(const uint8_t *p, int64_t) noexcept {
+			return _mm_loadu_si128((const __m128i*)p);
+		}
+
+		static inline __m256i __attribute__((target("avx2"))) load4(const uint8_t *p, int8_t) noexcept {
+			int32_t v; std::memcpy(&v, p, sizeof(v));
+			return _mm256_cvtepi8_epi64(_mm_cvtsi32_si128(v));
+		}
+		static inline __m256i __attribute__((target("avx2"))) load4(const uint8_t *p, int16_t) noexcept {
+			return _mm256_cvtepi16_epi64(_mm_loadl_epi64((const __m128i*)p));
+		}
+		static inline __m256i __attribute__((target("avx2"))) load4(const uint8_t *p, int32_t) noexcept {
+			return _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)p));
+		}
+		static inline __m256i __attribute__((target("avx2"))) load4(const uint8_t *p, int64_t) noexcept {
+			return _mm256_loadu_si256((const __m256i*)p);
+		}
+
+		// префиксная сумма внутри регистра и перенос последнего значения
+		static inline __m128i __attribute__((target("sse4.1"))) scan2(const __m128i x, __m128i &carry) noexcept {
+			const __m128i sum = _mm_add_epi64(_mm_add_epi64(x, _mm_slli_si128(x, 8)), carry);
+			carry = _mm_unpackhi_epi64(sum, sum);
+			return sum;
+		}
+
+		static inline __m256i __attribute__((target("avx2"))) scan4(__m256i x, __m256i &carry) noexcept {
+			const __m256i zero = _mm256_setzero_si256();
+			x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x03));
+			x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x0F));
+			x = _mm256_add_epi64(x, carry);
+			carry = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 3, 3));
+			return x;
+		}
+
+		// точный перевод int64 -> double для |x| < 2^51
+		static inline __m128d __attribute__((target("sse4.1"))) to_double2(const __m128i x) noexcept {
+			const __m128i magic_i = _mm_set1_epi64x(0x4338000000000000LL);
+			const __m128d magic_d = _mm_castsi128_pd(magic_i);
+			return _mm_sub_pd(_mm_castsi128_pd(_mm_add_epi64(x, magic_i)), magic_d);
+		}
+
+		static inline __m256d __attribute__((target("avx2"))) to_double4(const __m256i x) noexcept {
+			const __m256i magic_i = _mm256_set1_epi64x(0x4338000000000000LL);
+			const __m256d magic_d = _mm256_castsi256_pd(magic_i);
+			return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(x, magic_i)), magic_d);
+		}
+
+		template<class T1>
+		static void __attribute__((target("sse4.1"))) prefix_sum_sse41(
+				const uint8_t *src, const size_t count, const int64_t start, int64_t *dst) noexcept {
+			__m128i carry = _mm_set1_epi64x(start);
+			size_t i = 0;
+			for (; i + 2 <= count; i += 2) {
+				_mm_storeu_si128((__m128i*)(dst + i), scan2(load2(src + i * sizeof(T1), T1()), carry));
+			}
+			prefix_sum_scalar<T1>(src + i * sizeof(T1), count - i, i ? dst[i - 1] : start, dst + i);
+		}
+
+		template<class T1>
+		static void __attribute__((target("avx2"))) prefix_sum_avx2(
+				const uint8_t *src, const size_t count, const int64_t start, int64_t *dst) noexcept {
+			__m256i carry = _mm256_set1_epi64x(start);
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				_mm256_storeu_si256((__m256i*)(dst + i), scan4(load4(src + i * sizeof(T1), T1()), carry));
+			}
+			prefix_sum_scalar<T1>(src + i * sizeof(T1), count - i, i ? dst[i - 1] : start, dst + i);
+		}
+
+		template<class TB, class TS>
+		static void __attribute__((target("sse4.1"))) decode_prices_sse41(
+				const uint8_t *db, const uint8_t *ds, const size_t count, const int64_t start,
+				const double price_factor, double *bid, double *ask) noexcept {
+			const __m128d factor = _mm_set1_pd(price_factor);
+			__m128i carry = _mm_set1_epi64x(start);
+			size_t i = 0;
+			for (; i + 2 <= count; i += 2) {
+				const __m128i b = scan2(load2(db + i * sizeof(TB), TB()), carry);
+				const __m128i a = _mm_add_epi64(b, load2(ds + i * sizeof(TS), TS()));
+				_mm_storeu_pd(bid + i, _mm_div_pd(to_double2(b), factor));
+				_mm_storeu_pd(ask + i, _mm_div_pd(to_double2(a), factor));
+			}
+			decode_prices_scalar<TB, TS>(db + i * sizeof(TB), ds + i * sizeof(TS), count - i, _mm_cvtsi128_si64(carry), price_factor, bid + i, ask + i);
+		}
+
+		template<class TB, class TS>
+		static void __attribute__((target("avx2"))) decode_prices_avx2(
+				const uint8_t *db, const uint8_t *ds, const size_t count, const int64_t start,
+				const double price_factor, double *bid, double *ask) noexcept {
+			const __m256d factor = _mm256_set1_pd(price_factor);
+			__m256i carry = _mm256_set1_epi64x(start);
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				const __m256i b = scan4(load4(db + i * sizeof(TB), TB()), carry);
+				const __m256i a = _mm256_add_epi64(b, load4(ds + i * sizeof(TS), TS()));
+				_mm256_storeu_pd(bid + i, _mm256_div_pd(to_double4(b), factor));
+				_mm256_storeu_pd(ask + i, _mm256_div_pd(to_double4(a), factor));
+			}
+			decode_prices_scalar<TB, TS>(db + i * sizeof(TB), ds + i * sizeof(TS), count - i, _mm256_extract_epi64(carry, 0), price_factor, bid + i, ask + i);
+		}
+
+#		endif // TRADING_DB_QDB_USE_SIMD_DECODE
+	}; // QdbSimdDecode
+}; // trading_db
+
+#endif // TRADING_DB_QDB_SIMD_DECODE_HPP_INCLUDED
@@ -7,6 +7,7 @@
 #endif
 
 #include "../../config.hpp"
+#include "data-classes.hpp"
 
 #include "../../utils/sqlite-func.hpp"
 #include "../../utils/async-tasks.hpp"
@@ -21,6 +22,9 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <functional>
+#include <chrono>
+#include <thread>
 
 namespace trading_db {
 
@@ -47,6 +51,20 @@ namespace trading_db {
 			MetaData(const std::string &k, const std::string &v) : key(k), value(v) {};
 		};
 
+		/// Функция обратного вызова для блока цен (ключ, указатель на данные sqlite, размер данных)
+		using BlobCallback = std::function<void(const uint64_t key, const uint8_t *data, const size_t size)>;
+
+		/// Функция пережатия блока (флаг тиков, ключ, исходный блок, размер блока, новый блок)
+		using RecompressCallback = std::function<bool(
+			const bool is_tick,
+			const uint64_t key,
+			const uint8_t *data,
+			const size_t size,
+			std::vector<uint8_t> &dst)>;
+
+		/// Функция прогресса фонового пережатия (обработано блоков, всего блоков)
+		using ProgressCallback = std::function<void(const size_t done, const size_t total)>;
+
 		enum class METADATA_TYPE {
 			SYMBOL_NAME,
 			SYMBOL_DIGITS,
@@ -61,7 +79,14 @@ namespace trading_db {
 			const std::string candle_table		= "candles";		/**< Имя таблицы */
 			const std::string tick_table		= "ticks";			/**< Имя таблицы */
 			const std::string meta_data_table	= "meta-data";		/**< Имя таблицы */
+			const std::string candle_level_table	= "candle-levels";	/**< Имя таблицы уровней сжатия блоков баров */
+			const std::string tick_level_table		= "tick-levels";	/**< Имя таблицы уровней сжатия блоков тиков */
+			const std::string candle_index_table	= "candle-index";	/**< Имя таблицы сводок по блокам баров */
+			const std::string tick_index_table		= "tick-index";		/**< Имя таблицы сводок по блокам тиков */
+			const std::string candle_source_table	= "candle-sources";	/**< Имя таблицы отпечатков тиков, из которых построены блоки баров */
 			int busy_timeout = 0;
+			int compaction_delay_ms	= 10;	/**< Пауза между пережатием блоков (мс) */
+			int compaction_idle_ms	= 1000;	/**< Время без записи, после которого БД считается простаивающей (мс) */
 			std::atomic<bool> use_log = ATOMIC_VAR_INIT(false);
 		};
 
@@ -81,6 +106,34 @@ namespace trading_db {
 		utils::SqliteStmt stmt_get_candle;
 		utils::SqliteStmt stmt_get_tick;
 		utils::SqliteStmt stmt_get_meta_data;
+		//
+		utils::SqliteStmt stmt_get_candle_range;
+		utils::SqliteStmt stmt_get_tick_range;
+		// уровни сжатия блоков (только для записи)
+		utils::SqliteStmt stmt_replace_candle_level;
+		utils::SqliteStmt stmt_replace_tick_level;
+		utils::SqliteStmt stmt_replace_candle_summary;
+		utils::SqliteStmt stmt_replace_tick_summary;
+		utils::SqliteStmt stmt_delete_candle_summary;
+		utils::SqliteStmt stmt_delete_tick_summary;
+		utils::SqliteStmt stmt_get_candle_summary_range;
+		utils::SqliteStmt stmt_get_tick_summary_range;
+		utils::SqliteStmt stmt_get_next_tick_summary;
+		utils::SqliteStmt stmt_replace_candle_source;
+		utils::SqliteStmt stmt_get_candle_source_range;
+		utils::SqliteStmt stmt_delete_candle;
+		utils::SqliteStmt stmt_delete_candle_level;
+		utils::SqliteStmt stmt_delete_candle_source;
+		bool is_readonly = false;
+
+		// сводки по блокам есть для всех блоков
+		std::atomic<bool>		is_candle_summary = ATOMIC_VAR_INIT(false);
+		std::atomic<bool>		is_tick_summary = ATOMIC_VAR_INIT(false);
+
+		// фоновое пережатие блоков
+		utils::AsyncTasks		compaction_tasks;
+		std::atomic<bool>		is_compaction = ATOMIC_VAR_INIT(false);
+		std::atomic<uint64_t>	last_write_ms = ATOMIC_VAR_INIT(0);
 
 		// флаг сброса
 		bool is_backup = ATOMIC_VAR_INIT(false);
@@ -89,6 +142,8 @@ namespace trading_db {
 		std::atomic<bool> is_shutdown = ATOMIC_VAR_INIT(false);
 		//
 		std::mutex method_mutex;
+		// общие запросы чтения
+		std::mutex read_mutex;
 
 		inline void print_error(
 				const std::string message,
@@ -133,6 +188,56 @@ namespace trading_db {
 				if (!utils::prepare(sqlite_db_ptr, create_candle_table_sql)) return false;
 				if (!utils::prepare(sqlite_db_ptr, create_tick_table_sql)) return false;
 				if (!utils::prepare(sqlite_db_ptr, create_meta_data_table_sql)) return false;
+				if (readonly) return true;
+
+				const std::string create_candle_level_table_sql =
+					"CREATE TABLE IF NOT EXISTS '" + config.candle_level_table + "' ("
+					"key				INTEGER PRIMARY KEY NOT NULL,"
+					"level				INTEGER				NOT NULL)";
+				const std::string create_tick_level_table_sql =
+					"CREATE TABLE IF NOT EXISTS '" + config.tick_level_table + "' ("
+					"key				INTEGER PRIMARY KEY NOT NULL,"
+					"level				INTEGER				NOT NULL)";
+
+				const std::string create_candle_index_table_sql =
+					"CREATE TABLE IF NOT EXISTS '" + config.candle_index_table + "' ("
+					"key				INTEGER PRIMARY KEY NOT NULL,"
+					"count				INTEGER				NOT NULL,"
+					"first_time			INTEGER				NOT NULL,"
+					"last_time			INTEGER				NOT NULL,"
+					"open				REAL				NOT NULL,"
+					"high				REAL				NOT NULL,"
+					"low				REAL				NOT NULL,"
+					"close				REAL				NOT NULL,"
+					"volume				REAL				NOT NULL,"
+					"compressed_size	INTEGER				NOT NULL,"
+					"raw_size			INTEGER				NOT NULL)";
+				const std::string create_tick_index_table_sql =
+					"CREATE TABLE IF NOT EXISTS '" + config.tick_index_table + "' ("
+					"key				INTEGER PRIMARY KEY NOT NULL,"
+					"count				INTEGER				NOT NULL,"
+					"first_t_ms			INTEGER				NOT NULL,"
+					"last_t_ms			INTEGER				NOT NULL,"
+					"first_bid			REAL				NOT NULL,"
+					"first_ask			REAL				NOT NULL,"
+					"last_bid			REAL				NOT NULL,"
+					"last_ask			REAL				NOT NULL,"
+					"min_bid			REAL				NOT NULL,"
+					"max_bid			REAL				NOT NULL,"
+					"min_ask			REAL				NOT NULL,"
+					"max_ask			REAL				NOT NULL,"
+					"compressed_size	INTEGER				NOT NULL,"
+					"raw_size			INTEGER				NOT NULL)";
+				const std::string create_candle_source_table_sql =
+					"CREATE TABLE IF NOT EXISTS '" + config.candle_source_table + "' ("
+					"key				INTEGER PRIMARY KEY NOT NULL,"
+					"hash				INTEGER				NOT NULL)";
+
+				if (!utils::prepare(sqlite_db_ptr, create_candle_level_table_sql)) return false;
+				if (!utils::prepare(sqlite_db_ptr, create_tick_level_table_sql)) return false;
+				if (!utils::prepare(sqlite_db_ptr, create_candle_index_table_sql)) return false;
+				if (!utils::prepare(sqlite_db_ptr, create_tick_index_table_sql)) return false;
+				if (!utils::prepare(sqlite_db_ptr, create_candle_source_table_sql)) return false;
 			}
 			return true;
 		}
@@ -151,16 +256,81 @@ namespace trading_db {
 				!stmt_replace_meta_data.init(sqlite_db, "INSERT OR REPLACE INTO '" + config.meta_data_table + "' (key, value) VALUES (?, ?)") ||
 				!stmt_get_candle.init(sqlite_db, "SELECT value FROM '" + config.candle_table + "' WHERE key == :x") ||
 				!stmt_get_tick.init(sqlite_db, "SELECT value FROM '" + config.tick_table + "' WHERE key == :x") ||
-				!stmt_get_meta_data.init(sqlite_db, "SELECT value FROM '" + config.meta_data_table + "' WHERE key == :x")
+				!stmt_get_meta_data.init(sqlite_db, "SELECT value FROM '" + config.meta_data_table + "' WHERE key == :x") ||
+				!stmt_get_candle_range.init(sqlite_db, "SELECT key, value FROM '" + config.candle_table + "' WHERE key BETWEEN :a AND :b ORDER BY key") ||
+				!stmt_get_tick_range.init(sqlite_db, "SELECT key, value FROM '" + config.tick_table + "' WHERE key BETWEEN :a AND :b ORDER BY key")
 				) {
 				sqlite3_close_v2(sqlite_db);
 				sqlite_db = nullptr;
 				print_error("stmt init return false", __LINE__);
 				return false;
 			}
+			is_readonly = readonly;
+			if (!readonly) {
+				if (!stmt_replace_candle_level.init(sqlite_db, "INSERT OR REPLACE INTO '" + config.candle_level_table + "' (key, level) VALUES (?, ?)") ||
+					!stmt_replace_tick_level.init(sqlite_db, "INSERT OR REPLACE INTO '" + config.tick_level_table + "' (key, level) VALUES (?, ?)") ||
+					!stmt_replace_candle_summary.init(sqlite_db, "INSERT OR REPLACE INTO '" + config.candle_index_table + "' "
+						"(key, count, first_time, last_time, open, high, low, close, volume, compressed_size, raw_size) "
+						"VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)") ||
+					!stmt_replace_tick_summary.init(sqlite_db, "INSERT OR REPLACE INTO '" + config.tick_index_table + "' "
+						"(key, count, first_t_ms, last_t_ms, first_bid, first_ask, last_bid, last_ask, "
+						"min_bid, max_bid, min_ask, max_ask, compressed_size, raw_size) "
+						"VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)") ||
+					!stmt_delete_candle_summary.init(sqlite_db, "DELETE FROM '" + config.candle_index_table + "' WHERE key == ?") ||
+					!stmt_delete_tick_summary.init(sqlite_db, "DELETE FROM '" + config.tick_index_table + "' WHERE key == ?") ||
+					!stmt_replace_candle_source.init(sqlite_db, "INSERT OR REPLACE INTO '" + config.candle_source_table + "' (key, hash) VALUES (?, ?)") ||
+					!stmt_get_candle_source_range.init(sqlite_db, "SELECT key, hash FROM '" + config.candle_source_table + "' WHERE key BETWEEN :a AND :b ORDER BY key") ||
+					!stmt_delete_candle.init(sqlite_db, "DELETE FROM '" + config.candle_table + "' WHERE key == ?") ||
+					!stmt_delete_candle_level.init(sqlite_db, "DELETE FROM '" + config.candle_level_table + "' WHERE key == ?") ||
+					!stmt_delete_candle_source.init(sqlite_db, "DELETE FROM '" + config.candle_source_table + "' WHERE key == ?")) {
+					sqlite3_close_v2(sqlite_db);
+					sqlite_db = nullptr;
+					print_error("stmt init return false", __LINE__);
+					return false;
+				}
+			}
+			// в файлах, открытых только для чтения, таблиц сводок может не быть
+			const std::string candle_summary_sql =
+				"SELECT key, count, first_time, last_time, open, high, low, close, volume, compressed_size, raw_size "
+				"FROM '" + config.candle_index_table + "' ";
+			const std::string tick_summary_sql =
+				"SELECT key, count, first_t_ms, last_t_ms, first_bid, first_ask, last_bid, last_ask, "
+				"min_bid, max_bid, min_ask, max_ask, compressed_size, raw_size "
+				"FROM '" + config.tick_index_table + "' ";
+			if (check_table(config.candle_index_table)) {
+				stmt_get_candle_summary_range.init(sqlite_db, candle_summary_sql + "WHERE key BETWEEN :a AND :b ORDER BY key");
+			}
+			if (check_table(config.tick_index_table)) {
+				stmt_get_tick_summary_range.init(sqlite_db, tick_summary_sql + "WHERE key BETWEEN :a AND :b ORDER BY key");
+				stmt_get_next_tick_summary.init(sqlite_db, tick_summary_sql + "WHERE key BETWEEN :a AND :b AND last_t_ms > :t ORDER BY key LIMIT 1");
+			}
+			update_summary_state();
 			return true;
 		}
 
+		bool check_table(const std::string &table) noexcept {
+			utils::SqliteStmt stmt;
+			if (!stmt.init(sqlite_db, "SELECT COUNT(*) FROM sqlite_master WHERE type == 'table' AND name == '" + table + "'")) return false;
+			uint64_t value = 0;
+			return get_uint64_value(stmt, value) && value > 0;
+		}
+
+		uint64_t get_row_count(const std::string &table) noexcept {
+			utils::SqliteStmt stmt;
+			if (!stmt.init(sqlite_db, "SELECT COUNT(*) FROM '" + table + "'")) return 0;
+			uint64_t value = 0;
+			get_uint64_value(stmt, value);
+			return value;
+		}
+
+		// сводками можно пользоваться, только если они есть для каждого блока
+		void update_summary_state() noexcept {
+			is_candle_summary = stmt_get_candle_summary_range.get() &&
+				get_row_count(config.candle_index_table) == get_row_count(config.candle_table);
+			is_tick_summary = stmt_get_tick_summary_range.get() &&
+				get_row_count(config.tick_index_table) == get_row_count(config.tick_table);
+		}
+
 		bool replace_price_data(
 				const uint64_t key,
 				const std::vector<uint8_t> &buffer,
@@ -235,11 +405,204 @@ namespace trading_db {
 			return true;
 		}
 
+		// записываем уровень сжатия блока (вызывается внутри транзакции)
+		bool replace_level(
+				const uint64_t		key,
+				const int			level,
+				utils::SqliteStmt	&stmt) noexcept {
+			sqlite3_reset(stmt.get());
+			if (sqlite3_bind_int64(stmt.get(), 1, key) != SQLITE_OK ||
+				sqlite3_bind_int(stmt.get(), 2, level) != SQLITE_OK) {
+				return false;
+			}
+			const int err = sqlite3_step(stmt.get());
+			sqlite3_reset(stmt.get());
+			sqlite3_clear_bindings(stmt.get());
+			if (err != SQLITE_DONE) {
+				print_error(std::string(sqlite3_errmsg(sqlite_db)) +
+					", code " + std::to_string(err), __LINE__);
+				return false;
+			}
+			return true;
+		}
+
+		// выполняем запросы в одной транзакции, при ошибке изменения откатываются
+		bool execute_in_transaction(const std::vector<std::string> &queries) noexcept {
+			if (!sqlite_transaction.begin_transaction()) return false;
+			for (const auto &query : queries) {
+				if (!utils::prepare(sqlite_db, query)) {
+					sqlite_transaction.rollback();
+					return false;
+				}
+			}
+			return sqlite_transaction.commit();
+		}
+
+		// выполняем запрос изменения данных (вызывается внутри транзакции)
+		bool step_stmt(utils::SqliteStmt &stmt) noexcept {
+			const int err = sqlite3_step(stmt.get());
+			sqlite3_reset(stmt.get());
+			sqlite3_clear_bindings(stmt.get());
+			if (err != SQLITE_DONE) {
+				print_error(std::string(sqlite3_errmsg(sqlite_db)) +
+					", code " + std::to_string(err), __LINE__);
+				return false;
+			}
+			return true;
+		}
+
+		bool replace_summary(const TickBlockSummary &summary) noexcept {
+			utils::SqliteStmt &stmt = stmt_replace_tick_summary;
+			sqlite3_reset(stmt.get());
+			if (sqlite3_bind_int64(stmt.get(), 1, summary.key) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 2, summary.count) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 3, summary.first_t_ms) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 4, summary.last_t_ms) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 5, summary.first_bid) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 6, summary.first_ask) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 7, summary.last_bid) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 8, summary.last_ask) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 9, summary.min_bid) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 10, summary.max_bid) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 11, summary.min_ask) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 12, summary.max_ask) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 13, summary.compressed_size) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 14, summary.raw_size) != SQLITE_OK) {
+				return false;
+			}
+			return step_stmt(stmt);
+		}
+
+		bool replace_summary(const CandleBlockSummary &summary) noexcept {
+			utils::SqliteStmt &stmt = stmt_replace_candle_summary;
+			sqlite3_reset(stmt.get());
+			if (sqlite3_bind_int64(stmt.get(), 1, summary.key) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 2, summary.count) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 3, summary.first_time) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 4, summary.last_time) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 5, summary.open) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 6, summary.high) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 7, summary.low) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 8, summary.close) != SQLITE_OK ||
+				sqlite3_bind_double(stmt.get(), 9, summary.volume) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 10, summary.compressed_size) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 11, summary.raw_size) != SQLITE_OK) {
+				return false;
+			}
+			return step_stmt(stmt);
+		}
+
+		// удаляем строку по ключу (вызывается внутри транзакции)
+		bool delete_row(const uint64_t key, utils::SqliteStmt &stmt) noexcept {
+			sqlite3_reset(stmt.get());
+			if (sqlite3_bind_int64(stmt.get(), 1, key) != SQLITE_OK) return false;
+			return step_stmt(stmt);
+		}
+
+		bool delete_summary(const uint64_t key, utils::SqliteStmt &stmt) noexcept {
+			return delete_row(key, stmt);
+		}
+
+		// записываем отпечатки тиков дней баров (вызывается внутри транзакции)
+		bool replace_candle_sources(const std::map<uint64_t, uint64_t> &sources) noexcept {
+			utils::SqliteStmt &stmt = stmt_replace_candle_source;
+			for (const auto &item : sources) {
+				sqlite3_reset(stmt.get());
+				if (sqlite3_bind_int64(stmt.get(), 1, item.first) != SQLITE_OK ||
+					sqlite3_bind_int64(stmt.get(), 2, (int64_t)item.second) != SQLITE_OK ||
+					!step_stmt(stmt)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/** \brief Записать сводки вместе с блоками (вызывается внутри транзакции)
+		 * Для блока без сводки старая сводка удаляется, а сводки помечаются как неполные
+		 */
+		template<class T>
+		std::function<bool(const uint64_t key)> get_summary_writer(
+				const std::map<uint64_t, T>	&summary,
+				utils::SqliteStmt			&stmt_delete,
+				bool						&is_complete) noexcept {
+			if (is_readonly) return nullptr;
+			return [this, &summary, &stmt_delete, &is_complete](const uint64_t key) -> bool {
+				auto it = summary.find(key);
+				if (it == summary.end()) {
+					is_complete = false;
+					return delete_summary(key, stmt_delete);
+				}
+				return replace_summary(it->second);
+			};
+		}
+
+		static void read_summary_row(sqlite3_stmt *stmt, TickBlockSummary &summary) noexcept {
+			summary.key				= (uint64_t)sqlite3_column_int64(stmt, 0);
+			summary.count			= (uint32_t)sqlite3_column_int64(stmt, 1);
+			summary.first_t_ms		= (uint64_t)sqlite3_column_int64(stmt, 2);
+			summary.last_t_ms		= (uint64_t)sqlite3_column_int64(stmt, 3);
+			summary.first_bid		= sqlite3_column_double(stmt, 4);
+			summary.first_ask		= sqlite3_column_double(stmt, 5);
+			summary.last_bid		= sqlite3_column_double(stmt, 6);
+			summary.last_ask		= sqlite3_column_double(stmt, 7);
+			summary.min_bid			= sqlite3_column_double(stmt, 8);
+			summary.max_bid			= sqlite3_column_double(stmt, 9);
+			summary.min_ask			= sqlite3_column_double(stmt, 10);
+			summary.max_ask			= sqlite3_column_double(stmt, 11);
+			summary.compressed_size	= (uint32_t)sqlite3_column_int64(stmt, 12);
+			summary.raw_size		= (uint32_t)sqlite3_column_int64(stmt, 13);
+		}
+
+		static void read_summary_row(sqlite3_stmt *stmt, CandleBlockSummary &summary) noexcept {
+			summary.key				= (uint64_t)sqlite3_column_int64(stmt, 0);
+			summary.count			= (uint32_t)sqlite3_column_int64(stmt, 1);
+			summary.first_time		= (uint64_t)sqlite3_column_int64(stmt, 2);
+			summary.last_time		= (uint64_t)sqlite3_column_int64(stmt, 3);
+			summary.open			= sqlite3_column_double(stmt, 4);
+			summary.high			= sqlite3_column_double(stmt, 5);
+			summary.low				= sqlite3_column_double(stmt, 6);
+			summary.close			= sqlite3_column_double(stmt, 7);
+			summary.volume			= sqlite3_column_double(stmt, 8);
+			summary.compressed_size	= (uint32_t)sqlite3_column_int64(stmt, 9);
+			summary.raw_size		= (uint32_t)sqlite3_column_int64(stmt, 10);
+		}
+
+		/** \brief Прочитать сводки по блокам
+		 * \param stmt	Запрос с уже привязанными параметрами
+		 * \param rows	Сводки в порядке возрастания ключа
+		 * \return Вернет true, если запрос был выполнен без ошибок
+		 */
+		template<class T>
+		bool get_summary_rows(utils::SqliteStmt &stmt, std::vector<T> &rows) noexcept {
+			int err = 0;
+			while (true) {
+				rows.clear();
+				while ((err = sqlite3_step(stmt.get())) == SQLITE_ROW) {
+					rows.resize(rows.size() + 1);
+					read_summary_row(stmt.get(), rows.back());
+				}
+				sqlite3_reset(stmt.get());
+				if (err == SQLITE_BUSY) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					continue;
+				}
+				sqlite3_clear_bindings(stmt.get());
+				if (err == SQLITE_DONE) return true;
+				print_error("sqlite3_step return code " + std::to_string(err), __LINE__);
+				return false;
+			}
+			return false;
+		}
+
 		bool replace_price_data_map(
 				const std::map<uint64_t, std::vector<uint8_t>>	&buffer,
 				utils::SqliteTransaction						&transaction,
-				utils::SqliteStmt								&stmt) noexcept {
-			if (buffer.empty()) return true;
+				utils::SqliteStmt								&stmt,
+				utils::SqliteStmt								*stmt_level = nullptr,
+				const int										level = 0,
+				const std::function<bool(const uint64_t key)>	&on_block = nullptr,
+				const std::function<bool()>						&on_commit = nullptr) noexcept {
+			if (buffer.empty() && !on_commit) return true;
 			if (!transaction.begin_transaction()) return false;
 			sqlite3_reset(stmt.get());
 			for (const auto &pair : buffer) {
@@ -267,28 +630,213 @@ namespace trading_db {
 						", code " + std::to_string(err), __LINE__);
 					return false;
 				}
+				if (stmt_level && level > 0 &&
+					!replace_level(pair.first, level, *stmt_level)) {
+					transaction.rollback();
+					return false;
+				}
+				if (on_block && !on_block(pair.first)) {
+					transaction.rollback();
+					return false;
+				}
+			}
+			if (on_commit && !on_commit()) {
+				transaction.rollback();
+				return false;
 			}
 			if (!transaction.commit()) return false;
 			return true;
 		}
 
-		inline std::vector<uint8_t> get_price_data(utils::SqliteStmt &stmt, const uint64_t key) noexcept {
-			std::vector<uint8_t> value;
+		// запросы пережатия блоков одной таблицы
+		class CompactionStmt {
+		public:
+			utils::SqliteStmt update;
+			utils::SqliteStmt level;
+			utils::SqliteStmt index;
+
+			bool init(
+					sqlite3 *sqlite_db,
+					const std::string &table,
+					const std::string &level_table,
+					const std::string &index_table) noexcept {
+				return
+					update.init(sqlite_db, "UPDATE '" + table + "' SET value = ? WHERE key == ? AND value == ?") &&
+					level.init(sqlite_db, "UPDATE '" + level_table + "' SET level = ? WHERE key == ?") &&
+					index.init(sqlite_db, "UPDATE '" + index_table + "' SET compressed_size = ? WHERE key == ?");
+			}
+		};
+
+		/** \brief Заменить блок, только если он не изменился с момента чтения
+		 * \param is_replaced	Вернет true, если блок был заменен, и false, если блок был перезаписан после чтения
+		 * \return Вернет false в случае ошибки БД
+		 */
+		bool compare_and_replace_price_data(
+				CompactionStmt				&stmt,
+				const uint64_t				key,
+				const std::vector<uint8_t>	&old_value,
+				const std::vector<uint8_t>	&new_value,
+				const int					level,
+				bool						&is_replaced) noexcept {
+			is_replaced = false;
+			if (!sqlite_transaction.begin_transaction()) {
+				print_error("begin_transaction return false", __LINE__);
+				return false;
+			}
+			if (sqlite3_bind_blob(stmt.update.get(), 1, new_value.data(), new_value.size(), SQLITE_STATIC) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.update.get(), 2, key) != SQLITE_OK ||
+				sqlite3_bind_blob(stmt.update.get(), 3, old_value.data(), old_value.size(), SQLITE_STATIC) != SQLITE_OK ||
+				!step_stmt(stmt.update)) {
+				sqlite_transaction.rollback();
+				return false;
+			}
+			if (sqlite3_changes(sqlite_db) != 1) {
+				// блок был перезаписан, пережмем его при следующем запуске
+				sqlite_transaction.rollback();
+				return true;
+			}
+			if (sqlite3_bind_int(stmt.level.get(), 1, level) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.level.get(), 2, key) != SQLITE_OK ||
+				!step_stmt(stmt.level) ||
+				sqlite3_bind_int64(stmt.index.get(), 1, new_value.size()) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.index.get(), 2, key) != SQLITE_OK ||
+				!step_stmt(stmt.index)) {
+				sqlite_transaction.rollback();
+				return false;
+			}
+			if (!sqlite_transaction.commit()) {
+				print_error("commit return false", __LINE__);
+				return false;
+			}
+			is_replaced = true;
+			return true;
+		}
+
+		static uint64_t get_steady_ms() noexcept {
+			return std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		// фоновое пережатие блоков до уровня target_level
+		void compaction_loop(
+				const int					target_level,
+				const RecompressCallback	on_recompress,
+				const ProgressCallback		on_progress) noexcept {
+
+			// список блоков для пережатия
+			std::vector<std::pair<bool, uint64_t>> keys;
+			// собственные запросы, чтобы не делить их с потоком чтения
+			utils::SqliteStmt stmt_get_candle_local;
+			utils::SqliteStmt stmt_get_tick_local;
+			CompactionStmt stmt_candle_replace;
+			CompactionStmt stmt_tick_replace;
+			{
+				std::lock_guard<std::mutex> lock(method_mutex);
+				if (!check_init_db()) return;
+				if (!stmt_get_candle_local.init(sqlite_db, "SELECT value FROM '" + config.candle_table + "' WHERE key == :x") ||
+					!stmt_get_tick_local.init(sqlite_db, "SELECT value FROM '" + config.tick_table + "' WHERE key == :x") ||
+					!stmt_candle_replace.init(sqlite_db, config.candle_table, config.candle_level_table, config.candle_index_table) ||
+					!stmt_tick_replace.init(sqlite_db, config.tick_table, config.tick_level_table, config.tick_index_table)) {
+					print_error("stmt init return false", __LINE__);
+					return;
+				}
+				for (const bool is_tick : {false, true}) {
+					utils::SqliteStmt stmt;
+					const std::string &level_table = is_tick ? config.tick_level_table : config.candle_level_table;
+					if (!stmt.init(sqlite_db, "SELECT key FROM '" + level_table + "' WHERE level < " + std::to_string(target_level) + " AND key >= ? ORDER BY key")) {
+						print_error("stmt init return false", __LINE__);
+						return;
+					}
+					uint64_t first_key = 0;
+					int err = 0;
+					while (true) {
+						sqlite3_reset(stmt.get());
+						if (sqlite3_bind_int64(stmt.get(), 1, first_key) != SQLITE_OK) {
+							print_error("sqlite3_bind_int64 error", __LINE__);
+							return;
+						}
+						while ((err = sqlite3_step(stmt.get())) == SQLITE_ROW) {
+							const uint64_t key = (uint64_t)sqlite3_column_int64(stmt.get(), 0);
+							keys.push_back(std::make_pair(is_tick, key));
+							// при повторе запроса продолжим со следующего ключа
+							first_key = key + 1;
+						}
+						sqlite3_reset(stmt.get());
+						if (err == SQLITE_DONE) break;
+						if (err == SQLITE_BUSY && !is_shutdown) {
+							std::this_thread::sleep_for(std::chrono::milliseconds(1));
+							continue;
+						}
+						print_error("sqlite3_step return code " + std::to_string(err), __LINE__);
+						return;
+					}
+				}
+			}
+
+			const size_t total = keys.size();
+			size_t done = 0;
+			if (on_progress) on_progress(done, total);
+
+			std::vector<uint8_t> old_value, new_value;
+			for (const auto &item : keys) {
+				// ждем простоя БД
+				while (is_compaction && !is_shutdown &&
+					(get_steady_ms() - last_write_ms) < (uint64_t)config.compaction_idle_ms) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				}
+				if (!is_compaction || is_shutdown) break;
+
+				const bool is_tick = item.first;
+				const uint64_t key = item.second;
+				{
+					std::lock_guard<std::mutex> lock(method_mutex);
+					old_value = get_price_data(is_tick ? stmt_get_tick_local : stmt_get_candle_local, key);
+				}
+				if (!old_value.empty() &&
+					on_recompress(is_tick, key, old_value.data(), old_value.size(), new_value)) {
+					std::lock_guard<std::mutex> lock(method_mutex);
+					bool is_replaced = false;
+					if (!compare_and_replace_price_data(
+							is_tick ? stmt_tick_replace : stmt_candle_replace,
+							key, old_value, new_value, target_level, is_replaced)) {
+						print_error("error replace block " + std::to_string(key), __LINE__);
+						break;
+					}
+					// если блок не заменен, он был перезаписан во время пережатия и остается в очереди
+				}
+				++done;
+				if (on_progress) on_progress(done, total);
+				if (config.compaction_delay_ms > 0) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(config.compaction_delay_ms));
+				}
+			}
+		}
+
+		/** \brief Прочитать блок цен без копирования
+		 * \param stmt		Предкомпилированный запрос вида "SELECT value ... WHERE key == ?"
+		 * \param key		Ключ блока
+		 * \param on_data	Функция обратного вызова. Указатель принадлежит sqlite и действителен только внутри вызова
+		 * \return Вернет true, если блок был найден
+		 */
+		inline bool get_price_data(
+				utils::SqliteStmt &stmt,
+				const uint64_t key,
+				const BlobCallback &on_data) noexcept {
 			int err = 0;
 			while (true) {
 				if ((err = sqlite3_reset(stmt.get())) != SQLITE_OK) {
 					print_error("sqlite3_reset return code " + std::to_string(err), __LINE__);
-					return std::vector<uint8_t>();
+					return false;
 				}
 				if (sqlite3_bind_int64(stmt.get(), 1, key) != SQLITE_OK) {
 					print_error("sqlite3_bind_text error", __LINE__);
-					return std::vector<uint8_t>();
+					return false;
 				}
 				err = sqlite3_step(stmt.get());
 				if(err == SQLITE_DONE) {
 					sqlite3_reset(stmt.get());
 					sqlite3_clear_bindings(stmt.get());
-					return std::vector<uint8_t>();
+					return false;
 				} else
 				if(err == SQLITE_BUSY) {
 					sqlite3_reset(stmt.get());
@@ -300,33 +848,76 @@ namespace trading_db {
 					sqlite3_reset(stmt.get());
 					sqlite3_clear_bindings(stmt.get());
 					print_error("sqlite3_step return code " + std::to_string(err), __LINE__);
-					return std::vector<uint8_t>();
+					return false;
 				}
 
-				const void* blob = sqlite3_column_blob(stmt.get(), 0);
+				const uint8_t* blob = (const uint8_t*)sqlite3_column_blob(stmt.get(), 0);
 				const size_t blob_bytes = sqlite3_column_bytes(stmt.get(), 0);
-				value.assign((const uint8_t*)blob, (const uint8_t*)blob + blob_bytes);
+				const bool is_data = blob_bytes != 0;
+				if (is_data) on_data(key, blob, blob_bytes);
 
-				err = sqlite3_step(stmt.get());
-				if (err == SQLITE_ROW) {
-					break;
-				} else
-				if(err == SQLITE_DONE) {
-					sqlite3_reset(stmt.get());
-					sqlite3_clear_bindings(stmt.get());
-					break;
-				} else
-				if(err == SQLITE_BUSY) {
-					sqlite3_reset(stmt.get());
-					sqlite3_clear_bindings(stmt.get());
-					value = std::vector<uint8_t>();
-					print_error("sqlite3_step return SQLITE_BUSY", __LINE__);
+				sqlite3_reset(stmt.get());
+				sqlite3_clear_bindings(stmt.get());
+				return is_data;
+			}
+			return false;
+		}
+
+		inline std::vector<uint8_t> get_price_data(utils::SqliteStmt &stmt, const uint64_t key) noexcept {
+			std::vector<uint8_t> value;
+			get_price_data(stmt, key, [&](
+					const uint64_t,
+					const uint8_t *data,
+					const size_t size) {
+				value.assign(data, data + size);
+			});
+			return value;
+		}
+
+		/** \brief Прочитать все блоки цен в диапазоне ключей одним запросом
+		 * \param stmt		Предкомпилированный запрос вида "SELECT key, value ... WHERE key BETWEEN ? AND ?"
+		 * \param t_start	Первый ключ диапазона (включительно)
+		 * \param t_stop	Последний ключ диапазона (включительно)
+		 * \param on_data	Функция обратного вызова для каждой пары ключ-значение (в порядке возрастания ключа).
+		 * Указатель принадлежит sqlite и действителен только внутри вызова
+		 * \return Вернет true, если запрос был выполнен без ошибок
+		 */
+		inline bool get_price_data_range(
+				utils::SqliteStmt &stmt,
+				const uint64_t t_start,
+				const uint64_t t_stop,
+				const BlobCallback &on_data) noexcept {
+			uint64_t first_key = t_start;
+			int err = 0;
+			while (true) {
+				if ((err = sqlite3_reset(stmt.get())) != SQLITE_OK) {
+					print_error("sqlite3_reset return code " + std::to_string(err), __LINE__);
+					return false;
+				}
+				if (sqlite3_bind_int64(stmt.get(), 1, first_key) != SQLITE_OK ||
+					sqlite3_bind_int64(stmt.get(), 2, t_stop) != SQLITE_OK) {
+					print_error("sqlite3_bind_int64 error", __LINE__);
+					return false;
+				}
+				while ((err = sqlite3_step(stmt.get())) == SQLITE_ROW) {
+					const uint64_t key = (uint64_t)sqlite3_column_int64(stmt.get(), 0);
+					const uint8_t* blob = (const uint8_t*)sqlite3_column_blob(stmt.get(), 1);
+					const size_t blob_bytes = sqlite3_column_bytes(stmt.get(), 1);
+					// при повторе запроса продолжим со следующего ключа
+					first_key = key + 1;
+					if (blob_bytes) on_data(key, blob, blob_bytes);
+				}
+				sqlite3_reset(stmt.get());
+				sqlite3_clear_bindings(stmt.get());
+				if (err == SQLITE_DONE) return true;
+				if (err == SQLITE_BUSY) {
 					std::this_thread::sleep_for(std::chrono::milliseconds(1));
 					continue;
 				}
-				break;
+				print_error("sqlite3_step return code " + std::to_string(err), __LINE__);
+				return false;
 			}
-			return std::move(value);
+			return false;
 		}
 
 		inline MetaData get_meta_data(
@@ -449,6 +1040,7 @@ namespace trading_db {
 
 		~QdbStorage() {
 			is_shutdown = true;
+			stop_compaction();
 			std::lock_guard<std::mutex> lock(method_mutex);
 			if (sqlite_db != nullptr) sqlite3_close_v2(sqlite_db);
 		};
@@ -487,33 +1079,114 @@ namespace trading_db {
 		}
 
 		inline bool read_candles(std::vector<uint8_t> &data, const uint64_t t) noexcept {
+			std::lock_guard<std::mutex> lock(read_mutex);
 			data = get_price_data(stmt_get_candle, t);
 			if (data.empty()) return false;
 			return true;
 		}
 
 		inline bool read_ticks(std::vector<uint8_t> &data, const uint64_t t) noexcept {
+			std::lock_guard<std::mutex> lock(read_mutex);
 			data = get_price_data(stmt_get_tick, t);
 			if (data.empty()) return false;
 			return true;
 		}
 
-		inline bool write_candles(const std::map<uint64_t, std::vector<uint8_t>> &data) noexcept {
-			{
-				std::lock_guard<std::mutex> lock(method_mutex);
-				if (!check_init_db()) return false;
+		/** \brief Read the keys of all stored blocks
+		 * \param is_tick_data	Tick blocks if true, candle blocks otherwise
+		 * \param keys			Block keys in ascending order
+		 * \return Will return true if the query was successful
+		 */
+		inline bool read_keys(const bool is_tick_data, std::vector<uint64_t> &keys) noexcept {
+			std::lock_guard<std::mutex> lock(read_mutex);
+			keys.clear();
+			if (!check_init_db()) return false;
+			utils::SqliteStmt stmt;
+			if (!stmt.init(sqlite_db, "SELECT key FROM '" + (is_tick_data ? config.tick_table : config.candle_table) + "' ORDER BY key")) {
+				print_error("stmt init return false", __LINE__);
+				return false;
 			}
-			while (!is_shutdown) {
-				{
-					std::lock_guard<std::mutex> lock(method_mutex);
-					if (replace_price_data_map(data, sqlite_transaction, stmt_replace_candle)) return true;
+			int err = 0;
+			while (true) {
+				while ((err = sqlite3_step(stmt.get())) == SQLITE_ROW) {
+					keys.push_back((uint64_t)sqlite3_column_int64(stmt.get(), 0));
 				}
-				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				if (err == SQLITE_BUSY) {
+					sqlite3_reset(stmt.get());
+					keys.clear();
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					continue;
+				}
+				if (err == SQLITE_DONE) return true;
+				print_error("sqlite3_step return code " + std::to_string(err), __LINE__);
+				return false;
 			}
 			return false;
 		}
 
-		inline bool write_ticks(const std::map<uint64_t, std::vector<uint8_t>> &data) noexcept {
+		/** \brief Read a candle block without copying it
+		 * \param t		Start of the day
+		 * \param on_data	Callback with the blob. The blob is owned by sqlite and is valid only inside the callback
+		 * \return Will return true if the block was found
+		 */
+		inline bool read_candles(const uint64_t t, const BlobCallback &on_data) noexcept {
+			std::lock_guard<std::mutex> lock(read_mutex);
+			return get_price_data(stmt_get_candle, t, on_data);
+		}
+
+		/** \brief Read a tick block without copying it
+		 * \param t		Start of the hour
+		 * \param on_data	Callback with the blob. The blob is owned by sqlite and is valid only inside the callback
+		 * \return Will return true if the block was found
+		 */
+		inline bool read_ticks(const uint64_t t, const BlobCallback &on_data) noexcept {
+			std::lock_guard<std::mutex> lock(read_mutex);
+			return get_price_data(stmt_get_tick, t, on_data);
+		}
+
+		/** \brief Read all candle blocks in the range of days with a single query
+		 * \param t_start	Start of the first day (inclusive)
+		 * \param t_stop	Start of the last day (inclusive)
+		 * \param on_data	Callback for each (key, blob) pair, in ascending key order.
+		 * The blob is owned by sqlite and is valid only inside the callback
+		 * \return Will return true if the query was successful
+		 */
+		inline bool read_candles_range(
+				const uint64_t t_start,
+				const uint64_t t_stop,
+				const BlobCallback &on_data) noexcept {
+			if (t_start > t_stop) return true;
+			std::lock_guard<std::mutex> lock(read_mutex);
+			return get_price_data_range(stmt_get_candle_range, t_start, t_stop, on_data);
+		}
+
+		/** \brief Read all tick blocks in the range of hours with a single query
+		 * \param t_start	Start of the first hour (inclusive)
+		 * \param t_stop	Start of the last hour (inclusive)
+		 * \param on_data	Callback for each (key, blob) pair, in ascending key order.
+		 * The blob is owned by sqlite and is valid only inside the callback
+		 * \return Will return true if the query was successful
+		 */
+		inline bool read_ticks_range(
+				const uint64_t t_start,
+				const uint64_t t_stop,
+				const BlobCallback &on_data) noexcept {
+			if (t_start > t_stop) return true;
+			std::lock_guard<std::mutex> lock(read_mutex);
+			return get_price_data_range(stmt_get_tick_range, t_start, t_stop, on_data);
+		}
+
+		/** \brief Write candle blocks and their summaries in a single transaction
+		 * \param data		Blocks by key
+		 * \param summary	Block summaries by key. The summary of a block written without one is removed
+		 * \param level		Compression level of the blocks. If greater than zero, blocks are tagged with it
+		 * so that the background compaction can recompress them later
+		 * \return Will return true if the write was successful
+		 */
+		inline bool write_candles(
+				const std::map<uint64_t, std::vector<uint8_t>> &data,
+				const std::map<uint64_t, CandleBlockSummary> &summary,
+				const int level = 0) noexcept {
 			{
 				std::lock_guard<std::mutex> lock(method_mutex);
 				if (!check_init_db()) return false;
@@ -521,14 +1194,31 @@ namespace trading_db {
 			while (!is_shutdown) {
 				{
 					std::lock_guard<std::mutex> lock(method_mutex);
-					if (replace_price_data_map(data, sqlite_transaction, stmt_replace_tick)) return true;
+					last_write_ms = get_steady_ms();
+					bool is_complete = true;
+					if (replace_price_data_map(data, sqlite_transaction, stmt_replace_candle,
+						is_readonly ? nullptr : &stmt_replace_candle_level, level,
+						get_summary_writer(summary, stmt_delete_candle_summary, is_complete))) {
+						if (!is_complete) is_candle_summary = false;
+						return true;
+					}
 				}
 				std::this_thread::sleep_for(std::chrono::milliseconds(1));
 			}
 			return false;
 		}
 
-		inline bool write_candles(const std::vector<uint8_t> &data, const uint64_t t) noexcept {
+		/** \brief Write tick blocks and their summaries in a single transaction
+		 * \param data		Blocks by key
+		 * \param summary	Block summaries by key. The summary of a block written without one is removed
+		 * \param level		Compression level of the blocks. If greater than zero, blocks are tagged with it
+		 * so that the background compaction can recompress them later
+		 * \return Will return true if the write was successful
+		 */
+		inline bool write_ticks(
+				const std::map<uint64_t, std::vector<uint8_t>> &data,
+				const std::map<uint64_t, TickBlockSummary> &summary,
+				const int level = 0) noexcept {
 			{
 				std::lock_guard<std::mutex> lock(method_mutex);
 				if (!check_init_db()) return false;
@@ -536,52 +1226,354 @@ namespace trading_db {
 			while (!is_shutdown) {
 				{
 					std::lock_guard<std::mutex> lock(method_mutex);
-					if (replace_price_data(t, data, sqlite_transaction, stmt_replace_candle)) return true;
+					last_write_ms = get_steady_ms();
+					bool is_complete = true;
+					if (replace_price_data_map(data, sqlite_transaction, stmt_replace_tick,
+						is_readonly ? nullptr : &stmt_replace_tick_level, level,
+						get_summary_writer(summary, stmt_delete_tick_summary, is_complete))) {
+						if (!is_complete) is_tick_summary = false;
+						return true;
+					}
 				}
 				std::this_thread::sleep_for(std::chrono::milliseconds(1));
 			}
 			return false;
 		}
 
+		/** \brief Write candle blocks in a single transaction
+		 * \param data		Blocks by key
+		 * \param level		Compression level of the blocks. If greater than zero, blocks are tagged with it
+		 * so that the background compaction can recompress them later
+		 * \return Will return true if the write was successful
+		 */
+		inline bool write_candles(const std::map<uint64_t, std::vector<uint8_t>> &data, const int level = 0) noexcept {
+			return write_candles(data, std::map<uint64_t, CandleBlockSummary>(), level);
+		}
+
+		/** \brief Write tick blocks in a single transaction
+		 * \param data		Blocks by key
+		 * \param level		Compression level of the blocks. If greater than zero, blocks are tagged with it
+		 * so that the background compaction can recompress them later
+		 * \return Will return true if the write was successful
+		 */
+		inline bool write_ticks(const std::map<uint64_t, std::vector<uint8_t>> &data, const int level = 0) noexcept {
+			return write_ticks(data, std::map<uint64_t, TickBlockSummary>(), level);
+		}
+
+		inline bool write_candles(const std::vector<uint8_t> &data, const uint64_t t) noexcept {
+			std::map<uint64_t, std::vector<uint8_t>> data_map;
+			data_map[t] = data;
+			return write_candles(data_map);
+		}
+
 		inline bool write_ticks(const std::vector<uint8_t> &data, const uint64_t t) noexcept {
+			std::map<uint64_t, std::vector<uint8_t>> data_map;
+			data_map[t] = data;
+			return write_ticks(data_map);
+		}
+
+		inline bool remove_candles(const uint64_t t) noexcept {
+			std::lock_guard<std::mutex> lock(method_mutex);
+			if (!check_init_db() || is_readonly) return false;
+			const std::string where = "' WHERE key == " + std::to_string(t);
+			return execute_in_transaction({
+				"DELETE FROM '" + config.candle_level_table + where,
+				"DELETE FROM '" + config.candle_index_table + where,
+				"DELETE FROM '" + config.candle_source_table + where,
+				"DELETE FROM '" + config.candle_table + where});
+		}
+
+		inline bool remove_ticks(const uint64_t t) noexcept {
+			std::lock_guard<std::mutex> lock(method_mutex);
+			if (!check_init_db() || is_readonly) return false;
+			const std::string where = "' WHERE key == " + std::to_string(t);
+			return execute_in_transaction({
+				"DELETE FROM '" + config.tick_level_table + where,
+				"DELETE FROM '" + config.tick_index_table + where,
+				"DELETE FROM '" + config.tick_table + where});
+		}
+
+		/** \brief Удалить все данные
+		 */
+		inline bool remove_all() noexcept {
+			std::lock_guard<std::mutex> lock(method_mutex);
+			if (!check_init_db() || is_readonly) return false;
+			const bool is_removed = execute_in_transaction({
+				"DELETE FROM '" + config.candle_level_table + "'",
+				"DELETE FROM '" + config.tick_level_table + "'",
+				"DELETE FROM '" + config.candle_index_table + "'",
+				"DELETE FROM '" + config.tick_index_table + "'",
+				"DELETE FROM '" + config.candle_source_table + "'",
+				"DELETE FROM '" + config.candle_table + "'",
+				"DELETE FROM '" + config.tick_table + "'",
+				"DELETE FROM '" + config.meta_data_table + "'"});
+			update_summary_state();
+			return is_removed;
+		}
+
+		/** \brief Write block summaries in a single transaction (e.g. to rebuild the index of an existing file)
+		 * \param summary	Tick block summaries
+		 * \return Will return true if the write was successful
+		 */
+		inline bool write_tick_summary(const std::vector<TickBlockSummary> &summary) noexcept {
+			std::lock_guard<std::mutex> lock(method_mutex);
+			if (!check_init_db() || is_readonly) return false;
+			if (!sqlite_transaction.begin_transaction()) return false;
+			for (const auto &item : summary) {
+				if (!replace_summary(item)) {
+					sqlite_transaction.rollback();
+					return false;
+				}
+			}
+			if (!sqlite_transaction.commit()) return false;
+			update_summary_state();
+			return true;
+		}
+
+		/** \brief Write block summaries in a single transaction (e.g. to rebuild the index of an existing file)
+		 * \param summary	Candle block summaries
+		 * \return Will return true if the write was successful
+		 */
+		inline bool write_candle_summary(const std::vector<CandleBlockSummary> &summary) noexcept {
+			std::lock_guard<std::mutex> lock(method_mutex);
+			if (!check_init_db() || is_readonly) return false;
+			if (!sqlite_transaction.begin_transaction()) return false;
+			for (const auto &item : summary) {
+				if (!replace_summary(item)) {
+					sqlite_transaction.rollback();
+					return false;
+				}
+			}
+			if (!sqlite_transaction.commit()) return false;
+			update_summary_state();
+			return true;
+		}
+
+		/** \brief Write fingerprints of the ticks the candle blocks were built from
+		 * \param sources	Fingerprints by start of day
+		 * \return Will return true if the write was successful
+		 */
+		inline bool write_candle_sources(const std::map<uint64_t, uint64_t> &sources) noexcept {
+			std::lock_guard<std::mutex> lock(method_mutex);
+			if (!check_init_db() || is_readonly) return false;
+			if (sources.empty()) return true;
+			if (!sqlite_transaction.begin_transaction()) return false;
+			if (!replace_candle_sources(sources)) {
+				sqlite_transaction.rollback();
+				return false;
+			}
+			return sqlite_transaction.commit();
+		}
+
+		/** \brief Write candle days built from ticks in a single transaction
+		 * \param data		Blocks by key
+		 * \param summary	Block summaries by key
+		 * \param level		Compression level of the blocks (see write_candles)
+		 * \param removed	Days to remove together with their summaries, levels and tick fingerprints
+		 * \param sources	Fingerprints of the ticks the written days were built from, by start of day
+		 * \return Will return true if the write was successful
+		 */
+		inline bool write_candle_days(
+				const std::map<uint64_t, std::vector<uint8_t>> &data,
+				const std::map<uint64_t, CandleBlockSummary> &summary,
+				const int level,
+				const std::vector<uint64_t> &removed,
+				const std::map<uint64_t, uint64_t> &sources) noexcept {
 			{
 				std::lock_guard<std::mutex> lock(method_mutex);
-				if (!check_init_db()) return false;
+				if (!check_init_db() || is_readonly) return false;
 			}
 			while (!is_shutdown) {
 				{
 					std::lock_guard<std::mutex> lock(method_mutex);
-					if (replace_price_data(t, data, sqlite_transaction, stmt_replace_tick)) return true;
+					last_write_ms = get_steady_ms();
+					bool is_complete = true;
+					if (replace_price_data_map(data, sqlite_transaction, stmt_replace_candle,
+						&stmt_replace_candle_level, level,
+						get_summary_writer(summary, stmt_delete_candle_summary, is_complete),
+						[&]() -> bool {
+							for (const uint64_t key : removed) {
+								if (!delete_row(key, stmt_delete_candle) ||
+									!delete_row(key, stmt_delete_candle_level) ||
+									!delete_row(key, stmt_delete_candle_summary) ||
+									!delete_row(key, stmt_delete_candle_source)) return false;
+							}
+							return replace_candle_sources(sources);
+						})) {
+						if (!is_complete) is_candle_summary = false;
+						return true;
+					}
 				}
 				std::this_thread::sleep_for(std::chrono::milliseconds(1));
 			}
 			return false;
 		}
 
-		inline bool remove_candles(const uint64_t t) noexcept {
-			std::lock_guard<std::mutex> lock(method_mutex);
-			if (!check_init_db()) return false;
-			return utils::prepare(sqlite_db, "DELETE FROM '" + config.candle_table + "' WHERE key == " + std::to_string(t));
+		/** \brief Read fingerprints of the ticks the candle blocks were built from
+		 * \param t_start	Start of the first day (inclusive)
+		 * \param t_stop	Start of the last day (inclusive)
+		 * \param sources	Fingerprints by start of day
+		 * \return Will return true if the query was successful
+		 */
+		inline bool read_candle_sources(
+				const uint64_t t_start,
+				const uint64_t t_stop,
+				std::map<uint64_t, uint64_t> &sources) noexcept {
+			std::lock_guard<std::mutex> lock(read_mutex);
+			sources.clear();
+			utils::SqliteStmt &stmt = stmt_get_candle_source_range;
+			if (!stmt.get()) return false;
+			if (t_start > t_stop) return true;
+			int err = 0;
+			while (true) {
+				sources.clear();
+				sqlite3_reset(stmt.get());
+				if (sqlite3_bind_int64(stmt.get(), 1, t_start) != SQLITE_OK ||
+					sqlite3_bind_int64(stmt.get(), 2, t_stop) != SQLITE_OK) {
+					return false;
+				}
+				while ((err = sqlite3_step(stmt.get())) == SQLITE_ROW) {
+					sources[(uint64_t)sqlite3_column_int64(stmt.get(), 0)] =
+						(uint64_t)sqlite3_column_int64(stmt.get(), 1);
+				}
+				sqlite3_reset(stmt.get());
+				if (err == SQLITE_BUSY) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					continue;
+				}
+				sqlite3_clear_bindings(stmt.get());
+				if (err == SQLITE_DONE) return true;
+				print_error("sqlite3_step return code " + std::to_string(err), __LINE__);
+				return false;
+			}
+			return false;
 		}
 
-		inline bool remove_ticks(const uint64_t t) noexcept {
-			std::lock_guard<std::mutex> lock(method_mutex);
-			if (!check_init_db()) return false;
-			return utils::prepare(sqlite_db, "DELETE FROM '" + config.tick_table + "' WHERE key == " + std::to_string(t));
+		/** \brief Check if every tick block has a summary
+		 */
+		inline bool has_tick_summary() const noexcept {
+			return is_tick_summary;
 		}
 
-		/** \brief Удалить все данные
+		/** \brief Check if every candle block has a summary
 		 */
-		inline bool remove_all() noexcept {
-			std::lock_guard<std::mutex> lock(method_mutex);
-			if (!check_init_db()) return false;
-			return
-				utils::prepare(sqlite_db, "DELETE FROM '" + config.candle_table + "'") &&
-				utils::prepare(sqlite_db, "DELETE FROM '" + config.tick_table + "'") &&
-				utils::prepare(sqlite_db, "DELETE FROM '" + config.meta_data_table + "'");
+		inline bool has_candle_summary() const noexcept {
+			return is_candle_summary;
+		}
+
+		/** \brief Read tick block summaries in the range of hours
+		 * \param t_start	Start of the first hour (inclusive)
+		 * \param t_stop	Start of the last hour (inclusive)
+		 * \param summary	Summaries in ascending key order
+		 * \return Will return true if the query was successful
+		 */
+		inline bool read_tick_summary(
+				const uint64_t t_start,
+				const uint64_t t_stop,
+				std::vector<TickBlockSummary> &summary) noexcept {
+			std::lock_guard<std::mutex> lock(read_mutex);
+			summary.clear();
+			if (!stmt_get_tick_summary_range.get()) return false;
+			if (t_start > t_stop) return true;
+			sqlite3_reset(stmt_get_tick_summary_range.get());
+			if (sqlite3_bind_int64(stmt_get_tick_summary_range.get(), 1, t_start) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt_get_tick_summary_range.get(), 2, t_stop) != SQLITE_OK) {
+				return false;
+			}
+			return get_summary_rows(stmt_get_tick_summary_range, summary);
+		}
+
+		/** \brief Read candle block summaries in the range of days
+		 * \param t_start	Start of the first day (inclusive)
+		 * \param t_stop	Start of the last day (inclusive)
+		 * \param summary	Summaries in ascending key order
+		 * \return Will return true if the query was successful
+		 */
+		inline bool read_candle_summary(
+				const uint64_t t_start,
+				const uint64_t t_stop,
+				std::vector<CandleBlockSummary> &summary) noexcept {
+			std::lock_guard<std::mutex> lock(read_mutex);
+			summary.clear();
+			if (!stmt_get_candle_summary_range.get()) return false;
+			if (t_start > t_stop) return true;
+			sqlite3_reset(stmt_get_candle_summary_range.get());
+			if (sqlite3_bind_int64(stmt_get_candle_summary_range.get(), 1, t_start) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt_get_candle_summary_range.get(), 2, t_stop) != SQLITE_OK) {
+				return false;
+			}
+			return get_summary_rows(stmt_get_candle_summary_range, summary);
+		}
+
+		/** \brief Find the first tick block that has a tick after t_ms
+		 * \param t_ms		Time in milliseconds
+		 * \param t_stop	Start of the last hour to search (inclusive)
+		 * \param summary	Summary of the found block (empty if there is no such block)
+		 * \return Will return false if the query failed or the summaries are incomplete
+		 */
+		inline bool find_next_tick_summary(
+				const uint64_t t_ms,
+				const uint64_t t_stop,
+				TickBlockSummary &summary) noexcept {
+			if (!is_tick_summary) return false;
+			std::lock_guard<std::mutex> lock(read_mutex);
+			summary = TickBlockSummary();
+			utils::SqliteStmt &stmt = stmt_get_next_tick_summary;
+			if (!stmt.get()) return false;
+			sqlite3_reset(stmt.get());
+			if (sqlite3_bind_int64(stmt.get(), 1, ztime::start_of_hour(t_ms / ztime::MS_PER_SEC)) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 2, t_stop) != SQLITE_OK ||
+				sqlite3_bind_int64(stmt.get(), 3, t_ms) != SQLITE_OK) {
+				return false;
+			}
+			std::vector<TickBlockSummary> rows;
+			if (!get_summary_rows(stmt, rows)) return false;
+			if (!rows.empty()) summary = rows.front();
+			return true;
+		}
+
+		/** \brief Start background recompression of blocks written below the target level
+		 *
+		 * The task works only while the database is idle (no writes for compaction_idle_ms)
+		 * and pauses for compaction_delay_ms after each block. A block that was rewritten
+		 * while it was being recompressed is skipped.
+		 * \param target_level	Archival compression level
+		 * \param on_recompress	Recompression function. It is called from the background thread
+		 * \param on_progress	Progress callback (optional). It is called from the background thread
+		 * \return Will return true if the task was started
+		 */
+		inline bool start_compaction(
+				const int target_level,
+				const RecompressCallback &on_recompress,
+				const ProgressCallback &on_progress = nullptr) noexcept {
+			{
+				std::lock_guard<std::mutex> lock(method_mutex);
+				if (!check_init_db() || is_readonly || !on_recompress) return false;
+			}
+			if (is_compaction.exchange(true)) return false;
+			compaction_tasks.wait();
+			compaction_tasks.create_task([this, target_level, on_recompress, on_progress]() {
+				compaction_loop(target_level, on_recompress, on_progress);
+				is_compaction = false;
+			});
+			return true;
+		}
+
+		/** \brief Stop background recompression and wait for the task to finish
+		 */
+		inline void stop_compaction() noexcept {
+			is_compaction = false;
+			compaction_tasks.wait();
+		}
+
+		/** \brief Check if background recompression is running
+		 */
+		inline bool check_compaction() const noexcept {
+			return is_compaction;
 		}
 
 		inline std::string get_info_str(const METADATA_TYPE type) noexcept {
+			std::lock_guard<std::mutex> lock(read_mutex);
 			MetaData pair;
 			switch (type) {
 			case METADATA_TYPE::SYMBOL_NAME:
@@ -598,6 +1590,7 @@ namespace trading_db {
 		}
 
 		inline int get_info_int(const METADATA_TYPE type) noexcept {
+			std::lock_guard<std::mutex> lock(read_mutex);
 			MetaData pair;
 			switch (type) {
 			case METADATA_TYPE::SYMBOL_DIGITS:
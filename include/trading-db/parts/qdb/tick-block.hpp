@@ -0,0 +1,214 @@
+#pragma once
+#ifndef TRADING_DB_QDB_TICK_BLOCK_HPP_INCLUDED
+#define TRADING_DB_QDB_TICK_BLOCK_HPP_INCLUDED
+
+#include "data-classes.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <map>
+
+namespace trading_db {
+
+	/** \brief Блок тиков (обычно один час) в виде отсортированных массивов t_ms[], bid[], ask[]
+	 *
+	 * Все три массива лежат в одном непрерывном буфере. Поиск по времени выполняется
+	 * бинарным поиском по массиву t_ms.
+	 *
+	 * Копии блока разделяют один буфер (копирование при записи), поэтому один распакованный
+	 * час может одновременно находиться в кэше блоков и в буферах нескольких QDB.
+	 */
+	class QdbTickBlock {
+	public:
+
+		QdbTickBlock() {};
+
+		QdbTickBlock(const QdbTickBlock &other) {
+			*this = other;
+		}
+
+		QdbTickBlock(QdbTickBlock &&other) noexcept {
+			*this = std::move(other);
+		}
+
+		/** \brief Создать блок из std::map
+		 */
+		explicit QdbTickBlock(const std::map<uint64_t, ShortTick> &ticks) {
+			reserve(ticks.size());
+			for (const auto &item : ticks) {
+				push_back(item.first, item.second.bid, item.second.ask);
+			}
+		}
+
+		QdbTickBlock &operator=(const QdbTickBlock &other) {
+			if (this == &other) return *this;
+			m_buffer = other.m_buffer;
+			m_t_ms = other.m_t_ms;
+			m_bid = other.m_bid;
+			m_ask = other.m_ask;
+			m_size = other.m_size;
+			m_capacity = other.m_capacity;
+			return *this;
+		}
+
+		QdbTickBlock &operator=(QdbTickBlock &&other) noexcept {
+			if (this == &other) return *this;
+			m_buffer = std::move(other.m_buffer);
+			m_t_ms = other.m_t_ms;
+			m_bid = other.m_bid;
+			m_ask = other.m_ask;
+			m_size = other.m_size;
+			m_capacity = other.m_capacity;
+			other.m_t_ms = nullptr;
+			other.m_bid = other.m_ask = nullptr;
+			other.m_size = other.m_capacity = 0;
+			return *this;
+		}
+
+		inline size_t size() const noexcept { return m_size; }
+		inline bool empty() const noexcept { return m_size == 0; }
+
+		inline void clear() noexcept {
+			if (is_shared()) release();
+			m_size = 0;
+		}
+
+		/// Количество блоков, разделяющих буфер (0, если буфера нет)
+		inline long use_count() const noexcept { return m_buffer.use_count(); }
+
+		/// Размер выделенной под тики памяти в байтах
+		inline size_t memory_size() const noexcept { return m_capacity * item_size; }
+
+		/** \brief Зарезервировать место под тики
+		 */
+		void reserve(const size_t capacity) {
+			if (capacity <= m_capacity && !is_shared()) return;
+			realloc(std::max(capacity, m_capacity));
+		}
+
+		/** \brief Добавить тик в конец блока
+		 * Если время тика не больше времени последнего тика, тик вставляется на свое место
+		 * (тик с тем же временем заменяется)
+		 */
+		inline void push_back(const uint64_t t_ms, const double bid, const double ask) {
+			if (m_size && t_ms <= m_t_ms[m_size - 1]) {
+				insert(t_ms, bid, ask);
+				return;
+			}
+			if (is_shared()) reserve(m_capacity);
+			if (m_size == m_capacity) reserve(std::max(m_capacity * 2, (size_t)64));
+			m_t_ms[m_size] = t_ms;
+			m_bid[m_size] = bid;
+			m_ask[m_size] = ask;
+			++m_size;
+		}
+
+		/** \brief Добавить в конец блока count тиков для заполнения на месте
+		 * Тики должны быть заполнены по возрастанию времени и быть позже последнего тика блока
+		 * \param count	Количество тиков
+		 * \param t_ms	Указатель на время добавленных тиков
+		 * \param bid	Указатель на цены bid добавленных тиков
+		 * \param ask	Указатель на цены ask добавленных тиков
+		 */
+		inline void append(const size_t count, uint64_t *&t_ms, double *&bid, double *&ask) {
+			if (is_shared() || m_size + count > m_capacity) {
+				reserve(std::max(m_size + count, m_capacity));
+			}
+			t_ms = m_t_ms + m_size;
+			bid = m_bid + m_size;
+			ask = m_ask + m_size;
+			m_size += count;
+		}
+
+		/** \brief Вставить тик с сохранением порядка (тик с тем же временем заменяется)
+		 */
+		void insert(const uint64_t t_ms, const double bid, const double ask) {
+			if (is_shared()) reserve(m_capacity);
+			const size_t index = lower_bound_index(t_ms);
+			if (index < m_size && m_t_ms[index] == t_ms) {
+				m_bid[index] = bid;
+				m_ask[index] = ask;
+				return;
+			}
+			if (m_size == m_capacity) reserve(std::max(m_capacity * 2, (size_t)64));
+			const size_t tail = m_size - index;
+			std::memmove(m_t_ms + index + 1, m_t_ms + index, tail * sizeof(uint64_t));
+			std::memmove(m_bid + index + 1, m_bid + index, tail * sizeof(double));
+			std::memmove(m_ask + index + 1, m_ask + index, tail * sizeof(double));
+			m_t_ms[index] = t_ms;
+			m_bid[index] = bid;
+			m_ask[index] = ask;
+			++m_size;
+		}
+
+		inline uint64_t t_ms(const size_t index) const noexcept { return m_t_ms[index]; }
+		inline double bid(const size_t index) const noexcept { return m_bid[index]; }
+		inline double ask(const size_t index) const noexcept { return m_ask[index]; }
+
+		inline const uint64_t *t_ms_data() const noexcept { return m_t_ms; }
+		inline const double *bid_data() const noexcept { return m_bid; }
+		inline const double *ask_data() const noexcept { return m_ask; }
+
+		/** \brief Получить тик по индексу
+		 */
+		inline Tick get_tick(const size_t index) const noexcept {
+			return Tick(m_bid[index], m_ask[index], m_t_ms[index]);
+		}
+
+		/// Индекс первого тика со временем не меньше t_ms (size(), если такого нет)
+		inline size_t lower_bound_index(const uint64_t t_ms) const noexcept {
+			return std::lower_bound(m_t_ms, m_t_ms + m_size, t_ms) - m_t_ms;
+		}
+
+		/// Индекс первого тика со временем больше t_ms (size(), если такого нет)
+		inline size_t upper_bound_index(const uint64_t t_ms) const noexcept {
+			return std::upper_bound(m_t_ms, m_t_ms + m_size, t_ms) - m_t_ms;
+		}
+
+	private:
+		static const size_t item_size = sizeof(uint64_t) + 2 * sizeof(double);
+
+		std::shared_ptr<uint8_t>	m_buffer;
+		uint64_t					*m_t_ms		= nullptr;
+		double						*m_bid		= nullptr;
+		double						*m_ask		= nullptr;
+		size_t						m_size		= 0;
+		size_t						m_capacity	= 0;
+
+		inline bool is_shared() const noexcept { return m_buffer.use_count() > 1; }
+
+		inline void release() noexcept {
+			m_buffer.reset();
+			m_t_ms = nullptr;
+			m_bid = m_ask = nullptr;
+			m_size = m_capacity = 0;
+		}
+
+		// выделяем новый буфер и копируем в него тики
+		void realloc(const size_t capacity) {
+			std::shared_ptr<uint8_t> buffer(new uint8_t[capacity * item_size], std::default_delete<uint8_t[]>());
+			uint64_t *t_ms = reinterpret_cast<uint64_t*>(buffer.get());
+			double *bid = reinterpret_cast<double*>(buffer.get() + capacity * sizeof(uint64_t));
+			double *ask = bid + capacity;
+			copy_arrays(*this, t_ms, bid, ask);
+			m_buffer = std::move(buffer);
+			m_t_ms = t_ms;
+			m_bid = bid;
+			m_ask = ask;
+			m_capacity = capacity;
+		}
+
+		static void copy_arrays(
+				const QdbTickBlock &src,
+				uint64_t *t_ms,
+				double *bid,
+				double *ask) noexcept {
+			if (!src.m_size) return;
+			std::memcpy(t_ms, src.m_t_ms, src.m_size * sizeof(uint64_t));
+			std::memcpy(bid, src.m_bid, src.m_size * sizeof(double));
+			std::memcpy(ask, src.m_ask, src.m_size * sizeof(double));
+		}
+	}; // QdbTickBlock
+}; // trading_db
+
+#endif // TRADING_DB_QDB_TICK_BLOCK_HPP_INCLUDED
@@ -0,0 +1,119 @@
+#pragma once
+#ifndef TRADING_DB_QDB_TICK_BUCKETING_HPP_INCLUDED
+#define TRADING_DB_QDB_TICK_BUCKETING_HPP_INCLUDED
+
+#include "data-classes.hpp"
+#include <ztime.hpp>
+#include <algorithm>
+
+namespace trading_db {
+
+	/** \brief Формирование баров произвольного периода (в секундах) из тиков
+	 *
+	 * Тики подаются отсортированными массивами (например, блоками QdbTickBlock).
+	 * Для каждого отрезка времени за один проход по тикам вычисляются бары по bid, ask и средней цене.
+	 * Отрезки выровнены по периоду от начала эпохи, бары строятся только для отрезков с тиками.
+	 * Объем бара - количество тиков.
+	 */
+	class QdbTickBucketing {
+	public:
+
+		/** \brief Инициализировать формирование баров
+		 * \param period	Период баров в секундах
+		 * \param bid		Бары по цене bid (nullptr - не нужны)
+		 * \param ask		Бары по цене ask (nullptr - не нужны)
+		 * \param mid		Бары по средней цене (nullptr - не нужны)
+		 */
+		QdbTickBucketing(
+				const uint64_t period,
+				CandleColumns *bid,
+				CandleColumns *ask,
+				CandleColumns *mid) :
+			period_ms(std::max(period, (uint64_t)1) * ztime::MS_PER_SEC),
+			out_bid(bid), out_ask(ask), out_mid(mid) {
+		};
+
+		/** \brief Добавить тики
+		 * Тики должны идти по возрастанию времени, в том числе между вызовами
+		 * \param t_ms	Время тиков
+		 * \param bid	Цены bid
+		 * \param ask	Цены ask
+		 * \param count	Количество тиков
+		 */
+		void add(
+				const uint64_t *t_ms,
+				const double *bid,
+				const double *ask,
+				const size_t count) noexcept {
+			size_t i = 0;
+			while (i < count) {
+				const uint64_t bucket_ms = t_ms[i] - t_ms[i] % period_ms;
+				const size_t end = std::lower_bound(t_ms + i, t_ms + count, bucket_ms + period_ms) - t_ms;
+
+				// экстремумы трех цен за один проход по отрезку
+				double bid_high = bid[i], bid_low = bid[i];
+				double ask_high = ask[i], ask_low = ask[i];
+				double mid_high = (bid[i] + ask[i]) / 2.0, mid_low = mid_high;
+				for (size_t k = i + 1; k < end; ++k) {
+					const double b = bid[k];
+					const double a = ask[k];
+					const double m = (b + a) / 2.0;
+					bid_high = b > bid_high ? b : bid_high;
+					bid_low = b < bid_low ? b : bid_low;
+					ask_high = a > ask_high ? a : ask_high;
+					ask_low = a < ask_low ? a : ask_low;
+					mid_high = m > mid_high ? m : mid_high;
+					mid_low = m < mid_low ? m : mid_low;
+				}
+
+				const uint64_t timestamp = bucket_ms / ztime::MS_PER_SEC;
+				const double volume = (double)(end - i);
+				const size_t last = end - 1;
+				if (out_bid) {
+					add_bar(*out_bid, timestamp, bid[i], bid_high, bid_low, bid[last], volume);
+				}
+				if (out_ask) {
+					add_bar(*out_ask, timestamp, ask[i], ask_high, ask_low, ask[last], volume);
+				}
+				if (out_mid) {
+					add_bar(*out_mid, timestamp,
+						(bid[i] + ask[i]) / 2.0, mid_high, mid_low,
+						(bid[last] + ask[last]) / 2.0, volume);
+				}
+				i = end;
+			}
+		}
+
+	private:
+		uint64_t		period_ms	= 0;
+		CandleColumns	*out_bid	= nullptr;
+		CandleColumns	*out_ask	= nullptr;
+		CandleColumns	*out_mid	= nullptr;
+
+		// добавляем бар или продолжаем последний бар, если отрезок начался в предыдущем блоке тиков
+		static inline void add_bar(
+				CandleColumns &bars,
+				const uint64_t timestamp,
+				const double open,
+				const double high,
+				const double low,
+				const double close,
+				const double volume) noexcept {
+			if (!bars.empty() && bars.timestamp.back() == timestamp) {
+				bars.high.back() = std::max(bars.high.back(), high);
+				bars.low.back() = std::min(bars.low.back(), low);
+				bars.close.back() = close;
+				bars.volume.back() += volume;
+				return;
+			}
+			bars.timestamp.push_back(timestamp);
+			bars.open.push_back(open);
+			bars.high.push_back(high);
+			bars.low.push_back(low);
+			bars.close.push_back(close);
+			bars.volume.push_back(volume);
+		}
+	}; // QdbTickBucketing
+}; // trading_db
+
+#endif // TRADING_DB_QDB_TICK_BUCKETING_HPP_INCLUDED
@@ -0,0 +1,179 @@
+#pragma once
+#ifndef TRADING_DB_QDB_TICK_CANDLE_AGGREGATOR_HPP_INCLUDED
+#define TRADING_DB_QDB_TICK_CANDLE_AGGREGATOR_HPP_INCLUDED
+
+#include "enums.hpp"
+#include "data-classes.hpp"
+#include "tick-block.hpp"
+#include <ztime.hpp>
+#include <array>
+
+namespace trading_db {
+
+	/** \brief Инкрементальное формирование баров из тиков (QDB_CANDLE_MODE::SRC_TICK)
+	 *
+	 * Для каждого таймфрейма хранится формирующийся бар и время, до которого учтены тики.
+	 * При запросе того же бара на более позднее время в бар добавляются только новые тики.
+	 * Бар строится заново при переходе к другому бару или при запросе на более раннее время.
+	 *
+	 * Бар открывается ценой последнего тика не позже начала бара, далее учитываются тики до времени запроса включительно.
+	 */
+	class QdbTickCandleAggregator {
+	public:
+
+		QdbTickCandleAggregator() {};
+
+		/** \brief Получить формирующийся бар
+		 * \param candle	Бар
+		 * \param t			Время запроса (секунды)
+		 * \param p			Таймфрейм
+		 * \param mode		Цена тика, по которой строится бар
+		 * \param deadtime	Максимальное время отсутствия тиков до времени запроса (0 - не проверять)
+		 * \param lookback	Глубина поиска тика до начала бара (секунды)
+		 * \param get_hour	Функция получения часа тиков: bool(uint64_t hour, QdbTickBlock &ticks)
+		 * \return Вернет false, если бар не сформирован
+		 */
+		template<class F>
+		bool get_candle(
+				Candle &candle,
+				const uint64_t t,
+				const QDB_TIMEFRAMES p,
+				const QDB_PRICE_MODE mode,
+				const uint64_t deadtime,
+				const uint64_t lookback,
+				F get_hour) noexcept {
+			const uint64_t period = static_cast<uint64_t>(p) * ztime::SEC_PER_MIN;
+			const uint64_t bar_start = t - t % period;
+			const uint64_t start_ms = bar_start * ztime::MS_PER_SEC;
+			const uint64_t stop_ms = t * ztime::MS_PER_SEC;
+
+			State &state = states[get_level(p)];
+			if (!state.is_init ||
+				state.bar_start != bar_start ||
+				state.mode != mode ||
+				stop_ms < state.stop_ms) {
+				// произвольный переход, строим бар заново
+				state = State();
+				state.is_init = true;
+				state.bar_start = bar_start;
+				state.mode = mode;
+				state.stop_ms = start_ms;
+				state.candle.timestamp = bar_start;
+				if (!add_last_tick(state, start_ms, lookback, get_hour)) {
+					state.is_init = false;
+					return false;
+				}
+			}
+			if (stop_ms > state.stop_ms) {
+				if (!add_ticks(state, state.stop_ms, stop_ms, get_hour)) {
+					state.is_init = false;
+					return false;
+				}
+				state.stop_ms = stop_ms;
+			}
+
+			if (state.candle.empty()) return false;
+			if (deadtime) {
+				const int64_t dt = ((int64_t)stop_ms - (int64_t)state.last_t_ms) / (int64_t)ztime::MS_PER_SEC;
+				if (dt > (int64_t)deadtime) return false;
+			}
+			candle = state.candle;
+			return true;
+		}
+
+		/** \brief Сбросить формирующиеся бары (после изменения тиков)
+		 */
+		void reset() noexcept {
+			for (auto &state : states) {
+				state = State();
+			}
+		}
+
+	private:
+
+		class State {
+		public:
+			Candle			candle;
+			uint64_t		bar_start	= 0;
+			uint64_t		stop_ms		= 0;	// тики учтены до этого времени включительно
+			uint64_t		last_t_ms	= 0;	// время последнего учтенного тика
+			QDB_PRICE_MODE	mode		= QDB_PRICE_MODE::BID_PRICE;
+			bool			is_init		= false;
+		};
+
+		std::array<State, 7> states;	// M1, M5, M15, M30, H1, H4, D1
+
+		static inline size_t get_level(const QDB_TIMEFRAMES p) noexcept {
+			switch (p) {
+			case QDB_TIMEFRAMES::PERIOD_M1:		return 0;
+			case QDB_TIMEFRAMES::PERIOD_M5:		return 1;
+			case QDB_TIMEFRAMES::PERIOD_M15:	return 2;
+			case QDB_TIMEFRAMES::PERIOD_M30:	return 3;
+			case QDB_TIMEFRAMES::PERIOD_H1:		return 4;
+			case QDB_TIMEFRAMES::PERIOD_H4:		return 5;
+			default:
+				break;
+			};
+			return 6;
+		}
+
+		static inline double get_price(const double bid, const double ask, const QDB_PRICE_MODE mode) noexcept {
+			switch (mode) {
+			case QDB_PRICE_MODE::BID_PRICE:
+				return bid;
+			case QDB_PRICE_MODE::ASK_PRICE:
+				return ask;
+			case QDB_PRICE_MODE::AVG_PRICE:
+				return ((bid + ask) / 2.0);
+			};
+			return bid;
+		}
+
+		static inline void add_tick(State &state, const uint64_t t_ms, const double bid, const double ask) noexcept {
+			const double price = get_price(bid, ask, state.mode);
+			Candle &candle = state.candle;
+			if (!candle.open) {
+				candle.open = candle.high = candle.low = price;
+			}
+			if (price > candle.high) candle.high = price;
+			if (price < candle.low) candle.low = price;
+			candle.close = price;
+			state.last_t_ms = t_ms;
+		}
+
+		// добавляем последний тик не позже t_ms (цена на начало бара)
+		template<class F>
+		static bool add_last_tick(State &state, const uint64_t t_ms, const uint64_t lookback, F &get_hour) noexcept {
+			const uint64_t t = t_ms / ztime::MS_PER_SEC;
+			const uint64_t first_hour = t <= lookback ? 0 : ztime::start_of_hour(t - lookback);
+			QdbTickBlock block;
+			for (uint64_t hour = ztime::start_of_hour(t);; hour -= ztime::SEC_PER_HOUR) {
+				if (!get_hour(hour, block)) return false;
+				const size_t index = block.upper_bound_index(t_ms);
+				if (index) {
+					add_tick(state, block.t_ms(index - 1), block.bid(index - 1), block.ask(index - 1));
+					return true;
+				}
+				if (hour <= first_hour) break;
+			}
+			return true;
+		}
+
+		// добавляем тики в интервале (t_ms_start, t_ms_stop]
+		template<class F>
+		static bool add_ticks(State &state, const uint64_t t_ms_start, const uint64_t t_ms_stop, F &get_hour) noexcept {
+			const uint64_t stop_hour = ztime::start_of_hour_sec(t_ms_stop);
+			QdbTickBlock block;
+			for (uint64_t hour = ztime::start_of_hour_sec(t_ms_start); hour <= stop_hour; hour += ztime::SEC_PER_HOUR) {
+				if (!get_hour(hour, block)) return false;
+				const size_t end = block.upper_bound_index(t_ms_stop);
+				for (size_t i = block.upper_bound_index(t_ms_start); i < end; ++i) {
+					add_tick(state, block.t_ms(i), block.bid(i), block.ask(i));
+				}
+			}
+			return true;
+		}
+	}; // QdbTickCandleAggregator
+}; // trading_db
+
+#endif // TRADING_DB_QDB_TICK_CANDLE_AGGREGATOR_HPP_INCLUDED
@@ -0,0 +1,241 @@
+#pragma once
+#ifndef TRADING_DB_QDB_WRITER_PIPELINE_HPP_INCLUDED
+#define TRADING_DB_QDB_WRITER_PIPELINE_HPP_INCLUDED
+
+#include "../../utils/async-tasks.hpp"
+#include "data-classes.hpp"
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <map>
+#include <vector>
+
+namespace trading_db {
+
+	/** \brief Конвейер записи блоков цен
+	 *
+	 * Производитель добавляет задачи сжатия блоков, пул рабочих потоков выполняет их параллельно,
+	 * а единственный поток фиксации собирает готовые блоки в пакеты и передает их на запись
+	 * (одна транзакция на пакет). Если один и тот же ключ был добавлен несколько раз,
+	 * в БД останется результат последней добавленной задачи.
+	 */
+	class QdbWriterPipeline {
+	public:
+
+		/** \brief Сжатый блок и сводка по нему
+		 */
+		class Block {
+		public:
+			std::vector<uint8_t>	data;
+			TickBlockSummary		tick_summary;
+			CandleBlockSummary		candle_summary;
+		};
+
+		/// Задача сжатия блока (индекс рабочего потока, сжатый блок)
+		using Job = std::function<bool(const size_t worker, Block &dst)>;
+
+		/// Запись пакета блоков (флаг тиков, блоки по ключам)
+		using CommitCallback = std::function<bool(
+			const bool is_tick,
+			std::map<uint64_t, Block> &blocks)>;
+
+		class Config {
+		public:
+			size_t threads		= 1;	/**< Количество рабочих потоков сжатия */
+			size_t batch_size	= 256;	/**< Максимальное количество блоков в одной транзакции */
+			size_t queue_size	= 0;	/**< Максимальное количество задач в очереди (0 - четыре задачи на поток) */
+		} config;
+
+	private:
+
+		class Task {
+		public:
+			uint64_t	seq		= 0;
+			uint64_t	key		= 0;
+			bool		is_tick = false;
+			Job			job;
+		};
+
+		class Result {
+		public:
+			uint64_t				seq		= 0;
+			uint64_t				key		= 0;
+			bool					is_tick = false;
+			Block					block;
+		};
+
+		std::mutex				task_mutex;
+		std::condition_variable	task_cv;
+		std::condition_variable	space_cv;
+		std::deque<Task>		tasks;
+
+		std::mutex				result_mutex;
+		std::condition_variable	result_cv;
+		std::deque<Result>		results;
+
+		size_t					active_workers	= 0;
+		uint64_t				seq_counter		= 0;
+		bool					is_stop			= true;
+		std::atomic<bool>		is_error		= ATOMIC_VAR_INIT(false);
+
+		CommitCallback			on_commit		= nullptr;
+		utils::AsyncTasks		worker_tasks;
+		utils::AsyncTasks		commit_tasks;
+
+		inline size_t get_queue_size() const noexcept {
+			if (config.queue_size) return config.queue_size;
+			return 4 * std::max(config.threads, (size_t)1);
+		}
+
+		void worker_loop(const size_t worker) noexcept {
+			while (!false) {
+				Task task;
+				{
+					std::unique_lock<std::mutex> locker(task_mutex);
+					task_cv.wait(locker, [&](){return !tasks.empty() || is_stop;});
+					if (tasks.empty()) break;
+					task = std::move(tasks.front());
+					tasks.pop_front();
+					++active_workers;
+				}
+				space_cv.notify_one();
+
+				Result result;
+				result.seq = task.seq;
+				result.key = task.key;
+				result.is_tick = task.is_tick;
+				if (!task.job(worker, result.block)) is_error = true;
+				{
+					std::lock_guard<std::mutex> locker(result_mutex);
+					if (!result.block.data.empty()) results.push_back(std::move(result));
+				}
+				result_cv.notify_one();
+				{
+					std::lock_guard<std::mutex> locker(task_mutex);
+					--active_workers;
+				}
+				result_cv.notify_one();
+			}
+		}
+
+		inline bool check_workers_done() noexcept {
+			std::lock_guard<std::mutex> locker(task_mutex);
+			return is_stop && tasks.empty() && active_workers == 0;
+		}
+
+		void commit_loop() noexcept {
+			// последний записанный номер задачи для каждого ключа
+			std::map<std::pair<bool, uint64_t>, uint64_t> last_seq;
+			std::map<uint64_t, Block> batch[2];
+
+			auto flush = [&](const bool is_tick) {
+				auto &blocks = batch[is_tick ? 1 : 0];
+				if (blocks.empty()) return;
+				if (!on_commit(is_tick, blocks)) is_error = true;
+				blocks.clear();
+			};
+
+			while (!false) {
+				std::deque<Result> items;
+				{
+					std::unique_lock<std::mutex> locker(result_mutex);
+					result_cv.wait_for(locker, std::chrono::milliseconds(10), [&](){return !results.empty();});
+					items.swap(results);
+				}
+				if (items.empty()) {
+					if (check_workers_done()) {
+						// повторная проверка: результат мог прийти до завершения рабочих потоков
+						std::lock_guard<std::mutex> locker(result_mutex);
+						if (results.empty()) break;
+					}
+					continue;
+				}
+				for (auto &item : items) {
+					const size_t index = item.is_tick ? 1 : 0;
+					auto &seq = last_seq[std::make_pair(item.is_tick, item.key)];
+					if (item.seq < seq) continue;
+					seq = item.seq;
+					batch[index][item.key] = std::move(item.block);
+					if (batch[index].size() >= config.batch_size) flush(item.is_tick);
+				}
+			}
+			flush(false);
+			flush(true);
+		}
+
+	public:
+
+		QdbWriterPipeline() {};
+
+		~QdbWriterPipeline() {
+			stop();
+		};
+
+		/** \brief Запустить конвейер
+		 * \param callback Функция записи пакета блоков. Вызывается из потока фиксации
+		 */
+		inline void start(const CommitCallback &callback) noexcept {
+			stop();
+			{
+				std::lock_guard<std::mutex> locker(task_mutex);
+				is_stop = false;
+			}
+			is_error = false;
+			on_commit = callback;
+			const size_t threads = std::max(config.threads, (size_t)1);
+			for (size_t n = 0; n < threads; ++n) {
+				worker_tasks.create_task([this, n]() {
+					worker_loop(n);
+				});
+			}
+			commit_tasks.create_task([this]() {
+				commit_loop();
+			});
+		}
+
+		/** \brief Добавить задачу сжатия блока
+		 * Если очередь заполнена, метод ждет, пока рабочие потоки освободят место
+		 * \param is_tick	Флаг блока тиков
+		 * \param key		Ключ блока
+		 * \param job		Задача сжатия. Вызывается из рабочего потока
+		 * \return Вернет false, если конвейер не запущен
+		 */
+		inline bool add(const bool is_tick, const uint64_t key, const Job &job) noexcept {
+			{
+				std::unique_lock<std::mutex> locker(task_mutex);
+				if (is_stop) return false;
+				space_cv.wait(locker, [&](){return tasks.size() < get_queue_size();});
+				Task task;
+				task.seq = ++seq_counter;
+				task.key = key;
+				task.is_tick = is_tick;
+				task.job = job;
+				tasks.push_back(std::move(task));
+			}
+			task_cv.notify_one();
+			return true;
+		}
+
+		/** \brief Дождаться выполнения всех задач и записи всех блоков
+		 * \return Вернет true, если все блоки были сжаты и записаны без ошибок
+		 */
+		inline bool stop() noexcept {
+			{
+				std::lock_guard<std::mutex> locker(task_mutex);
+				if (is_stop) return !is_error;
+				is_stop = true;
+			}
+			task_cv.notify_all();
+			worker_tasks.wait();
+			result_cv.notify_all();
+			commit_tasks.wait();
+			return !is_error;
+		}
+	}; // QdbWriterPipeline
+}; // trading_db
+
+#endif // TRADING_DB_QDB_WRITER_PIPELINE_HPP_INCLUDED
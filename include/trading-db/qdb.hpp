@@ -14,6 +14,12 @@
 #include "parts/qdb/price-buffer.hpp"
 #include "parts/qdb/writer-price-buffer.hpp"
 #include "parts/qdb/storage.hpp"
+#include "parts/qdb/writer-pipeline.hpp"
+#include "parts/qdb/presence-bitmap.hpp"
+#include "parts/qdb/block-cache.hpp"
+#include "parts/qdb/read-pool.hpp"
+#include "parts/qdb/prefetcher.hpp"
+#include "parts/qdb/tick-bucketing.hpp"
 #include "tools/qdb/csv.hpp"
 
 #include "utils/sqlite-func.hpp"
@@ -26,8 +32,12 @@
 #include <mutex>
 #include <atomic>
 #include <future>
+#include <memory>
 #include <vector>
+#include <iterator>
 #include <map>
+#include <limits>
+#include <algorithm>
 #include <set>
 
 namespace trading_db {
@@ -46,18 +56,41 @@ namespace trading_db {
             int         digits  = 0;    /**< The number of decimals */
             bool        use_data_merge = false; /**< Use data merge mode */
 
+            bool        use_tiered_compression  = false;            /**< Write blocks at a fast level and recompress them later (see start_compaction) */
+            int         fast_compress_level     = 3;                /**< Compression level for fast writes */
+            int         compress_level          = ZSTD_maxCLevel(); /**< Archival compression level */
+            uint8_t     tick_format             = QdbCompactDataset::TICK_FORMAT_V2; /**< Format of new tick blocks (TICK_FORMAT_V1 keeps files readable by older versions) */
+            bool        use_block_header        = true;             /**< Write blocks with QdbBlockHeader (false - plain zstd frames readable by older versions) */
+            uint8_t     codec_id                = QdbCodecRegistry::CODEC_ZSTD; /**< Codec of new blocks (see QdbCodecRegistry; CODEC_BITPACK trades size for faster tick decoding) */
+
+            size_t      write_threads       = 0;    /**< Number of compression threads for stop_write (0 - compress on the writer thread) */
+            size_t      write_batch_size    = 256;  /**< Maximum number of blocks per write transaction when write_threads > 0 */
+
+            bool        use_block_cache     = true; /**< Share decoded blocks through the process-wide QdbBlockCache */
+            size_t      prefetch_hours      = 0;    /**< Number of tick hours decoded ahead into the block cache on a background thread during forward reads (0 - disabled) */
+
             std::string title = "qdb: ";
             bool        use_log = false;
         } config;
 
     private:
         QdbPriceBuffer          price_buffer;
-        QdbStorage              storage;
+        std::shared_ptr<QdbStorage> storage = std::make_shared<QdbStorage>();
         QdbDataPreparation      data_preparation;
         QdbWriterPriceBuffer    writer_buffer;
+        std::vector<std::unique_ptr<QdbDataPreparation>> worker_preparation;
+        std::atomic<bool>       is_write_error = ATOMIC_VAR_INIT(false);
+        QdbWriterPipeline       writer_pipeline;
+        std::shared_ptr<QdbPresenceBitmap> tick_presence = std::make_shared<QdbPresenceBitmap>(ztime::SEC_PER_HOUR);
+        std::shared_ptr<QdbPresenceBitmap> candle_presence = std::make_shared<QdbPresenceBitmap>(ztime::SEC_PER_DAY);
+        uint64_t                cache_db_id = 0;
+        QdbPrefetcher           prefetcher;
+        QdbDataPreparation      prefetch_preparation;
 
         std::map<uint64_t, std::vector<uint8_t>> write_ticks_buffer;
         std::map<uint64_t, std::vector<uint8_t>> write_candles_buffer;
+        std::map<uint64_t, TickBlockSummary>     write_ticks_summary;
+        std::map<uint64_t, CandleBlockSummary>   write_candles_summary;
 
         inline void print_error(
 				const std::string message,
@@ -70,14 +103,20 @@ namespace trading_db {
 			}
 		}
 
-		bool read_ticks(const uint64_t t, std::map<uint64_t, ShortTick> &ticks) {
-            std::vector<uint8_t> data;
-            if (!storage.read_ticks(data, t)) {
+		template<class T>
+		bool read_ticks(const uint64_t t, T &ticks) {
+            data_preparation.config.price_scale = config.digits;
+            bool is_error = false;
+            if (!storage->read_ticks(t, [&](
+                    const uint64_t key,
+                    const uint8_t *data,
+                    const size_t size) {
+                is_error = !data_preparation.decompress_ticks(key, data, size, ticks);
+            })) {
                 print_error("error read ticks", __LINE__);
                 return false;
             }
-            data_preparation.config.price_scale = config.digits;
-            if (!data_preparation.decompress_ticks(t, data, ticks)) {
+            if (is_error) {
                 print_error("error decompress ticks", __LINE__);
                 return false;
             }
@@ -85,24 +124,489 @@ namespace trading_db {
 		}
 
 		bool read_candles(const uint64_t t, std::array<trading_db::Candle, ztime::MIN_PER_DAY> &candles) {
-            std::vector<uint8_t> data;
-            if (!storage.read_candles(data, t)) {
+            data_preparation.config.price_scale = config.digits;
+            bool is_error = false;
+            if (!storage->read_candles(t, [&](
+                    const uint64_t key,
+                    const uint8_t *data,
+                    const size_t size) {
+                is_error = !data_preparation.decompress_candles(key, data, size, candles);
+            })) {
                 print_error("error read candles", __LINE__);
                 return false;
             }
+            if (is_error) {
+                print_error("error decompress candles", __LINE__);
+                return false;
+            }
+            return true;
+		}
+
+		bool read_ticks_range(
+				const uint64_t t_start,
+				const uint64_t t_stop,
+				std::map<uint64_t, QdbTickBlock> &ticks) {
             data_preparation.config.price_scale = config.digits;
-            if (!data_preparation.decompress_candles(t, data, candles)) {
+            bool is_error = false;
+            const bool status = storage->read_ticks_range(t_start, t_stop, [&](
+                    const uint64_t key,
+                    const uint8_t *data,
+                    const size_t size) {
+                if (!data_preparation.decompress_ticks(key, data, size, ticks[key])) {
+                    ticks.erase(key);
+                    is_error = true;
+                }
+            });
+            if (!status) {
+                print_error("error read ticks range", __LINE__);
+                return false;
+            }
+            if (is_error) {
+                print_error("error decompress ticks", __LINE__);
+                return false;
+            }
+            return true;
+		}
+
+		bool read_candles_range(
+				const uint64_t t_start,
+				const uint64_t t_stop,
+				std::map<uint64_t, std::array<trading_db::Candle, ztime::MIN_PER_DAY>> &candles) {
+            data_preparation.config.price_scale = config.digits;
+            bool is_error = false;
+            const bool status = storage->read_candles_range(t_start, t_stop, [&](
+                    const uint64_t key,
+                    const uint8_t *data,
+                    const size_t size) {
+                if (!data_preparation.decompress_candles(key, data, size, candles[key])) {
+                    candles.erase(key);
+                    is_error = true;
+                }
+            });
+            if (!status) {
+                print_error("error read candles range", __LINE__);
+                return false;
+            }
+            if (is_error) {
                 print_error("error decompress candles", __LINE__);
                 return false;
             }
             return true;
 		}
 
+        using candles_day_ptr = QdbPriceBuffer::candles_day_ptr;
+
+        inline bool is_block_cache() const noexcept {
+            return config.use_block_cache && cache_db_id;
+        }
+
+        /** \brief Read an hour of ticks through the block cache
+         */
+        bool read_cached_ticks(const uint64_t t, QdbTickBlock &ticks) {
+            QdbBlockCache &cache = QdbBlockCache::get_instance();
+            if (is_block_cache() && cache.get_ticks(cache_db_id, t, ticks)) return true;
+            // распаковка добавляет тики в блок, поэтому начинаем с пустого блока
+            ticks = QdbTickBlock();
+            if (!read_ticks(t, ticks)) return false;
+            if (is_block_cache()) cache.put_ticks(cache_db_id, t, ticks);
+            return true;
+        }
+
+        /** \brief Read a day of candles through the block cache
+         */
+        bool read_cached_candles(const uint64_t t, candles_day_ptr &candles) {
+            QdbBlockCache &cache = QdbBlockCache::get_instance();
+            if (is_block_cache() && cache.get_candles(cache_db_id, t, candles)) return true;
+            auto day = std::make_shared<QdbPriceBuffer::candles_day>();
+            if (!read_candles(t, *day)) return false;
+            candles = std::move(day);
+            if (is_block_cache()) cache.put_candles(cache_db_id, t, candles);
+            return true;
+        }
+
+        /** \brief Read a range of tick hours, decoding only the hours missing from the block cache
+         */
+        bool read_cached_ticks_range(
+                const uint64_t t_start,
+                const uint64_t t_stop,
+                std::map<uint64_t, QdbTickBlock> &ticks) {
+            if (!is_block_cache()) return read_ticks_range(t_start, t_stop, ticks);
+            QdbBlockCache &cache = QdbBlockCache::get_instance();
+            // сужаем запрос до часов, которых нет в кэше
+            uint64_t first_time = t_stop + ztime::SEC_PER_HOUR;
+            uint64_t last_time = 0;
+            for (uint64_t t = t_start; t <= t_stop; t += ztime::SEC_PER_HOUR) {
+                if (!tick_presence->check(t)) continue;
+                if (cache.get_ticks(cache_db_id, t, ticks[t])) continue;
+                ticks.erase(t);
+                if (first_time > t_stop) first_time = t;
+                last_time = t;
+            }
+            if (first_time > t_stop) return true;
+            std::map<uint64_t, QdbTickBlock> temp;
+            if (!read_ticks_range(first_time, last_time, temp)) return false;
+            for (auto &item : temp) {
+                if (ticks.count(item.first)) continue;
+                cache.put_ticks(cache_db_id, item.first, item.second);
+                ticks[item.first] = std::move(item.second);
+            }
+            return true;
+        }
+
+        /** \brief Read a range of candle days, decoding only the days missing from the block cache
+         */
+        bool read_cached_candles_range(
+                const uint64_t t_start,
+                const uint64_t t_stop,
+                std::map<uint64_t, candles_day_ptr> &candles) {
+            QdbBlockCache &cache = QdbBlockCache::get_instance();
+            uint64_t first_time = t_stop + ztime::SEC_PER_DAY;
+            uint64_t last_time = 0;
+            for (uint64_t t = t_start; t <= t_stop; t += ztime::SEC_PER_DAY) {
+                if (!candle_presence->check(t)) continue;
+                if (is_block_cache() && cache.get_candles(cache_db_id, t, candles[t])) continue;
+                candles.erase(t);
+                if (first_time > t_stop) first_time = t;
+                last_time = t;
+            }
+            if (first_time > t_stop) return true;
+            std::map<uint64_t, std::array<trading_db::Candle, ztime::MIN_PER_DAY>> temp;
+            if (!read_candles_range(first_time, last_time, temp)) return false;
+            for (auto &item : temp) {
+                if (candles.count(item.first)) continue;
+                candles_day_ptr day = std::make_shared<const QdbPriceBuffer::candles_day>(item.second);
+                if (is_block_cache()) cache.put_candles(cache_db_id, item.first, day);
+                candles[item.first] = std::move(day);
+            }
+            return true;
+        }
+
+        /** \brief Find the first block with data in [t_start, t_stop]
+         *
+         * Uses the block presence map. If the map is not loaded, blocks are
+         * taken in a row within the stored date range.
+         * \param is_tick  Tick hours if true, candle days otherwise
+         * \param t_start  Start time (seconds)
+         * \param t_stop   Stop time (seconds)
+         * \param key      Start of the found block
+         * \return Will return false if there are no more blocks
+         */
+        bool find_block(const bool is_tick, const uint64_t t_start, const uint64_t t_stop, uint64_t &key) noexcept {
+            const uint64_t period = is_tick ? ztime::SEC_PER_HOUR : ztime::SEC_PER_DAY;
+            const uint64_t start_time = t_start - t_start % period;
+            if (start_time > t_stop) return false;
+            QdbPresenceBitmap &presence = is_tick ? *tick_presence : *candle_presence;
+            if (presence.find_next(start_time, t_stop, key)) return key != 0;
+            uint64_t t_min = 0, t_max = 0;
+            if (!storage->get_min_max_date(is_tick, t_min, t_max)) return false;
+            key = std::max(start_time, t_min);
+            return key <= std::min(t_stop, t_max);
+        }
+
+        /** \brief Pass the ticks in [t_start, t_stop] (seconds, inclusive) to the bucketing block by block
+         * \return Will return false if a tick block could not be read
+         */
+        bool for_each_tick_block(const uint64_t t_start, const uint64_t t_stop, QdbTickBucketing &bucketing) noexcept {
+            TickCursor cursor(this, t_start * ztime::MS_PER_SEC, t_stop * ztime::MS_PER_SEC + (ztime::MS_PER_SEC - 1));
+            const uint64_t *t_ms = nullptr;
+            const double *bid = nullptr, *ask = nullptr;
+            size_t count = 0;
+            while ((count = cursor.next_block(t_ms, bid, ask)) != 0) {
+                bucketing.add(t_ms, bid, ask, count);
+            }
+            return !cursor.is_error();
+        }
+
+        /** \brief Build candles of the timeframe from the minute candles in [t_start, t_stop]
+         * \param on_candle Called for each bar with data, in time order
+         * \return Will return false if a candle block could not be read
+         */
+        template<class F>
+        bool for_each_candle(
+                const uint64_t t_start,
+                const uint64_t t_stop,
+                const QDB_TIMEFRAMES p,
+                F on_candle) noexcept {
+            const uint64_t period = static_cast<uint64_t>(p) * ztime::SEC_PER_MIN;
+            CandleCursor cursor(this, t_start, t_stop);
+            Candle bar, candle;
+            while (cursor.next(candle)) {
+                const uint64_t bar_time = candle.timestamp - candle.timestamp % period;
+                if (bar.timestamp != bar_time || bar.empty()) {
+                    if (!bar.empty()) on_candle(bar);
+                    bar = candle;
+                    bar.timestamp = bar_time;
+                    continue;
+                }
+                bar.high = std::max(bar.high, candle.high);
+                bar.low = std::min(bar.low, candle.low);
+                bar.close = candle.close;
+                bar.volume += candle.volume;
+            }
+            if (!bar.empty()) on_candle(bar);
+            return !cursor.is_error();
+        }
+
+        /** \brief Decode tick hours ahead of the reader into the block cache
+         *
+         * Runs on the prefetcher thread. Takes up to config.prefetch_hours hours with data
+         * starting from t_start, copies the blobs of the hours missing from the cache
+         * under the storage lock and decodes them outside of it.
+         */
+        void prefetch_ticks(const uint64_t t_start, const uint64_t t_max) noexcept {
+            QdbBlockCache &cache = QdbBlockCache::get_instance();
+            std::vector<uint64_t> keys;
+            uint64_t t = ztime::start_of_hour(t_start);
+            while (keys.size() < config.prefetch_hours && t <= t_max) {
+                uint64_t key = t;
+                if (!tick_presence->find_next(t, t_max, key)) {
+                    // карта наличия не загружена, берем часы подряд
+                    key = t;
+                } else if (!key) break;
+                if (!cache.contains(cache_db_id, true, key)) keys.push_back(key);
+                t = key + ztime::SEC_PER_HOUR;
+            }
+            if (keys.empty()) return;
+
+            std::map<uint64_t, std::vector<uint8_t>> blobs;
+            if (!storage->read_ticks_range(keys.front(), keys.back(), [&](
+                    const uint64_t key,
+                    const uint8_t *data,
+                    const size_t size) {
+                if (!std::binary_search(keys.begin(), keys.end(), key)) return;
+                blobs[key].assign(data, data + size);
+            })) return;
+
+            prefetch_preparation.config.price_scale = config.digits;
+            for (const auto &item : blobs) {
+                QdbTickBlock ticks;
+                if (!prefetch_preparation.decompress_ticks(item.first, item.second.data(), item.second.size(), ticks)) continue;
+                cache.put_ticks(cache_db_id, item.first, ticks);
+            }
+        }
+
+        /** \brief Drop written or removed blocks from the block cache
+         */
+        template<class T>
+        inline void invalidate_cache(const bool is_tick, const std::map<uint64_t, T> &blocks) noexcept {
+            if (!cache_db_id) return;
+            QdbBlockCache &cache = QdbBlockCache::get_instance();
+            for (const auto &item : blocks) cache.remove(cache_db_id, is_tick, item.first);
+        }
+
+        inline void update_compress_config(QdbDataPreparation &preparation) noexcept {
+            preparation.config.price_scale = config.digits;
+            preparation.config.use_tiered_compression = config.use_tiered_compression;
+            preparation.config.fast_compress_level = config.fast_compress_level;
+            preparation.config.compress_level = config.compress_level;
+            preparation.config.tick_format = config.tick_format;
+            preparation.config.use_block_header = config.use_block_header;
+            preparation.config.codec_id = config.codec_id;
+        }
+
+        inline void update_compress_config() noexcept {
+            update_compress_config(data_preparation);
+        }
+
+        /** \brief Compress a tick block on a pipeline worker thread
+         */
+        bool compress_ticks_job(
+                QdbDataPreparation &preparation,
+                const uint64_t start_time,
+                const std::map<uint64_t, ShortTick> &ticks,
+                QdbWriterPipeline::Block &block) noexcept {
+            std::map<uint64_t, ShortTick> new_ticks(ticks);
+            if (config.use_data_merge) {
+                std::vector<uint8_t> prev_data;
+                if (storage->read_ticks(prev_data, start_time)) {
+                    std::map<uint64_t, ShortTick> prev_ticks;
+                    if (!preparation.decompress_ticks(start_time, prev_data, prev_ticks)) {
+                        print_error("error decompress ticks", __LINE__);
+                        return false;
+                    }
+                    new_ticks.insert(prev_ticks.begin(), prev_ticks.end());
+                }
+            }
+            if (!preparation.compress_ticks(start_time, new_ticks, block.data)) {
+                print_error("error compress ticks", __LINE__);
+                return false;
+            }
+            QdbDataPreparation::get_summary(start_time, new_ticks, block.data, block.tick_summary);
+            return true;
+        }
+
+        /** \brief Compress a candle block on a pipeline worker thread
+         */
+        bool compress_candles_job(
+                QdbDataPreparation &preparation,
+                const uint64_t start_time,
+                const std::array<trading_db::Candle, ztime::MIN_PER_DAY> &candles,
+                QdbWriterPipeline::Block &block) noexcept {
+            std::array<trading_db::Candle, ztime::MIN_PER_DAY> new_candles(candles);
+            if (config.use_data_merge) {
+                std::vector<uint8_t> prev_data;
+                if (storage->read_candles(prev_data, start_time)) {
+                    std::array<trading_db::Candle, ztime::MIN_PER_DAY> prev_candles;
+                    if (!preparation.decompress_candles(start_time, prev_data, prev_candles)) {
+                        print_error("error decompress candles", __LINE__);
+                        return false;
+                    }
+                    for (size_t i = 0; i < ztime::MIN_PER_DAY; ++i) {
+                        if (!new_candles[i].empty()) prev_candles[i] = new_candles[i];
+                    }
+                    new_candles = prev_candles;
+                }
+            }
+            if (!preparation.compress_candles(new_candles, block.data)) {
+                print_error("error compress candles", __LINE__);
+                return false;
+            }
+            QdbDataPreparation::get_summary(start_time, new_candles, block.data, block.candle_summary);
+            return true;
+        }
+
+        /** \brief Build and compress a day of M1 candles from the stored ticks (worker thread)
+         * \return Will return false on a read or compression error. An empty block means the day has no ticks
+         */
+        bool build_candles_job(
+                QdbDataPreparation &preparation,
+                const uint64_t start_time,
+                const QDB_PRICE_MODE mode,
+                QdbWriterPipeline::Block &block) noexcept {
+            // копируем блобы, чтобы не распаковывать тики под блокировкой чтения хранилища
+            std::vector<QdbStorage::KeyValue> blobs;
+            if (!storage->read_ticks_range(start_time, start_time + ztime::SEC_PER_DAY - ztime::SEC_PER_HOUR, [&](
+                    const uint64_t key,
+                    const uint8_t *data,
+                    const size_t size) {
+                blobs.resize(blobs.size() + 1);
+                blobs.back().key = key;
+                blobs.back().value.assign(data, data + size);
+            })) {
+                print_error("error read ticks", __LINE__);
+                return false;
+            }
+
+            std::array<trading_db::Candle, ztime::MIN_PER_DAY> candles;
+            std::vector<uint8_t> buffer;
+            QdbTickBlock ticks;
+            bool is_empty = true;
+            for (const auto &blob : blobs) {
+                ticks = QdbTickBlock();
+                if (!preparation.decompress_ticks(blob.key, blob.value.data(), blob.value.size(), ticks, buffer)) {
+                    print_error("error decompress ticks", __LINE__);
+                    return false;
+                }
+                for (size_t i = 0; i < ticks.size(); ++i) {
+                    const uint64_t t = ticks.t_ms(i) / ztime::MS_PER_SEC;
+                    if (t < start_time) continue;
+                    const uint64_t minute_day = (t - start_time) / ztime::SEC_PER_MIN;
+                    if (minute_day >= ztime::MIN_PER_DAY) continue;
+                    const double price =
+                        mode == QDB_PRICE_MODE::ASK_PRICE ? ticks.ask(i) :
+                        mode == QDB_PRICE_MODE::AVG_PRICE ? (ticks.bid(i) + ticks.ask(i)) / 2.0 :
+                        ticks.bid(i);
+                    Candle &candle = candles[minute_day];
+                    if (candle.empty()) {
+                        candle = Candle(price, price, price, price, 0.0, start_time + minute_day * ztime::SEC_PER_MIN);
+                    }
+                    if (price > candle.high) candle.high = price;
+                    if (price < candle.low) candle.low = price;
+                    candle.close = price;
+                    candle.volume += 1.0;
+                    is_empty = false;
+                }
+            }
+
+            block.data.clear();
+            if (is_empty) return true;
+            if (config.use_data_merge) {
+                // бары из тиков заполняют только пустые минуты уже записанного дня
+                std::vector<uint8_t> prev_data;
+                if (storage->read_candles(prev_data, start_time)) {
+                    std::array<trading_db::Candle, ztime::MIN_PER_DAY> prev_candles;
+                    if (!preparation.decompress_candles(start_time, prev_data, prev_candles)) {
+                        print_error("error decompress candles", __LINE__);
+                        return false;
+                    }
+                    for (size_t i = 0; i < ztime::MIN_PER_DAY; ++i) {
+                        if (!prev_candles[i].empty()) candles[i] = prev_candles[i];
+                    }
+                }
+            }
+            if (!preparation.compress_candles(candles, block.data)) {
+                print_error("error compress candles", __LINE__);
+                return false;
+            }
+            QdbDataPreparation::get_summary(start_time, candles, block.data, block.candle_summary);
+            return true;
+        }
+
+        /** \brief Write candle days built from ticks and remove the stale ones in a single transaction
+         */
+        bool write_candle_days(
+                const std::map<uint64_t, std::vector<uint8_t>> &data,
+                const std::map<uint64_t, CandleBlockSummary> &summary,
+                const std::vector<uint64_t> &removed,
+                const std::map<uint64_t, uint64_t> &sources,
+                const int level = 0) noexcept {
+            if (data.empty() && removed.empty() && sources.empty()) return true;
+            if (!storage->write_candle_days(data, summary, level, removed, sources)) {
+                print_error("error write candles", __LINE__);
+                return false;
+            }
+            QdbBlockCache &cache = QdbBlockCache::get_instance();
+            for (const uint64_t key : removed) {
+                cache.remove(cache_db_id, false, key);
+                candle_presence->reset(key);
+            }
+            invalidate_cache(false, data);
+            for (const auto &item : data) candle_presence->set(item.first);
+            return true;
+        }
+
+        /** \brief Add data to the fingerprint of a day of ticks (FNV-1a)
+         */
+        static inline uint64_t add_fingerprint(uint64_t hash, const void *data, const size_t size) noexcept {
+            const uint8_t *ptr = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash ^= ptr[i];
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        template<class T>
+        static inline uint64_t add_fingerprint(const uint64_t hash, const T &value) noexcept {
+            return add_fingerprint(hash, &value, sizeof(value));
+        }
+
+        /** \brief Add the content of a tick block to the fingerprint
+         *
+         * Only the decoded ticks are taken into account, so recompression or a new
+         * block format or codec does not change the fingerprint.
+         */
+        static inline uint64_t add_tick_fingerprint(uint64_t hash, const TickBlockSummary &item) noexcept {
+            hash = add_fingerprint(hash, item.key);
+            hash = add_fingerprint(hash, item.count);
+            hash = add_fingerprint(hash, item.first_t_ms);
+            hash = add_fingerprint(hash, item.last_t_ms);
+            hash = add_fingerprint(hash, item.first_bid);
+            hash = add_fingerprint(hash, item.first_ask);
+            hash = add_fingerprint(hash, item.last_bid);
+            hash = add_fingerprint(hash, item.last_ask);
+            hash = add_fingerprint(hash, item.min_bid);
+            hash = add_fingerprint(hash, item.max_bid);
+            hash = add_fingerprint(hash, item.min_ask);
+            hash = add_fingerprint(hash, item.max_ask);
+            return hash;
+        }
+
 		bool compress_ticks(
                 const uint64_t t,
                 const std::map<uint64_t, ShortTick> &ticks,
                 std::vector<uint8_t> &data) {
-            data_preparation.config.price_scale = config.digits;
+            update_compress_config();
             if (!data_preparation.compress_ticks(t, ticks, data)) {
                 print_error("error compress ticks", __LINE__);
                 return false;
@@ -113,7 +617,7 @@ namespace trading_db {
 		bool compress_candles(
                 const std::array<trading_db::Candle, ztime::MIN_PER_DAY> &candles,
                 std::vector<uint8_t> &data) {
-            data_preparation.config.price_scale = config.digits;
+            update_compress_config();
             if (!data_preparation.compress_candles(candles, data)) {
                 print_error("error compress candles", __LINE__);
                 return false;
@@ -128,6 +632,16 @@ namespace trading_db {
                     const std::map<uint64_t, trading_db::ShortTick> &ticks,
                     const uint64_t t) {
                 const uint64_t start_time = ztime::start_of_hour(t);
+                if (config.write_threads) {
+                    auto block = std::make_shared<std::map<uint64_t, ShortTick>>(ticks);
+                    const bool ok = writer_pipeline.add(true, start_time, [this, block, start_time](
+                            const size_t worker,
+                            QdbWriterPipeline::Block &dst) {
+                        return compress_ticks_job(*worker_preparation[worker], start_time, *block, dst);
+                    });
+                    if (!ok) is_write_error = true;
+                    return;
+                }
                 std::map<uint64_t, ShortTick> new_ticks(ticks);
                 if (config.use_data_merge) {
                     std::map<uint64_t, ShortTick> prev_ticks;
@@ -137,7 +651,10 @@ namespace trading_db {
                 }
                 std::vector<uint8_t> data;
                 if (compress_ticks(start_time, new_ticks, data)) {
-                    if (!data.empty()) write_ticks_buffer[start_time] = data;
+                    if (!data.empty()) {
+                        QdbDataPreparation::get_summary(start_time, new_ticks, data, write_ticks_summary[start_time]);
+                        write_ticks_buffer[start_time] = data;
+                    }
                 }
             };
 
@@ -145,6 +662,16 @@ namespace trading_db {
                     const std::array<trading_db::Candle, ztime::MIN_PER_DAY> &candles,
                     const uint64_t t) {
                 const uint64_t start_time = ztime::start_of_day(t);
+                if (config.write_threads) {
+                    auto block = std::make_shared<std::array<trading_db::Candle, ztime::MIN_PER_DAY>>(candles);
+                    const bool ok = writer_pipeline.add(false, start_time, [this, block, start_time](
+                            const size_t worker,
+                            QdbWriterPipeline::Block &dst) {
+                        return compress_candles_job(*worker_preparation[worker], start_time, *block, dst);
+                    });
+                    if (!ok) is_write_error = true;
+                    return;
+                }
                 std::array<trading_db::Candle, ztime::MIN_PER_DAY> new_candles(candles);
                 if (config.use_data_merge) {
                     std::array<trading_db::Candle, ztime::MIN_PER_DAY> prev_candles;
@@ -157,27 +684,82 @@ namespace trading_db {
                 }
                 std::vector<uint8_t> data;
                 if (compress_candles(new_candles, data)) {
-                    if (!data.empty()) write_candles_buffer[start_time] = data;
+                    if (!data.empty()) {
+                        QdbDataPreparation::get_summary(start_time, new_candles, data, write_candles_summary[start_time]);
+                        write_candles_buffer[start_time] = data;
+                    }
                 }
             };
             //}
 
             //{ initialize reading
-            price_buffer.on_read_ticks = [&](const uint64_t t) -> std::map<uint64_t, trading_db::ShortTick> {
-                std::map<uint64_t, ShortTick> temp;
-                if (!read_ticks(t, temp)) {
+            price_buffer.on_read_ticks = [&](const uint64_t t) -> QdbTickBlock {
+                QdbTickBlock temp;
+                if (!read_cached_ticks(t, temp)) {
                     print_error("error read ticks [price_buffer]", __LINE__);
                 }
                 return temp;
             };
 
-            price_buffer.on_read_candles = [&](const uint64_t t) -> std::array<trading_db::Candle, ztime::MIN_PER_DAY> {
-                std::array<trading_db::Candle, ztime::MIN_PER_DAY> temp;
-                if (!read_candles(t, temp)) {
+            price_buffer.on_read_candles = [&](const uint64_t t) -> candles_day_ptr {
+                candles_day_ptr temp;
+                if (!read_cached_candles(t, temp)) {
                     print_error("error read candles [price_buffer]", __LINE__);
                 }
                 return temp;
             };
+
+            price_buffer.on_read_ticks_range = [&](
+                    const uint64_t t_start,
+                    const uint64_t t_stop) -> std::map<uint64_t, QdbTickBlock> {
+                std::map<uint64_t, QdbTickBlock> temp;
+                if (!read_cached_ticks_range(t_start, t_stop, temp)) {
+                    print_error("error read ticks range [price_buffer]", __LINE__);
+                }
+                return temp;
+            };
+
+            price_buffer.on_read_candles_range = [&](
+                    const uint64_t t_start,
+                    const uint64_t t_stop) -> std::map<uint64_t, candles_day_ptr> {
+                std::map<uint64_t, candles_day_ptr> temp;
+                if (!read_cached_candles_range(t_start, t_stop, temp)) {
+                    print_error("error read candles range [price_buffer]", __LINE__);
+                }
+                return temp;
+            };
+
+            price_buffer.on_find_next_tick_hour = [&](
+                    const uint64_t t_ms,
+                    const uint64_t t_stop,
+                    uint64_t &hour) -> bool {
+                TickBlockSummary summary;
+                if (storage->find_next_tick_summary(t_ms, t_stop, summary)) {
+                    hour = summary.key;
+                    return true;
+                }
+                // без сводок текущий час проверяется отдельно, а следующий час с данными берем из карты наличия
+                const uint64_t start_time = ztime::start_of_hour(t_ms / ztime::MS_PER_SEC) + ztime::SEC_PER_HOUR;
+                return tick_presence->find_next(start_time, t_stop, hour);
+            };
+
+            price_buffer.on_prefetch_ticks = [&](const uint64_t t_start, const uint64_t t_max) {
+                if (!config.prefetch_hours || !is_block_cache()) return;
+                if (!prefetcher.is_running()) {
+                    prefetcher.start([this](const uint64_t start, const uint64_t max) {
+                        prefetch_ticks(start, max);
+                    });
+                }
+                prefetcher.request(t_start, t_max);
+            };
+
+            price_buffer.on_check_tick_hour = [&](const uint64_t t) -> bool {
+                return tick_presence->check(t);
+            };
+
+            price_buffer.on_check_candle_day = [&](const uint64_t t) -> bool {
+                return candle_presence->check(t);
+            };
             //}
 
         }
@@ -186,8 +768,327 @@ namespace trading_db {
 
         using METADATA_TYPE = QdbStorage::METADATA_TYPE;
 
+        /** \brief Sequential tick reader
+         *
+         * The cursor keeps the current hour block and the offset in it between calls,
+         * so walking the ticks costs O(1) per tick. Hours are read through the block cache
+         * and hours without data are skipped using the block presence map.
+         * The cursor must be used on the thread that owns the QDB instance.
+         */
+        class TickCursor {
+        public:
+
+            /** \brief Input iterator for range-based for loops
+             */
+            class iterator {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type        = Tick;
+                using difference_type   = std::ptrdiff_t;
+                using pointer           = const Tick*;
+                using reference         = const Tick&;
+
+                iterator() {};
+                explicit iterator(TickCursor *c) : cursor(c) {
+                    if (cursor && !cursor->next(tick)) cursor = nullptr;
+                }
+
+                inline reference operator*() const noexcept { return tick; }
+                inline pointer operator->() const noexcept { return &tick; }
+                inline iterator &operator++() noexcept {
+                    if (cursor && !cursor->next(tick)) cursor = nullptr;
+                    return *this;
+                }
+                inline bool operator==(const iterator &other) const noexcept { return cursor == other.cursor; }
+                inline bool operator!=(const iterator &other) const noexcept { return cursor != other.cursor; }
+
+            private:
+                TickCursor  *cursor = nullptr;
+                Tick        tick;
+            };
+
+            TickCursor() {};
+
+            TickCursor(QDB *qdb, const uint64_t t_ms_start, const uint64_t t_ms_stop) :
+                    db(qdb), t_stop_ms(t_ms_stop) {
+                seek(t_ms_start);
+            }
+
+            /** \brief Move the cursor to the first tick with time not less than t_ms
+             * \return Will return false if there are no ticks in [t_ms, t_ms_stop]
+             */
+            bool seek(const uint64_t t_ms) noexcept {
+                block = QdbTickBlock();
+                index = limit = 0;
+                has_error = false;
+                is_end = !db || t_ms > t_stop_ms;
+                if (is_end) return false;
+                if (!load_block(ztime::start_of_hour(t_ms / ztime::MS_PER_SEC))) return false;
+                index = block.lower_bound_index(t_ms);
+                if (index < limit) return true;
+                return load_block(block_key + ztime::SEC_PER_HOUR);
+            }
+
+            /** \brief Get the next tick
+             * \return Will return false when there are no more ticks
+             */
+            inline bool next(Tick &tick) noexcept {
+                if (index >= limit) {
+                    if (is_end || !load_block(block_key + ztime::SEC_PER_HOUR)) return false;
+                }
+                tick = block.get_tick(index++);
+                return true;
+            }
+
+            /** \brief Get the next ticks
+             * \param ticks Array of at least count ticks
+             * \param count Maximum number of ticks
+             * \return Number of ticks written to the array (0 when there are no more ticks)
+             */
+            size_t next_batch(Tick *ticks, const size_t count) noexcept {
+                size_t n = 0;
+                while (n < count) {
+                    if (index >= limit) {
+                        if (is_end || !load_block(block_key + ztime::SEC_PER_HOUR)) break;
+                    }
+                    const size_t end = std::min(limit, index + (count - n));
+                    const uint64_t *t_ms = block.t_ms_data();
+                    const double *bid = block.bid_data();
+                    const double *ask = block.ask_data();
+                    for (; index < end; ++index, ++n) {
+                        ticks[n].t_ms = t_ms[index];
+                        ticks[n].bid = bid[index];
+                        ticks[n].ask = ask[index];
+                    }
+                }
+                return n;
+            }
+
+            /** \brief Get the rest of the current hour block without copying
+             * \param t_ms  Pointer to the tick times
+             * \param bid   Pointer to the bid prices
+             * \param ask   Pointer to the ask prices
+             * \return Number of ticks (0 when there are no more ticks).
+             * The pointers are valid until the next call of the cursor
+             */
+            size_t next_block(const uint64_t *&t_ms, const double *&bid, const double *&ask) noexcept {
+                if (index >= limit) {
+                    if (is_end || !load_block(block_key + ztime::SEC_PER_HOUR)) return 0;
+                }
+                t_ms = block.t_ms_data() + index;
+                bid = block.bid_data() + index;
+                ask = block.ask_data() + index;
+                const size_t count = limit - index;
+                index = limit;
+                return count;
+            }
+
+            /** \brief Get the next ticks
+             * \param ticks Ticks (the array is replaced)
+             * \param count Maximum number of ticks
+             * \return Number of ticks
+             */
+            size_t next_batch(std::vector<Tick> &ticks, const size_t count) noexcept {
+                ticks.resize(count);
+                ticks.resize(next_batch(ticks.data(), count));
+                return ticks.size();
+            }
+
+            /** \brief Check if the iteration was stopped by a block that could not be read or decompressed
+             */
+            inline bool is_error() const noexcept { return has_error; }
+
+            inline iterator begin() noexcept { return iterator(this); }
+            inline iterator end() noexcept { return iterator(); }
+
+        private:
+            QDB             *db         = nullptr;
+            QdbTickBlock    block;
+            uint64_t        block_key   = 0;
+            uint64_t        t_stop_ms   = 0;
+            size_t          index       = 0;
+            size_t          limit       = 0;    // конец тиков блока в пределах t_stop_ms
+            bool            is_end      = true;
+            bool            has_error   = false;
+
+            // загружаем первый час с тиками, начиная с t
+            bool load_block(uint64_t t) noexcept {
+                const uint64_t t_stop = t_stop_ms / ztime::MS_PER_SEC;
+                index = limit = 0;
+                while (!is_end) {
+                    uint64_t key = 0;
+                    if (!db->find_block(true, t, t_stop, key)) break;
+                    block_key = key;
+                    t = key + ztime::SEC_PER_HOUR;
+                    if (!db->read_cached_ticks(key, block)) {
+                        // без карты наличия ключи перебираются подряд, отсутствующий час - пропуск
+                        if (!db->tick_presence->loaded()) continue;
+                        db->print_error("tick cursor error read block " + std::to_string(key), __LINE__);
+                        has_error = true;
+                        break;
+                    }
+                    if (block.empty()) continue;
+                    limit = block.t_ms(block.size() - 1) > t_stop_ms ? block.upper_bound_index(t_stop_ms) : block.size();
+                    if (limit < block.size()) is_end = true;
+                    if (limit) return true;
+                }
+                is_end = true;
+                block = QdbTickBlock();
+                return false;
+            }
+        }; // TickCursor
+
+        /** \brief Sequential reader of minute candles
+         *
+         * The cursor keeps the current day block and the minute in it between calls.
+         * Empty minutes are skipped. The cursor must be used on the thread that owns the QDB instance.
+         */
+        class CandleCursor {
+        public:
+
+            /** \brief Input iterator for range-based for loops
+             */
+            class iterator {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type        = Candle;
+                using difference_type   = std::ptrdiff_t;
+                using pointer           = const Candle*;
+                using reference         = const Candle&;
+
+                iterator() {};
+                explicit iterator(CandleCursor *c) : cursor(c) {
+                    if (cursor && !cursor->next(candle)) cursor = nullptr;
+                }
+
+                inline reference operator*() const noexcept { return candle; }
+                inline pointer operator->() const noexcept { return &candle; }
+                inline iterator &operator++() noexcept {
+                    if (cursor && !cursor->next(candle)) cursor = nullptr;
+                    return *this;
+                }
+                inline bool operator==(const iterator &other) const noexcept { return cursor == other.cursor; }
+                inline bool operator!=(const iterator &other) const noexcept { return cursor != other.cursor; }
+
+            private:
+                CandleCursor    *cursor = nullptr;
+                Candle          candle;
+            };
+
+            CandleCursor() {};
+
+            CandleCursor(QDB *qdb, const uint64_t t_start, const uint64_t t_stop_time) :
+                    db(qdb), t_stop(t_stop_time) {
+                seek(t_start);
+            }
+
+            /** \brief Move the cursor to the first candle with time not less than t
+             * \return Will return false if there are no candles in [t, t_stop]
+             */
+            bool seek(const uint64_t t) noexcept {
+                day.reset();
+                minute = ztime::MIN_PER_DAY;
+                has_error = false;
+                is_end = !db || t > t_stop;
+                if (is_end) return false;
+                if (!load_block(ztime::start_of_day(t))) return false;
+                if (day_key < t) minute = (t - day_key + ztime::SEC_PER_MIN - 1) / ztime::SEC_PER_MIN;
+                return skip_empty();
+            }
+
+            /** \brief Get the next candle
+             * \return Will return false when there are no more candles
+             */
+            inline bool next(Candle &candle) noexcept {
+                if (!skip_empty()) return false;
+                candle = (*day)[minute++];
+                return true;
+            }
+
+            /** \brief Get the next candles
+             * \param candles   Array of at least count candles
+             * \param count     Maximum number of candles
+             * \return Number of candles written to the array (0 when there are no more candles)
+             */
+            size_t next_batch(Candle *candles, const size_t count) noexcept {
+                size_t n = 0;
+                while (n < count && next(candles[n])) ++n;
+                return n;
+            }
+
+            /** \brief Get the next candles
+             * \param candles   Candles (the array is replaced)
+             * \param count     Maximum number of candles
+             * \return Number of candles
+             */
+            size_t next_batch(std::vector<Candle> &candles, const size_t count) noexcept {
+                candles.resize(count);
+                candles.resize(next_batch(candles.data(), count));
+                return candles.size();
+            }
+
+            /** \brief Check if the iteration was stopped by a block that could not be read or decompressed
+             */
+            inline bool is_error() const noexcept { return has_error; }
+
+            inline iterator begin() noexcept { return iterator(this); }
+            inline iterator end() noexcept { return iterator(); }
+
+        private:
+            QDB             *db         = nullptr;
+            candles_day_ptr day;
+            uint64_t        day_key     = 0;
+            uint64_t        t_stop      = 0;
+            size_t          minute      = ztime::MIN_PER_DAY;
+            bool            is_end      = true;
+            bool            has_error   = false;
+
+            // загружаем первый день с барами, начиная с t
+            bool load_block(uint64_t t) noexcept {
+                minute = ztime::MIN_PER_DAY;
+                while (!is_end) {
+                    uint64_t key = 0;
+                    if (!db->find_block(false, t, t_stop, key)) break;
+                    day_key = key;
+                    t = key + ztime::SEC_PER_DAY;
+                    if (!db->read_cached_candles(key, day)) {
+                        // без карты наличия ключи перебираются подряд, отсутствующий день - пропуск
+                        if (!db->candle_presence->loaded()) continue;
+                        db->print_error("candle cursor error read block " + std::to_string(key), __LINE__);
+                        has_error = true;
+                        break;
+                    }
+                    if (!day) continue;
+                    minute = 0;
+                    return true;
+                }
+                is_end = true;
+                day.reset();
+                return false;
+            }
+
+            // переходим к ближайшему непустому бару
+            bool skip_empty() noexcept {
+                while (!false) {
+                    for (; minute < ztime::MIN_PER_DAY; ++minute) {
+                        if ((day_key + minute * ztime::SEC_PER_MIN) > t_stop) {
+                            is_end = true;
+                            minute = ztime::MIN_PER_DAY;
+                            return false;
+                        }
+                        if (!(*day)[minute].empty()) return true;
+                    }
+                    if (is_end || !load_block(day_key + ztime::SEC_PER_DAY)) return false;
+                }
+            }
+        }; // CandleCursor
+
         QDB() {init();}
-        ~QDB() {}
+        ~QDB() {
+            prefetcher.stop();
+            writer_pipeline.stop();
+            QdbBlockCache::get_instance().release_db(cache_db_id);
+        }
 
         //----------------------------------------------------------------------
 
@@ -197,10 +1098,42 @@ namespace trading_db {
 		 * \return Вернет true в случае успешной инициализации
 		 */
 		inline bool open(const std::string &path, const bool readonly = false) noexcept {
-			if (!storage.open(path, readonly)) return false;
-			config.digits = storage.get_info_int(QdbStorage::METADATA_TYPE::SYMBOL_DIGITS);
-			config.symbol = storage.get_info_str(QdbStorage::METADATA_TYPE::SYMBOL_NAME);
-			config.source = storage.get_info_str(QdbStorage::METADATA_TYPE::SYMBOL_DATA_FEED_SOURCE);
+			prefetcher.stop();
+			// экземпляр, ранее открытый поверх пула, получает собственное соединение
+			if (storage.use_count() > 1) storage = std::make_shared<QdbStorage>();
+			if (tick_presence.use_count() > 1) tick_presence = std::make_shared<QdbPresenceBitmap>(ztime::SEC_PER_HOUR);
+			if (candle_presence.use_count() > 1) candle_presence = std::make_shared<QdbPresenceBitmap>(ztime::SEC_PER_DAY);
+			if (!storage->open(path, readonly)) return false;
+			QdbBlockCache::get_instance().release_db(cache_db_id);
+			cache_db_id = QdbBlockCache::get_instance().acquire_db(path);
+			std::vector<uint64_t> keys;
+			if (storage->read_keys(true, keys)) tick_presence->load(keys);
+			if (storage->read_keys(false, keys)) candle_presence->load(keys);
+			config.digits = storage->get_info_int(QdbStorage::METADATA_TYPE::SYMBOL_DIGITS);
+			config.symbol = storage->get_info_str(QdbStorage::METADATA_TYPE::SYMBOL_NAME);
+			config.source = storage->get_info_str(QdbStorage::METADATA_TYPE::SYMBOL_DATA_FEED_SOURCE);
+			return true;
+		}
+
+		/** \brief Open a read-only view on a shared connection pool
+		 *
+		 * The view uses a connection of the pool, the pool's block presence maps and the
+		 * process-wide block cache, so only its own price buffer is kept per instance.
+		 * Views of one pool can be used from different threads, one view per thread.
+		 * \param pool	Opened connection pool
+		 * \return Will return true if the view was opened
+		 */
+		inline bool open(const std::shared_ptr<QdbReadPool> &pool) noexcept {
+			if (!pool || !pool->is_open()) return false;
+			prefetcher.stop();
+			storage = pool->get_connection();
+			tick_presence = pool->get_tick_presence();
+			candle_presence = pool->get_candle_presence();
+			QdbBlockCache::get_instance().release_db(cache_db_id);
+			cache_db_id = QdbBlockCache::get_instance().acquire_db(pool->get_path());
+			config.digits = storage->get_info_int(QdbStorage::METADATA_TYPE::SYMBOL_DIGITS);
+			config.symbol = storage->get_info_str(QdbStorage::METADATA_TYPE::SYMBOL_NAME);
+			config.source = storage->get_info_str(QdbStorage::METADATA_TYPE::SYMBOL_DATA_FEED_SOURCE);
 			return true;
 		}
 
@@ -208,9 +1141,55 @@ namespace trading_db {
         //----------------------------------------------------------------------
         // методы для записи данных
 
+        /** \brief Start writing data
+         *
+         * If config.write_threads is greater than zero, hour and day blocks are compressed
+         * by a pool of worker threads and written in batches of config.write_batch_size blocks
+         * while data is still being added. stop_write waits for all blocks to be written.
+         */
         inline void start_write() noexcept {
+            prefetcher.wait();
             write_ticks_buffer.clear();
             write_candles_buffer.clear();
+            write_ticks_summary.clear();
+            write_candles_summary.clear();
+            is_write_error = false;
+            if (config.write_threads) {
+                update_compress_config();
+                worker_preparation.resize(config.write_threads);
+                for (auto &preparation : worker_preparation) {
+                    if (!preparation) preparation.reset(new QdbDataPreparation());
+                    update_compress_config(*preparation);
+                }
+                const int level = data_preparation.get_write_level();
+                writer_pipeline.config.threads = config.write_threads;
+                writer_pipeline.config.batch_size = config.write_batch_size;
+                writer_pipeline.start([this, level](
+                        const bool is_tick,
+                        std::map<uint64_t, QdbWriterPipeline::Block> &blocks) {
+                    std::map<uint64_t, std::vector<uint8_t>> data;
+                    if (is_tick) {
+                        std::map<uint64_t, TickBlockSummary> summary;
+                        for (auto &item : blocks) {
+                            data[item.first] = std::move(item.second.data);
+                            summary[item.first] = item.second.tick_summary;
+                        }
+                        if (!storage->write_ticks(data, summary, level)) return false;
+                        invalidate_cache(true, data);
+                        for (const auto &item : data) tick_presence->set(item.first);
+                        return true;
+                    }
+                    std::map<uint64_t, CandleBlockSummary> summary;
+                    for (auto &item : blocks) {
+                        data[item.first] = std::move(item.second.data);
+                        summary[item.first] = item.second.candle_summary;
+                    }
+                    if (!storage->write_candles(data, summary, level)) return false;
+                    invalidate_cache(false, data);
+                    for (const auto &item : data) candle_presence->set(item.first);
+                    return true;
+                });
+            }
             writer_buffer.start();
         }
 
@@ -224,35 +1203,317 @@ namespace trading_db {
 
         inline bool stop_write() noexcept {
             writer_buffer.stop();
+            prefetcher.wait();
+            if (!writer_pipeline.stop()) is_write_error = true;
+            if (is_write_error) return false;
+            update_compress_config();
+            const int level = data_preparation.get_write_level();
             if (!write_candles_buffer.empty()) {
-                if (!storage.write_candles(write_candles_buffer)) return false;
+                if (!storage->write_candles(write_candles_buffer, write_candles_summary, level)) return false;
+                invalidate_cache(false, write_candles_buffer);
+                for (const auto &item : write_candles_buffer) candle_presence->set(item.first);
             }
             if (!write_ticks_buffer.empty()) {
-                if (!storage.write_ticks(write_ticks_buffer)) return false;
+                if (!storage->write_ticks(write_ticks_buffer, write_ticks_summary, level)) return false;
+                invalidate_cache(true, write_ticks_buffer);
+                for (const auto &item : write_ticks_buffer) tick_presence->set(item.first);
             }
             return true;
         }
 
+        /** \brief Start background recompression of blocks written at a fast level
+         *
+         * Blocks written with use_tiered_compression are recompressed to config.compress_level
+         * while the database is idle. Throttling is set by storage settings
+         * compaction_delay_ms and compaction_idle_ms.
+         * \param on_progress   Progress callback (done blocks, total blocks). Called from the background thread
+         * \return Will return true if the task was started
+         */
+        inline bool start_compaction(const QdbStorage::ProgressCallback &on_progress = nullptr) noexcept {
+            auto preparation = std::make_shared<QdbDataPreparation>();
+            preparation->config.compress_level = config.compress_level;
+            return storage->start_compaction(config.compress_level, [preparation](
+                    const bool is_tick,
+                    const uint64_t,
+                    const uint8_t *data,
+                    const size_t size,
+                    std::vector<uint8_t> &dst) {
+                return preparation->recompress(is_tick, data, size, dst);
+            }, on_progress);
+        }
+
+        /** \brief Stop background recompression
+         */
+        inline void stop_compaction() noexcept {
+            storage->stop_compaction();
+        }
+
+        /** \brief Set compaction throttling
+         * \param delay_ms  Pause after each recompressed block
+         * \param idle_ms   Time without writes after which the database is considered idle
+         */
+        inline void set_compaction_throttle(const int delay_ms, const int idle_ms) noexcept {
+            storage->config.compaction_delay_ms = delay_ms;
+            storage->config.compaction_idle_ms = idle_ms;
+        }
+
         inline bool remove_candles(const uint64_t t) noexcept {
-            return storage.remove_candles(ztime::start_of_day(t));
+            if (!storage->remove_candles(ztime::start_of_day(t))) return false;
+            QdbBlockCache::get_instance().remove(cache_db_id, false, ztime::start_of_day(t));
+            candle_presence->reset(ztime::start_of_day(t));
+            return true;
         }
 
         inline bool remove_ticks(const uint64_t t) noexcept {
-            return storage.remove_ticks(ztime::start_of_hour(t));
+            if (!storage->remove_ticks(ztime::start_of_hour(t))) return false;
+            QdbBlockCache::get_instance().remove(cache_db_id, true, ztime::start_of_hour(t));
+            tick_presence->reset(ztime::start_of_hour(t));
+            return true;
         }
 
         inline bool remove_all() noexcept {
-			return storage.remove_all();
+			if (!storage->remove_all()) return false;
+			QdbBlockCache::get_instance().remove_db(cache_db_id);
+			tick_presence->clear();
+			candle_presence->clear();
+			return true;
+		}
+
+		/** \brief Get tick block summaries without decompressing the blocks
+		 * \param t_start	Start time (seconds)
+		 * \param t_stop	Stop time (seconds)
+		 * \param summary	Summaries of the hours in [t_start, t_stop] that have data
+		 * \return Will return false if the file has no summary index
+		 */
+		inline bool get_tick_summary(
+                const uint64_t t_start,
+                const uint64_t t_stop,
+                std::vector<TickBlockSummary> &summary) noexcept {
+            return storage->read_tick_summary(ztime::start_of_hour(t_start), ztime::start_of_hour(t_stop), summary);
+		}
+
+		/** \brief Get candle block summaries without decompressing the blocks
+		 * \param t_start	Start time (seconds)
+		 * \param t_stop	Stop time (seconds)
+		 * \param summary	Summaries of the days in [t_start, t_stop] that have data
+		 * \return Will return false if the file has no summary index
+		 */
+		inline bool get_candle_summary(
+                const uint64_t t_start,
+                const uint64_t t_stop,
+                std::vector<CandleBlockSummary> &summary) noexcept {
+            return storage->read_candle_summary(ztime::start_of_day(t_start), ztime::start_of_day(t_stop), summary);
+		}
+
+		/** \brief Rebuild the summary index from the stored blocks
+		 *
+		 * Files written before the index existed have no summaries, so
+		 * the summary-based searches are not used for them until the index is rebuilt.
+		 * \return Will return true if the index was rebuilt
+		 */
+		inline bool rebuild_summary() noexcept {
+            data_preparation.config.price_scale = config.digits;
+            bool is_error = false;
+            std::vector<TickBlockSummary> tick_summary;
+            std::map<uint64_t, ShortTick> ticks;
+            std::vector<uint8_t> data;
+            if (!storage->read_ticks_range(0, std::numeric_limits<int64_t>::max(), [&](
+                    const uint64_t key,
+                    const uint8_t *blob,
+                    const size_t size) {
+                if (is_error) return;
+                ticks.clear();
+                if (!data_preparation.decompress_ticks(key, blob, size, ticks)) {
+                    is_error = true;
+                    return;
+                }
+                data.assign(blob, blob + size);
+                tick_summary.resize(tick_summary.size() + 1);
+                QdbDataPreparation::get_summary(key, ticks, data, tick_summary.back());
+            }) || is_error) {
+                print_error("error rebuild tick summary", __LINE__);
+                return false;
+            }
+
+            std::vector<CandleBlockSummary> candle_summary;
+            std::array<trading_db::Candle, ztime::MIN_PER_DAY> candles;
+            if (!storage->read_candles_range(0, std::numeric_limits<int64_t>::max(), [&](
+                    const uint64_t key,
+                    const uint8_t *blob,
+                    const size_t size) {
+                if (is_error) return;
+                if (!data_preparation.decompress_candles(key, blob, size, candles)) {
+                    is_error = true;
+                    return;
+                }
+                data.assign(blob, blob + size);
+                candle_summary.resize(candle_summary.size() + 1);
+                QdbDataPreparation::get_summary(key, candles, data, candle_summary.back());
+            }) || is_error) {
+                print_error("error rebuild candle summary", __LINE__);
+                return false;
+            }
+            return storage->write_tick_summary(tick_summary) &&
+                storage->write_candle_summary(candle_summary);
+		}
+
+		/** \brief Build M1 candles from the stored ticks
+		 *
+		 * Tick hours are decoded by config.write_threads threads (hardware concurrency if zero),
+		 * the candle days are compressed on the same threads and written in batches of config.write_batch_size days.
+		 * Each candle is built from the tick prices of its minute, the volume is the number of ticks.
+		 *
+		 * A fingerprint of the ticks is stored for every written day. In incremental mode
+		 * the days whose ticks have not changed since the previous run are skipped.
+		 * The fingerprint covers only the decoded ticks of each hour (from the summary index if it is complete,
+		 * otherwise from the decoded blocks), so recompression or a new block format does not invalidate it.
+		 *
+		 * Days built earlier whose ticks are gone are removed together with their summaries and fingerprints.
+		 * With config.use_data_merge the stored candles are kept: the candles from ticks fill only
+		 * the empty minutes and no day is removed.
+		 * \param t_start		Start time (seconds)
+		 * \param t_stop		Stop time (seconds)
+		 * \param mode			Tick price the candles are built from
+		 * \param incremental	Skip the days whose tick blocks have not changed
+		 * \return Will return true if all the days were built and written
+		 */
+		inline bool rebuild_candles_from_ticks(
+                const uint64_t t_start,
+                const uint64_t t_stop,
+                const QDB_PRICE_MODE mode = QDB_PRICE_MODE::BID_PRICE,
+                const bool incremental = true) noexcept {
+            const uint64_t day_start = ztime::start_of_day(t_start);
+            const uint64_t day_stop = ztime::start_of_day(t_stop);
+            const uint64_t hour_stop = day_stop + ztime::SEC_PER_DAY - ztime::SEC_PER_HOUR;
+            if (day_start > day_stop) return true;
+
+            // отпечатки тиков по дням (режим цены тоже входит в отпечаток)
+            const uint64_t seed = add_fingerprint(14695981039346656037ULL, mode);
+            std::map<uint64_t, uint64_t> fingerprints;
+            auto add_block = [&](const TickBlockSummary &item) {
+                uint64_t &hash = fingerprints.emplace(ztime::start_of_day(item.key), seed).first->second;
+                hash = add_tick_fingerprint(hash, item);
+            };
+            if (storage->has_tick_summary()) {
+                std::vector<TickBlockSummary> summary;
+                if (!storage->read_tick_summary(day_start, hour_stop, summary)) {
+                    print_error("error read tick summary", __LINE__);
+                    return false;
+                }
+                for (const auto &item : summary) add_block(item);
+            } else {
+                // без индекса сводок получаем сводку каждого часа из распакованных тиков
+                data_preparation.config.price_scale = config.digits;
+                bool is_error = false;
+                std::map<uint64_t, ShortTick> ticks;
+                const std::vector<uint8_t> no_data;
+                TickBlockSummary summary;
+                if (!storage->read_ticks_range(day_start, hour_stop, [&](
+                        const uint64_t key,
+                        const uint8_t *data,
+                        const size_t size) {
+                    if (is_error) return;
+                    ticks.clear();
+                    if (!data_preparation.decompress_ticks(key, data, size, ticks)) {
+                        is_error = true;
+                        return;
+                    }
+                    QdbDataPreparation::get_summary(key, ticks, no_data, summary);
+                    add_block(summary);
+                })) {
+                    print_error("error read ticks", __LINE__);
+                    return false;
+                }
+                if (is_error) {
+                    print_error("error decompress ticks", __LINE__);
+                    return false;
+                }
+            }
+
+            std::map<uint64_t, uint64_t> sources;
+            if (!storage->read_candle_sources(day_start, day_stop, sources)) {
+                print_error("error read candle sources", __LINE__);
+                return false;
+            }
+            std::vector<uint64_t> days;
+            for (const auto &item : fingerprints) {
+                auto it = sources.find(item.first);
+                if (incremental && it != sources.end() && it->second == item.second) continue;
+                days.push_back(item.first);
+            }
+            // дни, построенные из тиков, которых больше нет
+            std::vector<uint64_t> removed;
+            if (!config.use_data_merge) {
+                for (const auto &item : sources) {
+                    if (!fingerprints.count(item.first)) removed.push_back(item.first);
+                }
+            }
+            if (!write_candle_days({}, {}, removed, {})) return false;
+            if (days.empty()) return true;
+
+            update_compress_config();
+            const int level = data_preparation.get_write_level();
+            const size_t threads = std::min(days.size(), config.write_threads ?
+                config.write_threads : std::max((size_t)std::thread::hardware_concurrency(), (size_t)1));
+            const size_t batch_size = std::max(config.write_batch_size, (size_t)1);
+            std::vector<std::unique_ptr<QdbDataPreparation>> preparation(threads);
+            for (auto &item : preparation) {
+                item.reset(new QdbDataPreparation());
+                update_compress_config(*item);
+            }
+
+            for (size_t offset = 0; offset < days.size(); offset += batch_size) {
+                const size_t count = std::min(batch_size, days.size() - offset);
+                std::vector<QdbWriterPipeline::Block> blocks(count);
+                std::atomic<size_t> next = ATOMIC_VAR_INIT(0);
+                std::atomic<bool> is_error = ATOMIC_VAR_INIT(false);
+                {
+                    utils::AsyncTasks tasks;
+                    for (size_t n = 0; n < threads; ++n) {
+                        tasks.create_task([&, n]() {
+                            size_t index = 0;
+                            while (!is_error && (index = next++) < count) {
+                                if (!build_candles_job(*preparation[n], days[offset + index], mode, blocks[index])) {
+                                    is_error = true;
+                                }
+                            }
+                        });
+                    }
+                    tasks.wait();
+                }
+                if (is_error) return false;
+
+                std::map<uint64_t, std::vector<uint8_t>> data;
+                std::map<uint64_t, CandleBlockSummary> summary;
+                std::map<uint64_t, uint64_t> batch_sources;
+                std::vector<uint64_t> batch_removed;
+                for (size_t i = 0; i < count; ++i) {
+                    const uint64_t key = days[offset + i];
+                    if (blocks[i].data.empty()) {
+                        // в блоках дня нет тиков: старый день удаляется, при слиянии данных остается как есть
+                        if (!config.use_data_merge) {
+                            batch_removed.push_back(key);
+                            continue;
+                        }
+                    } else {
+                        data[key] = std::move(blocks[i].data);
+                        summary[key] = blocks[i].candle_summary;
+                    }
+                    batch_sources[key] = fingerprints[key];
+                }
+                if (!write_candle_days(data, summary, batch_removed, batch_sources, level)) return false;
+            }
+            return true;
 		}
 
 		//----------------------------------------------------------------------
 
 		inline std::string get_info_str(const QdbStorage::METADATA_TYPE type) noexcept {
-            return storage.get_info_str(type);
+            return storage->get_info_str(type);
 		}
 
 		inline int get_info_int(const QdbStorage::METADATA_TYPE type) noexcept {
-            return storage.get_info_int(type);
+            return storage->get_info_int(type);
 		}
 
 		inline bool set_info_str(const QdbStorage::METADATA_TYPE type, const std::string &value) noexcept {
@@ -266,7 +1527,7 @@ namespace trading_db {
             default:
                 return false;
             };
-            return storage.set_info_str(type, value);
+            return storage->set_info_str(type, value);
 		}
 
 		inline bool set_info_int(const QdbStorage::METADATA_TYPE type, const int value) noexcept {
@@ -277,11 +1538,24 @@ namespace trading_db {
             default:
                 return false;
             };
-            return storage.set_info_int(type, value);
+            return storage->set_info_int(type, value);
+		}
+
+		/** \brief Get statistics of the process-wide block cache
+		 */
+		static inline QdbBlockCache::Stats get_cache_stats() noexcept {
+            return QdbBlockCache::get_instance().get_stats();
+		}
+
+		/** \brief Set the memory budget of the process-wide block cache
+		 * \param max_bytes	Maximum size of decoded blocks kept by the cache for all QDB instances
+		 */
+		static inline void set_cache_budget(const size_t max_bytes) noexcept {
+            QdbBlockCache::get_instance().set_max_bytes(max_bytes);
 		}
 
 		inline bool get_min_max_date(const bool use_tick_data, uint64_t &t_min, uint64_t &t_max) {
-            return storage.get_min_max_date(use_tick_data, t_min, t_max);
+            return storage->get_min_max_date(use_tick_data, t_min, t_max);
 		}
 
         //----------------------------------------------------------------------
@@ -305,6 +1579,269 @@ namespace trading_db {
         inline bool get_next_tick_ms(Tick &tick, const uint64_t t_ms, const uint64_t t_ms_max) noexcept {
             return price_buffer.get_next_tick_ms(tick, t_ms, t_ms_max);
         }
+
+        /** \brief Get all ticks in [t_ms_start, t_ms_stop]
+         *
+         * Ticks are copied straight from the decoded hour blocks, bypassing the price buffer.
+         * \param t_ms_start   Start time (milliseconds)
+         * \param t_ms_stop    Stop time (milliseconds, inclusive)
+         * \param ticks        Ticks (the array is replaced, its memory is reused)
+         * \return Will return true if there is at least one tick and all blocks were read
+         */
+        bool get_ticks(const uint64_t t_ms_start, const uint64_t t_ms_stop, std::vector<Tick> &ticks) noexcept {
+            ticks.clear();
+            TickCursor cursor(this, t_ms_start, t_ms_stop);
+            const uint64_t *t_ms = nullptr;
+            const double *bid = nullptr, *ask = nullptr;
+            size_t count = 0;
+            while ((count = cursor.next_block(t_ms, bid, ask)) != 0) {
+                const size_t offset = ticks.size();
+                ticks.resize(offset + count);
+                for (size_t i = 0; i < count; ++i) {
+                    Tick &tick = ticks[offset + i];
+                    tick.t_ms = t_ms[i];
+                    tick.bid = bid[i];
+                    tick.ask = ask[i];
+                }
+            }
+            return !ticks.empty() && !cursor.is_error();
+        }
+
+        /** \brief Get all ticks in [t_ms_start, t_ms_stop] as separate columns
+         * \param t_ms_start   Start time (milliseconds)
+         * \param t_ms_stop    Stop time (milliseconds, inclusive)
+         * \param ticks        Tick columns (the columns are replaced, their memory is reused)
+         * \return Will return true if there is at least one tick and all blocks were read
+         */
+        bool get_ticks(const uint64_t t_ms_start, const uint64_t t_ms_stop, TickColumns &ticks) noexcept {
+            ticks.clear();
+            TickCursor cursor(this, t_ms_start, t_ms_stop);
+            const uint64_t *t_ms = nullptr;
+            const double *bid = nullptr, *ask = nullptr;
+            size_t count = 0;
+            while ((count = cursor.next_block(t_ms, bid, ask)) != 0) {
+                ticks.t_ms.insert(ticks.t_ms.end(), t_ms, t_ms + count);
+                ticks.bid.insert(ticks.bid.end(), bid, bid + count);
+                ticks.ask.insert(ticks.ask.end(), ask, ask + count);
+            }
+            return !ticks.empty() && !cursor.is_error();
+        }
+
+        /** \brief Get the candles of the timeframe built from the minute candles in [t_start, t_stop]
+         *
+         * Bars are aligned to the timeframe; the first and the last bar contain only
+         * the minutes inside the range. Bars without data are skipped.
+         * \param t_start  Start time (seconds)
+         * \param t_stop   Stop time (seconds, inclusive)
+         * \param p        Timeframe
+         * \param candles  Candles (the array is replaced, its memory is reused)
+         * \return Will return true if there is at least one candle and all blocks were read
+         */
+        bool get_candles(
+                const uint64_t t_start,
+                const uint64_t t_stop,
+                const QDB_TIMEFRAMES p,
+                std::vector<Candle> &candles) noexcept {
+            candles.clear();
+            const bool is_read = for_each_candle(t_start, t_stop, p, [&](const Candle &candle) {
+                candles.push_back(candle);
+            });
+            return !candles.empty() && is_read;
+        }
+
+        /** \brief Get the candles of the timeframe in [t_start, t_stop] as separate columns
+         * \param t_start  Start time (seconds)
+         * \param t_stop   Stop time (seconds, inclusive)
+         * \param p        Timeframe
+         * \param candles  Candle columns (the columns are replaced, their memory is reused)
+         * \return Will return true if there is at least one candle and all blocks were read
+         */
+        bool get_candles(
+                const uint64_t t_start,
+                const uint64_t t_stop,
+                const QDB_TIMEFRAMES p,
+                CandleColumns &candles) noexcept {
+            candles.clear();
+            const bool is_read = for_each_candle(t_start, t_stop, p, [&](const Candle &candle) {
+                candles.push_back(candle);
+            });
+            return !candles.empty() && is_read;
+        }
+
+        /** \brief Get the standard timeframe for a period in seconds
+         * \param period   Period in seconds
+         * \param p        Timeframe
+         * \return Will return false if the period is not one of QDB_TIMEFRAMES
+         */
+        static bool get_timeframe(const uint64_t period, QDB_TIMEFRAMES &p) noexcept {
+            if (!period || period % ztime::SEC_PER_MIN) return false;
+            switch (period / ztime::SEC_PER_MIN) {
+            case 1:     p = QDB_TIMEFRAMES::PERIOD_M1;  return true;
+            case 5:     p = QDB_TIMEFRAMES::PERIOD_M5;  return true;
+            case 15:    p = QDB_TIMEFRAMES::PERIOD_M15; return true;
+            case 30:    p = QDB_TIMEFRAMES::PERIOD_M30; return true;
+            case 60:    p = QDB_TIMEFRAMES::PERIOD_H1;  return true;
+            case 240:   p = QDB_TIMEFRAMES::PERIOD_H4;  return true;
+            case 1440:  p = QDB_TIMEFRAMES::PERIOD_D1;  return true;
+            default:
+                break;
+            };
+            return false;
+        }
+
+        /** \brief Get candles of any period in seconds built from the ticks in [t_start, t_stop]
+         *
+         * Bid, ask and mid price candles are built in one pass over the tick blocks.
+         * Bars are aligned to the period, bars without ticks are skipped, the volume is the number of ticks.
+         * \param t_start  Start time (seconds)
+         * \param t_stop   Stop time (seconds, inclusive)
+         * \param period   Period in seconds (S1, S5, M2, H12, ...)
+         * \param bid      Bid price candles (the columns are replaced)
+         * \param ask      Ask price candles (the columns are replaced)
+         * \param mid      Mid price candles (the columns are replaced)
+         * \return Will return true if there is at least one candle and all blocks were read
+         */
+        bool get_tick_candles(
+                const uint64_t t_start,
+                const uint64_t t_stop,
+                const uint64_t period,
+                CandleColumns &bid,
+                CandleColumns &ask,
+                CandleColumns &mid) noexcept {
+            bid.clear();
+            ask.clear();
+            mid.clear();
+            QdbTickBucketing bucketing(period, &bid, &ask, &mid);
+            if (!for_each_tick_block(t_start, t_stop, bucketing)) return false;
+            return !bid.empty();
+        }
+
+        /** \brief Get candles of any period in seconds built from the ticks in [t_start, t_stop]
+         * \param t_start  Start time (seconds)
+         * \param t_stop   Stop time (seconds, inclusive)
+         * \param period   Period in seconds
+         * \param mode     Tick price used for the candles
+         * \param candles  Candles (the array is replaced)
+         * \return Will return true if there is at least one candle and all blocks were read
+         */
+        bool get_tick_candles(
+                const uint64_t t_start,
+                const uint64_t t_stop,
+                const uint64_t period,
+                const QDB_PRICE_MODE mode,
+                std::vector<Candle> &candles) noexcept {
+            candles.clear();
+            CandleColumns bars;
+            QdbTickBucketing bucketing(
+                period,
+                mode == QDB_PRICE_MODE::BID_PRICE ? &bars : nullptr,
+                mode == QDB_PRICE_MODE::ASK_PRICE ? &bars : nullptr,
+                mode == QDB_PRICE_MODE::AVG_PRICE ? &bars : nullptr);
+            if (!for_each_tick_block(t_start, t_stop, bucketing)) return false;
+            candles.resize(bars.size());
+            for (size_t i = 0; i < bars.size(); ++i) {
+                candles[i] = Candle(bars.open[i], bars.high[i], bars.low[i], bars.close[i], bars.volume[i], bars.timestamp[i]);
+            }
+            return !candles.empty();
+        }
+
+        /** \brief Get the candle of a period in seconds built from the ticks up to time t
+         * \param candle   Candle from the start of the period to t inclusive
+         * \param t        Time (seconds)
+         * \param period   Period in seconds
+         * \param mode     Tick price used for the candle
+         * \return Will return false if there are no ticks from the start of the period to t
+         */
+        bool get_tick_candle(
+                Candle &candle,
+                const uint64_t t,
+                const uint64_t period,
+                const QDB_PRICE_MODE mode = QDB_PRICE_MODE::BID_PRICE) noexcept {
+            if (!period) return false;
+            std::vector<Candle> candles;
+            if (!get_tick_candles(t - t % period, t, period, mode, candles)) return false;
+            candle = candles.back();
+            return true;
+        }
+
+        /** \brief Get the ticks at many points in time with one sweep over the data
+         *
+         * For each time the last tick not later than it is found, as get_tick_ms does.
+         * The queries are sorted and every hour block is decoded at most once,
+         * bypassing the price buffer, so the cost depends on the data scanned rather than on the order of the queries.
+         * \param t_ms   Times (milliseconds) in any order
+         * \param ticks  Ticks in the order of t_ms (the array is replaced). A tick that was not found has t_ms == 0
+         * \return Number of ticks found
+         */
+        size_t get_ticks_at(const std::vector<uint64_t> &t_ms, std::vector<Tick> &ticks) noexcept {
+            ticks.assign(t_ms.size(), Tick());
+            if (t_ms.empty()) return 0;
+
+            std::vector<size_t> order(t_ms.size());
+            for (size_t i = 0; i < order.size(); ++i) {
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+                return t_ms[a] < t_ms[b];
+            });
+
+            const uint64_t deadtime = price_buffer.config.tick_deadtime;
+            const uint64_t lookback = (deadtime + ztime::SEC_PER_HOUR) / ztime::SEC_PER_HOUR;
+            // окно распакованных часов: час запроса и часы в пределах мертвого времени до него
+            std::map<uint64_t, QdbTickBlock> window;
+            auto get_block = [&](const uint64_t key) -> const QdbTickBlock& {
+                auto it = window.find(key);
+                if (it != window.end()) return it->second;
+                QdbTickBlock &block = window[key];
+                if (tick_presence->check(key) && !read_cached_ticks(key, block)) block = QdbTickBlock();
+                return block;
+            };
+
+            size_t found = 0;
+            for (const size_t i : order) {
+                const uint64_t t = t_ms[i];
+                const uint64_t hour = ztime::start_of_hour_sec(t);
+                const uint64_t first_hour = hour < lookback * ztime::SEC_PER_HOUR ? 0 : hour - lookback * ztime::SEC_PER_HOUR;
+                window.erase(window.begin(), window.lower_bound(first_hour));
+                // ищем последний тик не позже t, начиная с часа запроса
+                for (uint64_t key = hour;; key -= ztime::SEC_PER_HOUR) {
+                    const QdbTickBlock &block = get_block(key);
+                    const size_t index = block.upper_bound_index(t);
+                    if (index) {
+                        const int64_t dt = ztime::ms_to_sec((int64_t)t - (int64_t)block.t_ms(index - 1));
+                        if (dt <= (int64_t)deadtime) {
+                            ticks[i] = block.get_tick(index - 1);
+                            ++found;
+                        }
+                        break;
+                    }
+                    if (key <= first_hour) break;
+                }
+            }
+            return found;
+        }
+
+        /** \brief Get a cursor over the ticks in [t_ms_start, t_ms_stop]
+         * \param t_ms_start   Start time (milliseconds)
+         * \param t_ms_stop    Stop time (milliseconds, inclusive)
+         * \return Cursor positioned at the first tick not earlier than t_ms_start
+         */
+        inline TickCursor get_tick_cursor(
+                const uint64_t t_ms_start,
+                const uint64_t t_ms_stop = std::numeric_limits<uint64_t>::max()) noexcept {
+            return TickCursor(this, t_ms_start, t_ms_stop);
+        }
+
+        /** \brief Get a cursor over the minute candles in [t_start, t_stop]
+         * \param t_start  Start time (seconds)
+         * \param t_stop   Stop time (seconds, inclusive)
+         * \return Cursor positioned at the first candle not earlier than t_start
+         */
+        inline CandleCursor get_candle_cursor(
+                const uint64_t t_start,
+                const uint64_t t_stop = std::numeric_limits<uint64_t>::max()) noexcept {
+            return CandleCursor(this, t_start, t_stop);
+        }
     };
 
 };
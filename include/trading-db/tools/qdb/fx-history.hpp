@@ -7,6 +7,7 @@
 #include "../../qdb.hpp"
 #include "../../utils/async-tasks.hpp"
 #include "fx-symbols-db.hpp"
+#include "history-steps.hpp"
 #include <ztime.hpp>
 #include <vector>
 #include <set>
@@ -32,6 +33,8 @@ namespace trading_db {
             double                      tick_period         = 1.0;      /**< Период тиков внутри бара (в секундах) */
             uint64_t                    timeframe           = 60;       /**< Таймфрейм исторических данных (в секундах) */
             bool                        use_new_tick_mode   = false;    /**< Режим "новый тик" разрешает событие on_test только при наступлении нового тика */
+            bool                        use_event_mode      = false;    /**< Режим "по событиям" сразу переходит к шагу со следующим тиком или баром, пропуская шаги без событий */
+            size_t                      db_connections      = 2;        /**< Количество соединений с БД символа, общих для всех рабочих потоков (0 - свои соединения у каждого потока) */
 
             std::vector<TimePeriod>     trade_period;                   /**< Периоды торговли */
 
@@ -115,6 +118,8 @@ namespace trading_db {
             std::vector<bool>                   candle_flag;
             std::vector<std::set<int32_t>>      period_id;
             QDB_TIMEFRAMES                      timeframe = QDB_TIMEFRAMES::PERIOD_M1;
+            bool                                use_tick_candles = false;   // бары нестандартного таймфрейма формируются из тиков
+            QdbHistorySteps                     steps;                      // пропуск шагов без событий (use_event_mode)
             std::map<std::string, size_t>       symbol_to_index;
             std::map<std::thread::id, size_t>   thread_id_to_index;
             std::mutex                          thread_id_mutex;
@@ -135,6 +140,7 @@ namespace trading_db {
         } m_internal_config;
 
         std::vector<std::shared_ptr<QdbFxSymbolDB>> m_symbol_db;
+        std::vector<std::shared_ptr<QdbReadPool>>   m_read_pool;
         utils::AsyncTasks                           m_async_tasks;
 
         Config      m_config;
@@ -142,10 +148,24 @@ namespace trading_db {
         // Инициализация базы данных
         inline bool init_db() {
             m_symbol_db.clear();
+            m_read_pool.clear();
             const size_t number_threads = std::thread::hardware_concurrency();
+            // общие для всех потоков соединения, карты наличия блоков и кэш блоков
+            if (m_config.db_connections) {
+                const size_t connections = std::min(m_config.db_connections, (size_t)std::max(number_threads, (size_t)1));
+                for (size_t s = 0; s < m_config.symbols.size(); ++s) {
+                    m_read_pool.push_back(std::make_shared<QdbReadPool>());
+                    const std::string file_name = QdbFxSymbolDB::get_file_name(m_config, s);
+                    if (!m_read_pool[s]->open(file_name, connections)) {
+                        if (m_config.on_msg) m_config.on_msg("Database opening error! File name: " + file_name);
+                        return false;
+                    }
+                }
+            }
             for (size_t s = 0; s < number_threads; ++s) {
                 m_symbol_db.push_back(std::make_shared<QdbFxSymbolDB>());
                 m_symbol_db[s]->set_config(m_config);
+                m_symbol_db[s]->set_read_pools(m_read_pool);
                 if (!m_symbol_db[s]->init()) return false;
             }
             for (size_t s = 0; s < m_config.symbols.size(); ++s) {
@@ -159,7 +179,7 @@ namespace trading_db {
             const uint64_t tick_period_ms = (uint64_t)(m_config.tick_period * (double)ztime::MS_PER_SEC + 0.5);
             // Таймфрейм баров
             const uint64_t timeframe_ms = m_config.timeframe * (uint64_t)ztime::MS_PER_SEC;
-            m_internal_config.timeframe = static_cast<QDB_TIMEFRAMES>(m_config.timeframe / ztime::SEC_PER_MIN);
+            m_internal_config.use_tick_candles = !QDB::get_timeframe(m_config.timeframe, m_internal_config.timeframe);
 
             // Настариваем фильтр времени
             for (uint64_t t_ms = 0; t_ms < ztime::MS_PER_DAY; t_ms += tick_period_ms) {
@@ -181,6 +201,10 @@ namespace trading_db {
                     m_internal_config.candle_flag.push_back(is_candle);
                 }
             }
+            m_internal_config.steps.init(
+                m_internal_config.time_step_ms,
+                m_internal_config.candle_flag,
+                m_internal_config.period_id);
             return true;
         }
 
@@ -221,6 +245,33 @@ namespace trading_db {
                         const uint64_t tick_period_ms = (uint64_t)(m_config.tick_period * (double)ztime::MS_PER_SEC + 0.5);
                         const uint64_t date_step_ms = ztime::MS_PER_DAY;
 
+                        // Время последнего пройденного шага и флаг обязательного следующего шага (режим "по событиям")
+                        uint64_t    last_step_ms        = 0;
+                        bool        is_step_required    = true;
+
+                        // Пропускаем шаги, на которых не может произойти событие
+                        auto skip_steps = [&](const size_t i, const uint64_t date_ms) -> size_t {
+                            if (!m_config.use_event_mode || is_step_required) return i;
+                            // on_test вызывается на каждом шаге периода или ожидает новый тик
+                            const bool use_period = m_config.on_test &&
+                                date_ms >= start_date_ms &&
+                                (!m_config.use_new_tick_mode || is_new_tick);
+                            if (m_internal_config.steps.get_required_step(i, use_period) == i) return i;
+                            trading_db::Tick next_tick;
+                            const uint64_t next_tick_ms =
+                                m_symbol_db[n]->get_next_tick_ms(next_tick, s, last_step_ms, date_ms + ztime::MS_PER_DAY - 1) ?
+                                next_tick.t_ms : 0;
+                            return m_internal_config.steps.get_next_step(i, date_ms, next_tick_ms, use_period);
+                        };
+
+                        // Переходим к следующему шагу. После шага бара следующий шаг проходится всегда,
+                        // так как on_tick на нем может получить тик, пришедший до бара
+                        auto next_step = [&](const size_t i, const uint64_t date_ms) -> size_t {
+                            last_step_ms = date_ms + m_internal_config.time_step_ms[i];
+                            is_step_required = m_internal_config.candle_flag[i];
+                            return skip_steps(i + 1, date_ms);
+                        };
+
                         // Цикл по дате
                         for (uint64_t date_ms = pre_start_date_ms;
                             date_ms <= stop_date_ms;
@@ -234,19 +285,29 @@ namespace trading_db {
                             //} Выводим сообщение о дате
 
                             // цикл по времени внутри дня
-                            for (size_t i = 0; i < m_internal_config.time_step_ms.size(); ++i) {
+                            for (size_t i = skip_steps(0, date_ms);
+                                    i < m_internal_config.time_step_ms.size();
+                                    i = next_step(i, date_ms)) {
                                 // время внутри дня
                                 const uint64_t t_ms = date_ms + m_internal_config.time_step_ms[i];
 
                                 if (m_internal_config.candle_flag[i]) {
                                     //{ Вызываем on_candle
                                     const uint64_t t = ztime::ms_to_sec(t_ms);
-                                    const uint64_t timestamp_minute = ztime::get_first_timestamp_minute(t);
-                                    const uint64_t timestamp_candle = timestamp_minute - ztime::SEC_PER_MIN;
                                     trading_db::Candle db_candle;
-                                    if (m_symbol_db[n]->get_candle(db_candle, s, timestamp_candle, m_internal_config.timeframe)) {
-                                        m_config.on_candle(n, s, t_ms, m_internal_config.period_id[i], db_candle);
-                                        last_update_time_ms = (db_candle.timestamp + ztime::SEC_PER_MIN) * ztime::MS_PER_SEC;
+                                    if (m_internal_config.use_tick_candles) {
+                                        // закрытый бар из тиков
+                                        if (m_symbol_db[n]->get_tick_candle(db_candle, s, t - 1, m_config.timeframe)) {
+                                            m_config.on_candle(n, s, t_ms, m_internal_config.period_id[i], db_candle);
+                                            last_update_time_ms = (db_candle.timestamp + m_config.timeframe) * ztime::MS_PER_SEC;
+                                        }
+                                    } else {
+                                        const uint64_t timestamp_minute = ztime::get_first_timestamp_minute(t);
+                                        const uint64_t timestamp_candle = timestamp_minute - ztime::SEC_PER_MIN;
+                                        if (m_symbol_db[n]->get_candle(db_candle, s, timestamp_candle, m_internal_config.timeframe)) {
+                                            m_config.on_candle(n, s, t_ms, m_internal_config.period_id[i], db_candle);
+                                            last_update_time_ms = (db_candle.timestamp + ztime::SEC_PER_MIN) * ztime::MS_PER_SEC;
+                                        }
                                     }
                                     // для режима вызова on_test по новому тику
                                     if (m_config.use_new_tick_mode) {
@@ -327,6 +388,34 @@ namespace trading_db {
                     std::vector<bool> is_new_tick(m_config.symbols.size(), false);
                     std::vector<uint64_t> last_update_time_ms(m_config.symbols.size(), 0);
 
+                    // Время последнего пройденного шага и флаг обязательного следующего шага (режим "по событиям")
+                    uint64_t    last_step_ms        = 0;
+                    bool        is_step_required    = true;
+
+                    // Пропускаем шаги, на которых не может произойти событие ни для одного символа
+                    auto skip_steps = [&](const size_t i, const uint64_t date_ms) -> size_t {
+                        if (!m_config.use_event_mode || is_step_required) return i;
+                        const bool use_period = m_config.on_test &&
+                            date_ms >= start_date_ms &&
+                            !m_config.use_new_tick_mode;
+                        if (m_internal_config.steps.get_required_step(i, use_period) == i) return i;
+                        uint64_t next_tick_ms = 0;
+                        for (size_t s = 0; s < m_config.symbols.size(); ++s) {
+                            trading_db::Tick next_tick;
+                            if (!m_symbol_db[n]->get_next_tick_ms(next_tick, s, last_step_ms, date_ms + ztime::MS_PER_DAY - 1)) continue;
+                            if (!next_tick_ms || next_tick.t_ms < next_tick_ms) next_tick_ms = next_tick.t_ms;
+                        }
+                        return m_internal_config.steps.get_next_step(i, date_ms, next_tick_ms, use_period);
+                    };
+
+                    // Переходим к следующему шагу. После шага бара следующий шаг проходится всегда,
+                    // так как on_tick на нем может получить тик, пришедший до бара
+                    auto next_step = [&](const size_t i, const uint64_t date_ms) -> size_t {
+                        last_step_ms = date_ms + m_internal_config.time_step_ms[i];
+                        is_step_required = m_internal_config.candle_flag[i];
+                        return skip_steps(i + 1, date_ms);
+                    };
+
                     // Цикл по дате с шагом в 1 день
                     for (uint64_t date_ms = pre_start_date_ms;
                         date_ms <= stop_date_ms;
@@ -339,20 +428,25 @@ namespace trading_db {
                         //} Выводим сообщение о дате
 
                         // Цикл по времени внутри дня
-                        for (size_t i = 0; i < m_internal_config.time_step_ms.size(); ++i) {
+                        for (size_t i = skip_steps(0, date_ms);
+                                i < m_internal_config.time_step_ms.size();
+                                i = next_step(i, date_ms)) {
                             const uint64_t t_ms = date_ms + m_internal_config.time_step_ms[i];
                             // Цикл по символам
                             for (size_t s = 0; s < m_config.symbols.size(); ++s) {
                                 if (m_internal_config.candle_flag[i]) {
                                     //{ Вызываем on_candle
                                     const uint64_t t = ztime::ms_to_sec(t_ms);
-                                    const uint64_t t_tf = ztime::SEC_PER_MIN * static_cast<uint64_t>(m_internal_config.timeframe);
+                                    const uint64_t t_tf = m_config.timeframe;
                                     const uint64_t t_open_candle = t - t % t_tf - t_tf;
 
                                     trading_db::Candle db_candle;
-                                    if (m_symbol_db[n]->get_candle(db_candle, s, t_open_candle, m_internal_config.timeframe)) {
+                                    const bool is_candle = m_internal_config.use_tick_candles ?
+                                        m_symbol_db[n]->get_tick_candle(db_candle, s, t_open_candle + t_tf - 1, t_tf) :
+                                        m_symbol_db[n]->get_candle(db_candle, s, t_open_candle, m_internal_config.timeframe);
+                                    if (is_candle) {
                                         m_config.on_candle(n, s, t_ms, m_internal_config.period_id[i], db_candle);
-                                        last_update_time_ms[s] = ztime::sec_to_ms(db_candle.timestamp + ztime::SEC_PER_MIN * static_cast<uint64_t>(m_internal_config.timeframe));
+                                        last_update_time_ms[s] = ztime::sec_to_ms(db_candle.timestamp + t_tf);
                                     }
 
                                     // для режима вызова on_test по новому тику
@@ -465,7 +559,7 @@ namespace trading_db {
         // on_candle
         // on_tick
         // on_test
-        // Это связано с тем, что для каждого рабочего потока есть своя копия базы данных, с которой нужно работать
+        // Это связано с тем, что для каждого рабочего потока есть свой курсор (буфер цен) базы данных, с которым нужно работать
 
         inline bool get_candle(
                 Candle &candle,
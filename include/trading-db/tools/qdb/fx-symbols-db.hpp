@@ -78,6 +78,7 @@ namespace trading_db {
     private:
         Config                                  m_config;
         std::vector<std::shared_ptr<QDB>>       m_symbol_db;
+        std::vector<std::shared_ptr<QdbReadPool>> m_read_pool;          // общие пулы соединений (необязательно)
         std::map<std::string, size_t>           m_currency_to_index; // соотношение (валюта)-(индекс валюты)
         std::vector<std::pair<size_t,size_t>>   m_symbol_currency;
         std::vector<size_t>                     m_cross_symbol;
@@ -90,7 +91,14 @@ namespace trading_db {
             m_symbol_db.clear();
             for (size_t s = 0; s < m_config.symbols.size(); ++s) {
                 m_symbol_db.push_back(std::make_shared<trading_db::QDB>());
-                const std::string file_name = m_config.path_db + "\\" + m_config.symbols[s].symbol + ".qdb";
+                if (s < m_read_pool.size() && m_read_pool[s]) {
+                    if (!m_symbol_db[s]->open(m_read_pool[s])) {
+                        if (m_config.on_msg) m_config.on_msg("Database opening error! File name: " + m_read_pool[s]->get_path());
+                        return false;
+                    }
+                    continue;
+                }
+                const std::string file_name = get_file_name(m_config, s);
                 if (!m_symbol_db[s]->open(file_name, true)) {
                     if (m_config.on_msg) m_config.on_msg("Database opening error! File name: " + file_name);
                     return false;
@@ -173,21 +181,24 @@ namespace trading_db {
             return true;
         }
 
-        // Рассчет профита, реализовано по статье: https://www.mql5.com/ru/articles/10211
+        // Индекс символа с переводным курсом для валюты депозита (size() - не нужен)
+        inline size_t get_cross_index(const size_t s_index) const noexcept {
+            if (m_symbol_currency[s_index].second == m_account_currency_index) return m_config.symbols.size();
+            if (m_cross_symbol[s_index] < m_config.symbols.size()) return m_cross_symbol[s_index];
+            return m_cross_symbol_invert[s_index];
+        }
+
+        // Рассчет профита по ценам открытия, закрытия и переводного курса (cross_tick на момент закрытия)
         inline bool calc_profit(
                 const size_t s_index,
                 const double lot,
-                const uint64_t t_open_ms,
-                const uint64_t t_close_ms,
+                const Tick &open_tick,
+                const Tick &close_tick,
+                const Tick &cross_tick,
                 const bool direction,
                 double &open_price,
                 double &close_price,
-                double &profit) {
-            // Получаем актуальные цены
-            trading_db::Tick open_tick, close_tick;
-            if (!m_symbol_db[s_index]->get_tick_ms(open_tick, t_open_ms)) return false;
-            if (!m_symbol_db[s_index]->get_tick_ms(close_tick, t_close_ms)) return false;
-
+                double &profit) noexcept {
             open_price = direction ? open_tick.ask : open_tick.bid;
             close_price = direction ? close_tick.bid : close_tick.ask;
 
@@ -208,23 +219,86 @@ namespace trading_db {
 
             // Валюта депозита находится в нижней части переводного курса
             if (m_cross_symbol[s_index] < m_config.symbols.size()) {
-                trading_db::Tick last_tick;
-                if (!m_symbol_db[m_cross_symbol[s_index]]->get_tick_ms(last_tick, t_close_ms)) return false;
-                profit = mult * last_tick.bid;
+                profit = mult * cross_tick.bid;
                 return true;
             }
             // Валюта депозита находится в верхней части переводного курса
             if (m_cross_symbol_invert[s_index] < m_config.symbols.size()) {
-                trading_db::Tick last_tick;
-                if (!m_symbol_db[m_cross_symbol_invert[s_index]]->get_tick_ms(last_tick, t_close_ms)) return false;
-                profit = mult / last_tick.ask;
+                profit = mult / cross_tick.ask;
                 return true;
             }
             return false;
         }
 
+        // Рассчет профита, реализовано по статье: https://www.mql5.com/ru/articles/10211
+        inline bool calc_profit(
+                const size_t s_index,
+                const double lot,
+                const uint64_t t_open_ms,
+                const uint64_t t_close_ms,
+                const bool direction,
+                double &open_price,
+                double &close_price,
+                double &profit) {
+            // Получаем актуальные цены
+            trading_db::Tick open_tick, close_tick, cross_tick;
+            if (!m_symbol_db[s_index]->get_tick_ms(open_tick, t_open_ms)) return false;
+            if (!m_symbol_db[s_index]->get_tick_ms(close_tick, t_close_ms)) return false;
+
+            const size_t cross_index = get_cross_index(s_index);
+            if (cross_index < m_config.symbols.size() &&
+                !m_symbol_db[cross_index]->get_tick_ms(cross_tick, t_close_ms)) return false;
+
+            return calc_profit(s_index, lot, open_tick, close_tick, cross_tick, direction, open_price, close_price, profit);
+        }
+
+        // Подготовка результата сделки: индекс символа и даты открытия и закрытия
+        inline bool init_trade_result(
+                const TradeFxSignal &signal,
+                TradeFxResult       &result,
+                size_t              &s_index) noexcept {
+            if (signal.close_date_ms != 0 && signal.close_date_ms < signal.open_date_ms) return false;
+
+            const uint64_t open_date_ms     = signal.open_date_ms + signal.open_delay_ms;
+            const uint64_t close_date_ms    = signal.close_date_ms == 0 ?
+                (open_date_ms + signal.duration_ms + signal.close_delay_ms) :
+                (signal.close_date_ms + signal.close_delay_ms);
+
+            result.send_date_ms = signal.open_date_ms;
+            result.open_date_ms = open_date_ms;
+            result.close_date_ms = close_date_ms;
+            result.success = false;
+            result.win = false;
+
+            if (signal.symbol.empty()) {
+                s_index = signal.symbol_index;
+            } else {
+                auto it = m_symbol_to_index.find(signal.symbol);
+                if (it == m_symbol_to_index.end()) return false;
+                s_index = it->second;
+            }
+            return s_index < m_config.symbols.size();
+        }
+
+        // Завершение результата сделки после рассчета профита
+        inline void finish_trade_result(
+                const TradeFxSignal &signal,
+                const size_t        s_index,
+                TradeFxResult       &result) noexcept {
+            result.pips = signal.direction ? (result.close_price - result.open_price) : (result.open_price - result.close_price);
+            result.pips /= m_config.symbols[s_index].point;
+            result.win = (result.profit > 0);
+            result.success = true;
+        }
+
     public:
 
+        /** \brief Получить путь к файлу БД символа
+         */
+        static inline std::string get_file_name(const Config &config, const size_t s_index) noexcept {
+            return config.path_db + "\\" + config.symbols[s_index].symbol + ".qdb";
+        }
+
         QdbFxSymbolDB() {};
         ~QdbFxSymbolDB() {};
 
@@ -236,6 +310,13 @@ namespace trading_db {
             m_config = arg_config;
         }
 
+        /** \brief Установить общие пулы соединений (по одному на символ, в порядке config.symbols)
+         * Символы с пулом открываются поверх него, остальные - собственным соединением. Вызывается до init()
+         */
+        inline void set_read_pools(const std::vector<std::shared_ptr<QdbReadPool>> &pools) noexcept {
+            m_read_pool = pools;
+        }
+
         inline bool init() noexcept {
             if (!init_db()) return false;
             if (!init_config()) return false;
@@ -247,47 +328,99 @@ namespace trading_db {
                 const TradeFxSignal &signal,    // Сигнал
                 TradeFxResult       &result     // Результат сигнала
                 ) {
-
-            if (signal.close_date_ms != 0 && signal.close_date_ms < signal.open_date_ms) return false;
-
-            const uint64_t open_date_ms     = signal.open_date_ms + signal.open_delay_ms;
-            const uint64_t close_date_ms    = signal.close_date_ms == 0 ?
-                (open_date_ms + signal.duration_ms + signal.close_delay_ms) :
-                (signal.close_date_ms + signal.close_delay_ms);
-
-            result.send_date_ms = signal.open_date_ms;
-            result.open_date_ms = open_date_ms;
-            result.close_date_ms = close_date_ms;
-            result.success = false;
-            result.win = false;
-
             size_t s_index = 0;
-            if (signal.symbol.empty()) {
-                s_index = signal.symbol_index;
-            } else {
-                auto it = m_symbol_to_index.find(signal.symbol);
-                if (it == m_symbol_to_index.end()) return false;
-                s_index = it->second;
-            }
+            if (!init_trade_result(signal, result, s_index)) return false;
 
             if (!calc_profit(
                 s_index,
                 signal.lot_size,
-                open_date_ms,
-                close_date_ms,
+                (uint64_t)result.open_date_ms,
+                (uint64_t)result.close_date_ms,
                 signal.direction,
                 result.open_price,
                 result.close_price,
                 result.profit)) {
                 return false;
             }
-            result.pips = signal.direction ? (result.close_price - result.open_price) : (result.open_price - result.close_price);
-            result.pips /= m_config.symbols[s_index].point;
-            result.win = (result.profit > 0);
-            result.success = true;
+            finish_trade_result(signal, s_index, result);
             return true;
         }
 
+        /** \brief Рассчитать результаты множества сделок
+         *
+         * Цены запрашиваются пакетно: для каждого символа все моменты времени сортируются
+         * и блоки тиков проходятся один раз (QDB::get_ticks_at)
+         * \param signals Сигналы
+         * \param results Результаты сигналов (в порядке signals, у неудачных success == false)
+         * \return Количество успешно рассчитанных сделок
+         */
+        size_t calc_trade_results(
+                const std::vector<TradeFxSignal> &signals,
+                std::vector<TradeFxResult>       &results) {
+            const size_t symbols_count = m_config.symbols.size();
+            results.assign(signals.size(), TradeFxResult());
+            std::vector<size_t> trade_symbol(signals.size(), symbols_count);
+
+            // собираем моменты времени по символам: [2*n] - открытие сделки n, [2*n+1] - закрытие
+            // запросы переводного курса собираются отдельно
+            std::vector<std::vector<uint64_t>>  times(symbols_count), cross_times(symbols_count);
+            std::vector<std::vector<size_t>>    trades(symbols_count), cross_trades(symbols_count);
+            for (size_t n = 0; n < signals.size(); ++n) {
+                size_t s_index = 0;
+                if (!init_trade_result(signals[n], results[n], s_index)) continue;
+                trade_symbol[n] = s_index;
+                times[s_index].push_back((uint64_t)results[n].open_date_ms);
+                times[s_index].push_back((uint64_t)results[n].close_date_ms);
+                trades[s_index].push_back(n);
+                const size_t cross_index = get_cross_index(s_index);
+                if (cross_index >= symbols_count) continue;
+                cross_times[cross_index].push_back((uint64_t)results[n].close_date_ms);
+                cross_trades[cross_index].push_back(n);
+            }
+
+            std::vector<Tick> open_ticks(signals.size()), close_ticks(signals.size()), cross_ticks(signals.size());
+            std::vector<Tick> ticks;
+            for (size_t s = 0; s < symbols_count; ++s) {
+                if (!trades[s].empty()) {
+                    m_symbol_db[s]->get_ticks_at(times[s], ticks);
+                    for (size_t k = 0; k < trades[s].size(); ++k) {
+                        open_ticks[trades[s][k]] = ticks[2 * k];
+                        close_ticks[trades[s][k]] = ticks[2 * k + 1];
+                    }
+                }
+                if (!cross_trades[s].empty()) {
+                    m_symbol_db[s]->get_ticks_at(cross_times[s], ticks);
+                    for (size_t k = 0; k < cross_trades[s].size(); ++k) {
+                        cross_ticks[cross_trades[s][k]] = ticks[k];
+                    }
+                }
+            }
+
+            size_t count = 0;
+            for (size_t n = 0; n < signals.size(); ++n) {
+                const size_t s_index = trade_symbol[n];
+                if (s_index >= symbols_count) continue;
+                if (!open_ticks[n].t_ms || !close_ticks[n].t_ms) continue;
+                if (get_cross_index(s_index) < symbols_count && !cross_ticks[n].t_ms) continue;
+                TradeFxResult &result = results[n];
+                if (!calc_profit(
+                    s_index,
+                    signals[n].lot_size,
+                    open_ticks[n],
+                    close_ticks[n],
+                    cross_ticks[n],
+                    signals[n].direction,
+                    result.open_price,
+                    result.close_price,
+                    result.profit)) {
+                    continue;
+                }
+                finish_trade_result(signals[n], s_index, result);
+                ++count;
+            }
+            return count;
+        }
+
         inline bool get_candle(
                 Candle &candle,
                 const size_t s_index,
@@ -308,6 +441,17 @@ namespace trading_db {
             return m_symbol_db[it->second]->get_candle(candle, t, p, m);
         }
 
+        /** \brief Получить бар произвольного периода (в секундах), сформированный из тиков к моменту t
+         */
+        inline bool get_tick_candle(
+                Candle &candle,
+                const size_t s_index,
+                const uint64_t t,
+                const uint64_t period,
+                const QDB_PRICE_MODE mode = QDB_PRICE_MODE::BID_PRICE) noexcept {
+            return m_symbol_db[s_index]->get_tick_candle(candle, t, period, mode);
+        }
+
         inline bool get_tick(Tick &tick, const size_t s_index, const uint64_t t) noexcept {
             return m_symbol_db[s_index]->get_tick(tick, t);
         }
@@ -0,0 +1,81 @@
+#pragma once
+#ifndef TRADING_DB_QDB_HISTORY_STEPS_HPP_INCLUDED
+#define TRADING_DB_QDB_HISTORY_STEPS_HPP_INCLUDED
+
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <cstdint>
+
+namespace trading_db {
+
+	/** \brief Пропуск шагов тестера, на которых не может произойти событие
+	 *
+	 * Тестер проходит день по сетке шагов. Событие возможно только на шаге бара,
+	 * на шаге периода торговли (если on_test вызывается на каждом таком шаге)
+	 * и на первом шаге не раньше следующего тика. Остальные шаги можно пропустить,
+	 * не меняя последовательность вызовов on_tick, on_candle и on_test.
+	 */
+	class QdbHistorySteps {
+	public:
+
+		/** \brief Инициализировать сетку шагов дня
+		 * \param time_step_ms	Время шагов от начала дня (мс, по возрастанию)
+		 * \param candle_flag	Флаги шагов бара
+		 * \param period_id		Периоды торговли шагов
+		 */
+		void init(
+				const std::vector<uint64_t>				&time_step_ms,
+				const std::vector<bool>					&candle_flag,
+				const std::vector<std::set<int32_t>>	&period_id) noexcept {
+			step_ms = time_step_ms;
+			const size_t n = step_ms.size();
+			next_candle_step.assign(n + 1, n);
+			next_period_step.assign(n + 1, n);
+			for (size_t i = n; i > 0; --i) {
+				next_candle_step[i - 1] = candle_flag[i - 1] ? (i - 1) : next_candle_step[i];
+				next_period_step[i - 1] = !period_id[i - 1].empty() ? (i - 1) : next_period_step[i];
+			}
+		}
+
+		/** \brief Получить первый шаг, который нельзя пропустить независимо от тиков
+		 * \param i			Первый из еще не пройденных шагов дня
+		 * \param use_period	Шаги периодов торговли нельзя пропускать
+		 * \return Индекс шага (количество шагов, если таких шагов до конца дня нет)
+		 */
+		inline size_t get_required_step(const size_t i, const bool use_period) const noexcept {
+			const size_t n = step_ms.size();
+			if (i >= n) return n;
+			return std::min(next_candle_step[i], use_period ? next_period_step[i] : n);
+		}
+
+		/** \brief Получить первый шаг, на котором может произойти событие
+		 * \param i				Первый из еще не пройденных шагов дня
+		 * \param date_ms		Начало дня (мс)
+		 * \param next_tick_ms	Время первого тика после последнего пройденного шага (мс, 0 - тиков нет)
+		 * \param use_period	Шаги периодов торговли нельзя пропускать
+		 * \return Индекс шага (количество шагов, если до конца дня событий нет)
+		 */
+		size_t get_next_step(
+				const size_t	i,
+				const uint64_t	date_ms,
+				const uint64_t	next_tick_ms,
+				const bool		use_period) const noexcept {
+			const size_t n = step_ms.size();
+			if (i >= n) return n;
+			const size_t required = get_required_step(i, use_period);
+			if (!next_tick_ms) return required;
+			if (next_tick_ms <= date_ms + step_ms[i]) return i;
+			const size_t tick_step = std::lower_bound(
+				step_ms.begin() + i, step_ms.end(), next_tick_ms - date_ms) - step_ms.begin();
+			return std::min(required, tick_step);
+		}
+
+	private:
+		std::vector<uint64_t>	step_ms;
+		std::vector<size_t>		next_candle_step;
+		std::vector<size_t>		next_period_step;
+	}; // QdbHistorySteps
+}; // trading_db
+
+#endif // TRADING_DB_QDB_HISTORY_STEPS_HPP_INCLUDED
@@ -6,6 +6,7 @@
 #include "../../parts/qdb/data-classes.hpp"
 #include "../../qdb.hpp"
 #include "../../utils/async-tasks.hpp"
+#include "history-steps.hpp"
 #include "ztime.hpp"
 #include <vector>
 #include <set>
@@ -28,6 +29,7 @@ namespace trading_db {
 			double						tick_period			= 1.0;		/**< Период тиков внутри бара (в секундах) */
 			uint64_t					timeframe			= 60.0;		/**< Таймфрейм исторических данных (в секундах) */
 			bool						use_new_tick_mode	= false;	/**< Режим "новый тик" разрешает событие on_test только при наступлении нового тика */
+			bool						use_event_mode		= false;	/**< Режим "по событиям" сразу переходит к шагу со следующим тиком или баром, пропуская шаги без событий */
 			QDB_PRICE_MODE				trade_price_mode 	= QDB_PRICE_MODE::AVG_PRICE;
 
 			std::vector<TimePeriod>		trade_period;					/**< Периоды торговли */
@@ -139,6 +141,8 @@ namespace trading_db {
 			std::vector<bool>				candle_flag;
 			std::vector<std::set<int32_t>>	period_id;
 			QDB_TIMEFRAMES					timeframe	= QDB_TIMEFRAMES::PERIOD_M1;
+			bool							use_tick_candles = false;	// бары нестандартного таймфрейма формируются из тиков
+			QdbHistorySteps					steps;						// пропуск шагов без событий (use_event_mode)
 
 		} internal_config;
 
@@ -154,9 +158,12 @@ namespace trading_db {
 			const uint64_t tick_period_ms = (uint64_t)(user_config.tick_period * (double)ztime::MS_PER_SEC + 0.5);
 			const uint64_t timeframe_ms = user_config.timeframe * (uint64_t)ztime::MS_PER_SEC;
 
-			internal_config.timeframe = static_cast<QDB_TIMEFRAMES>(user_config.timeframe / 60);
+			internal_config.use_tick_candles = !QDB::get_timeframe(user_config.timeframe, internal_config.timeframe);
 
 			//{ Настариваем фильтр времени
+			internal_config.time_step_ms.clear();
+			internal_config.period_id.clear();
+			internal_config.candle_flag.clear();
 			for (uint64_t t_ms = 0; t_ms < ztime::MS_PER_DAY; t_ms += tick_period_ms) {
 				const uint64_t t = t_ms / ztime::MS_PER_SEC;
 				std::set<int32_t> period_id;
@@ -176,6 +183,10 @@ namespace trading_db {
 					internal_config.candle_flag.push_back(is_candle);
 				}
 			}
+			internal_config.steps.init(
+				internal_config.time_step_ms,
+				internal_config.candle_flag,
+				internal_config.period_id);
 			//}
 
 			//{ Открываем все БД
@@ -301,6 +312,33 @@ namespace trading_db {
 
 						const uint64_t tick_period_ms = (uint64_t)(local_config.tick_period * (double)ztime::MS_PER_SEC + 0.5);
 						const uint64_t date_step_ms = ztime::MS_PER_DAY;
+
+						// Время последнего пройденного шага и флаг обязательного следующего шага (режим "по событиям")
+						uint64_t	last_step_ms		= 0;
+						bool		is_step_required	= true;
+
+						// Пропускаем шаги, на которых не может произойти событие
+						auto skip_steps = [&](const size_t i, const uint64_t date_ms) -> size_t {
+							if (!local_config.use_event_mode || is_step_required) return i;
+							// on_test вызывается на каждом шаге периода или ожидает новый тик
+							const bool use_period = local_config.on_test &&
+								(!local_config.use_new_tick_mode || is_new_tick);
+							if (internal_config.steps.get_required_step(i, use_period) == i) return i;
+							trading_db::Tick next_tick;
+							const uint64_t next_tick_ms =
+								symbols_db[s]->get_next_tick_ms(next_tick, last_step_ms, date_ms + ztime::MS_PER_DAY - 1) ?
+								next_tick.t_ms : 0;
+							return internal_config.steps.get_next_step(i, date_ms, next_tick_ms, use_period);
+						};
+
+						// Переходим к следующему шагу. После шага бара следующий шаг проходится всегда,
+						// так как on_tick на нем может получить тик, пришедший до бара
+						auto next_step = [&](const size_t i, const uint64_t date_ms) -> size_t {
+							last_step_ms = date_ms + internal_config.time_step_ms[i];
+							is_step_required = internal_config.candle_flag[i];
+							return skip_steps(i + 1, date_ms);
+						};
+
 						for (uint64_t
 								date_ms = start_date_ms;
 								date_ms <= stop_date_ms;
@@ -313,25 +351,35 @@ namespace trading_db {
 							}
 							//} Выводим сообщение о дате
 
-							for (size_t i = 0; i < internal_config.time_step_ms.size(); ++i) {
+							for (size_t i = skip_steps(0, date_ms);
+									i < internal_config.time_step_ms.size();
+									i = next_step(i, date_ms)) {
 								uint64_t t_ms = date_ms + internal_config.time_step_ms[i];
 
 								if (internal_config.candle_flag[i]) {
 									//{ Вызываем on_candle
 									const uint64_t t = t_ms / ztime::MS_PER_SEC;
-									const uint64_t timestamp_minute = ztime::get_first_timestamp_minute(t);
-									const uint64_t timestamp_candle = timestamp_minute - ztime::SEC_PER_MIN;
 									trading_db::Candle db_candle;
-									if (symbols_db[s]->get_candle(db_candle, timestamp_candle, internal_config.timeframe)) {
-										local_config.on_candle(s, t_ms, internal_config.period_id[i], db_candle);
-										last_update_time_ms = (db_candle.timestamp + ztime::SEC_PER_MIN) * ztime::MS_PER_SEC;
+									if (internal_config.use_tick_candles) {
+										// закрытый бар из тиков
+										if (symbols_db[s]->get_tick_candle(db_candle, t - 1, local_config.timeframe)) {
+											local_config.on_candle(s, t_ms, internal_config.period_id[i], db_candle);
+											last_update_time_ms = (db_candle.timestamp + local_config.timeframe) * ztime::MS_PER_SEC;
+										}
+									} else {
+										const uint64_t timestamp_minute = ztime::get_first_timestamp_minute(t);
+										const uint64_t timestamp_candle = timestamp_minute - ztime::SEC_PER_MIN;
+										if (symbols_db[s]->get_candle(db_candle, timestamp_candle, internal_config.timeframe)) {
+											local_config.on_candle(s, t_ms, internal_config.period_id[i], db_candle);
+											last_update_time_ms = (db_candle.timestamp + ztime::SEC_PER_MIN) * ztime::MS_PER_SEC;
+										}
 									}
 									// для режима вызова on_test по новому тику
 									if (local_config.use_new_tick_mode) {
 										trading_db::Tick db_tick;
 										if (symbols_db[s]->get_tick_ms(db_tick, t_ms)) {
 											const uint64_t prev_timestamp_ms = t_ms - tick_period_ms;
-											if (db_tick.timestamp_ms > prev_timestamp_ms) {
+											if (db_tick.t_ms > prev_timestamp_ms) {
 												is_new_tick = true;
 											}
 										}
@@ -342,8 +390,8 @@ namespace trading_db {
 									trading_db::Tick db_tick;
 									if (symbols_db[s]->get_tick_ms(db_tick, t_ms)) {
 										//{ Проверяем, что пришел новый тик нового бара
-										if (db_tick.timestamp_ms > last_update_time_ms) {
-											last_update_time_ms = db_tick.timestamp_ms;
+										if (db_tick.t_ms > last_update_time_ms) {
+											last_update_time_ms = db_tick.t_ms;
 											local_config.on_tick(s, t_ms, internal_config.period_id[i], db_tick);
 											is_new_tick = true;
 										}
@@ -0,0 +1,238 @@
+#pragma once
+#ifndef TRADING_DB_QDB_MERGED_STREAM_HPP_INCLUDED
+#define TRADING_DB_QDB_MERGED_STREAM_HPP_INCLUDED
+
+#include "../../parts/qdb/data-classes.hpp"
+#include "../../qdb.hpp"
+#include "ztime.hpp"
+#include <vector>
+#include <memory>
+#include <limits>
+
+namespace trading_db {
+
+	/** \brief Тик с индексом символа
+	 */
+	class QdbMergedTick {
+	public:
+		size_t	s_index = 0;	/**< Индекс символа */
+		Tick	tick;			/**< Тик */
+
+		QdbMergedTick() {};
+
+		QdbMergedTick(const size_t _s_index, const Tick &_tick) :
+			s_index(_s_index), tick(_tick) {};
+	};
+
+	/** \brief Поток тиков нескольких символов в едином порядке времени
+	 *
+	 * Для каждого символа используется курсор тиков QDB::TickCursor, тики курсора
+	 * читаются блоками по часу без копирования. Следующий тик выбирается k-путевым слиянием
+	 * через двоичную кучу по времени тика: O(log N) на тик для N символов.
+	 * Тики с одинаковым временем выдаются в порядке индекса символа.
+	 *
+	 * Поток используется в одном потоке; экземпляры QDB не должны одновременно использоваться в других потоках.
+	 */
+	class QdbMergedStream {
+	public:
+
+		/** \brief Конфигурация потока
+		 */
+		class Config {
+		public:
+			uint64_t window_ms = 0;	/**< Размер окна для next_window (мс, 0 - одна миллисекунда) */
+		} config;
+
+		QdbMergedStream() {};
+
+		/** \brief Инициализировать поток
+		 * \param dbs			Базы данных символов (индекс символа - индекс в массиве)
+		 * \param t_ms_start	Начальное время (мс)
+		 * \param t_ms_stop		Конечное время (мс, включительно)
+		 */
+		QdbMergedStream(
+				const std::vector<std::shared_ptr<QDB>> &dbs,
+				const uint64_t t_ms_start,
+				const uint64_t t_ms_stop = std::numeric_limits<uint64_t>::max()) {
+			init(dbs, t_ms_start, t_ms_stop);
+		}
+
+		/** \brief Инициализировать поток
+		 * \param dbs			Базы данных символов (индекс символа - индекс в массиве)
+		 * \param t_ms_start	Начальное время (мс)
+		 * \param t_ms_stop		Конечное время (мс, включительно)
+		 */
+		void init(
+				const std::vector<std::shared_ptr<QDB>> &dbs,
+				const uint64_t t_ms_start,
+				const uint64_t t_ms_stop = std::numeric_limits<uint64_t>::max()) noexcept {
+			symbols_db = dbs;
+			sources.clear();
+			sources.resize(symbols_db.size());
+			for (size_t s = 0; s < symbols_db.size(); ++s) {
+				if (!symbols_db[s]) continue;
+				sources[s].cursor = symbols_db[s]->get_tick_cursor(t_ms_start, t_ms_stop);
+			}
+			t_stop_ms = t_ms_stop;
+			build_heap();
+		}
+
+		/** \brief Перейти к первому тику со временем не меньше t_ms
+		 * \return Вернет false, если тиков больше нет
+		 */
+		bool seek(const uint64_t t_ms) noexcept {
+			for (size_t s = 0; s < sources.size(); ++s) {
+				if (!symbols_db[s]) continue;
+				sources[s].cursor = symbols_db[s]->get_tick_cursor(t_ms, t_stop_ms);
+			}
+			build_heap();
+			return !heap.empty();
+		}
+
+		/** \brief Получить следующий тик
+		 * \param s_index	Индекс символа
+		 * \param tick		Тик
+		 * \return Вернет false, если тиков больше нет
+		 */
+		inline bool next(size_t &s_index, Tick &tick) noexcept {
+			if (heap.empty()) return false;
+			s_index = heap[0].s_index;
+			Source &source = sources[s_index];
+			tick.t_ms = source.t_ms[source.index];
+			tick.bid = source.bid[source.index];
+			tick.ask = source.ask[source.index];
+			advance();
+			return true;
+		}
+
+		/** \brief Получить следующие тики
+		 * \param ticks	Тики (массив заменяется)
+		 * \param count	Максимальное количество тиков
+		 * \return Количество тиков
+		 */
+		size_t next_batch(std::vector<QdbMergedTick> &ticks, const size_t count) noexcept {
+			ticks.resize(count);
+			size_t n = 0;
+			while (n < count && next(ticks[n].s_index, ticks[n].tick)) ++n;
+			ticks.resize(n);
+			return n;
+		}
+
+		/** \brief Получить тики следующего окна времени
+		 * Окна выровнены по config.window_ms от начала эпохи, пропускаются окна без тиков
+		 * \param window_ms	Начало окна (мс)
+		 * \param ticks		Тики окна (массив заменяется)
+		 * \return Количество тиков (0, если тиков больше нет)
+		 */
+		size_t next_window(uint64_t &window_ms, std::vector<QdbMergedTick> &ticks) noexcept {
+			ticks.clear();
+			if (heap.empty()) return 0;
+			const uint64_t period_ms = std::max(config.window_ms, (uint64_t)1);
+			window_ms = heap[0].t_ms - heap[0].t_ms % period_ms;
+			const uint64_t stop_ms = window_ms + period_ms;
+			QdbMergedTick item;
+			while (!heap.empty() && heap[0].t_ms < stop_ms) {
+				next(item.s_index, item.tick);
+				ticks.push_back(item);
+			}
+			return ticks.size();
+		}
+
+		/** \brief Проверить наличие тиков
+		 */
+		inline bool empty() const noexcept {
+			return heap.empty();
+		}
+
+		/** \brief Время следующего тика (мс, 0 - если тиков больше нет)
+		 */
+		inline uint64_t peek_time() const noexcept {
+			return heap.empty() ? 0 : heap[0].t_ms;
+		}
+
+		/** \brief Проверить, был ли поток символа остановлен из-за блока, который не удалось прочитать
+		 */
+		inline bool is_error() const noexcept {
+			for (const auto &source : sources) {
+				if (source.cursor.is_error()) return true;
+			}
+			return false;
+		}
+
+	private:
+
+		// курсор символа и текущий блок тиков курсора
+		class Source {
+		public:
+			QDB::TickCursor	cursor;
+			const uint64_t	*t_ms	= nullptr;
+			const double	*bid	= nullptr;
+			const double	*ask	= nullptr;
+			size_t			index	= 0;
+			size_t			count	= 0;
+
+			inline bool load() noexcept {
+				index = 0;
+				count = cursor.next_block(t_ms, bid, ask);
+				return count != 0;
+			}
+		};
+
+		// элемент кучи: время следующего тика символа
+		class HeapItem {
+		public:
+			uint64_t	t_ms	= 0;
+			size_t		s_index	= 0;
+
+			inline bool operator<(const HeapItem &other) const noexcept {
+				return t_ms < other.t_ms || (t_ms == other.t_ms && s_index < other.s_index);
+			}
+		};
+
+		std::vector<std::shared_ptr<QDB>>	symbols_db;
+		std::vector<Source>					sources;
+		std::vector<HeapItem>				heap;	// куча с минимумом в корне
+		uint64_t							t_stop_ms = 0;
+
+		void build_heap() noexcept {
+			heap.clear();
+			for (size_t s = 0; s < sources.size(); ++s) {
+				if (!symbols_db[s] || !sources[s].load()) continue;
+				HeapItem item;
+				item.t_ms = sources[s].t_ms[0];
+				item.s_index = s;
+				heap.push_back(item);
+			}
+			for (size_t i = heap.size() / 2; i > 0; --i) sift_down(i - 1);
+		}
+
+		// сдвигаем символ из корня кучи на следующий тик
+		inline void advance() noexcept {
+			Source &source = sources[heap[0].s_index];
+			if (++source.index >= source.count && !source.load()) {
+				heap[0] = heap.back();
+				heap.pop_back();
+				if (!heap.empty()) sift_down(0);
+				return;
+			}
+			heap[0].t_ms = source.t_ms[source.index];
+			sift_down(0);
+		}
+
+		inline void sift_down(size_t i) noexcept {
+			const size_t size = heap.size();
+			const HeapItem item = heap[i];
+			while (true) {
+				size_t child = 2 * i + 1;
+				if (child >= size) break;
+				if (child + 1 < size && heap[child + 1] < heap[child]) ++child;
+				if (!(heap[child] < item)) break;
+				heap[i] = heap[child];
+				i = child;
+			}
+			heap[i] = item;
+		}
+	}; // QdbMergedStream
+}; // trading_db
+
+#endif // TRADING_DB_QDB_MERGED_STREAM_HPP_INCLUDED